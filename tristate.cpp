@@ -13,10 +13,217 @@
     #include "tristate_inl.h"
 #endif
 
+/****************************************************************************/
+/* instrumentation */
+
+#ifdef TRISTATE_INSTRUMENT
+#ifndef TRISTATE_CXX11
+    #error TRISTATE_INSTRUMENT needs C++11.
+#endif
+
+#include <atomic>
+#include <mutex>
+#include <vector>
+#include <algorithm>
+
+namespace
+{
+    typedef std::atomic<uint64_t> instr_counter;
+
+    struct instr_reduction
+    {
+        instr_counter calls;
+        instr_counter short_circuits;
+        instr_counter scanned;
+        instr_counter unknowns;
+        instr_counter histogram[TS_INSTR_HIST_SIZE];
+    };
+
+    struct instr_block
+    {
+        instr_reduction connect_and;
+        instr_reduction connect_or;
+        instr_counter to_bool_calls;
+        instr_counter to_bool_untouched;
+
+        instr_block();
+        ~instr_block();
+    };
+
+    inline void bump(instr_counter& counter, uint64_t count = 1)
+    {
+        counter.fetch_add(count, std::memory_order_relaxed);
+    }
+
+    inline void
+    add_reduction(TS_INSTR_REDUCTION& sum, const instr_reduction& counters)
+    {
+        sum.calls += counters.calls.load(std::memory_order_relaxed);
+        sum.short_circuits +=
+            counters.short_circuits.load(std::memory_order_relaxed);
+        sum.scanned += counters.scanned.load(std::memory_order_relaxed);
+        sum.unknowns += counters.unknowns.load(std::memory_order_relaxed);
+        for (int i = 0; i < TS_INSTR_HIST_SIZE; ++i)
+        {
+            sum.histogram[i] +=
+                counters.histogram[i].load(std::memory_order_relaxed);
+        }
+    }
+
+    inline void add_block(TS_INSTR_SNAPSHOT& sum, const instr_block& block)
+    {
+        add_reduction(sum.connect_and, block.connect_and);
+        add_reduction(sum.connect_or, block.connect_or);
+        sum.to_bool_calls +=
+            block.to_bool_calls.load(std::memory_order_relaxed);
+        sum.to_bool_untouched +=
+            block.to_bool_untouched.load(std::memory_order_relaxed);
+    }
+
+    /* the blocks of the live threads and the sum of the exited ones */
+    struct instr_registry
+    {
+        std::mutex                  mutex;
+        std::vector<instr_block *>  blocks;
+        TS_INSTR_SNAPSHOT           retired;
+    };
+
+    instr_registry& registry()
+    {
+        static instr_registry *s_registry = new instr_registry();
+        return *s_registry;
+    }
+
+    void clear_block(instr_block& block)
+    {
+        instr_counter *first = &block.connect_and.calls;
+        instr_counter *last = &block.to_bool_untouched + 1;
+        for (; first != last; ++first)
+            first->store(0, std::memory_order_relaxed);
+    }
+
+    instr_block::instr_block()
+    {
+        clear_block(*this);
+        instr_registry& reg = registry();
+        std::lock_guard<std::mutex> lock(reg.mutex);
+        reg.blocks.push_back(this);
+    }
+
+    instr_block::~instr_block()
+    {
+        instr_registry& reg = registry();
+        std::lock_guard<std::mutex> lock(reg.mutex);
+        add_block(reg.retired, *this);
+        reg.blocks.erase(std::find(reg.blocks.begin(), reg.blocks.end(),
+                                   this));
+    }
+
+    thread_local instr_block t_block;
+
+    void print_reduction(FILE *fp, const char *name,
+                         const TS_INSTR_REDUCTION& counters)
+    {
+        std::fprintf(fp, "\"%s\":{\"calls\":%llu,\"short_circuits\":%llu,"
+                     "\"scanned\":%llu,\"unknowns\":%llu,\"histogram\":[",
+                     name, (unsigned long long)counters.calls,
+                     (unsigned long long)counters.short_circuits,
+                     (unsigned long long)counters.scanned,
+                     (unsigned long long)counters.unknowns);
+        int last = TS_INSTR_HIST_SIZE;
+        while (last > 1 && counters.histogram[last - 1] == 0)
+            --last;
+        for (int i = 0; i < last; ++i)
+        {
+            std::fprintf(fp, "%s%llu", (i ? "," : ""),
+                         (unsigned long long)counters.histogram[i]);
+        }
+        std::fprintf(fp, "]}");
+    }
+} // namespace
+
+void
+TS_instr_connect(bool is_or, size_t scanned, size_t unknowns,
+                 bool short_circuit)
+{
+    instr_reduction& counters =
+        (is_or ? t_block.connect_or : t_block.connect_and);
+    int bucket = 0;
+    for (size_t n = scanned; n; n >>= 1)
+        ++bucket;
+    bump(counters.calls);
+    bump(counters.scanned, scanned);
+    bump(counters.histogram[bucket]);
+    if (unknowns)
+        bump(counters.unknowns, unknowns);
+    if (short_circuit)
+        bump(counters.short_circuits);
+}
+
+void
+TS_instr_to_bool(TRISTATE value)
+{
+    bump(t_block.to_bool_calls);
+    if (value == TS_UNKNOWN)
+        bump(t_block.to_bool_untouched);
+}
+
+void
+TS_instr_snapshot(TS_INSTR_SNAPSHOT *snapshot)
+{
+    assert(snapshot != NULL);
+    instr_registry& reg = registry();
+    std::lock_guard<std::mutex> lock(reg.mutex);
+    *snapshot = reg.retired;
+    for (size_t i = 0; i < reg.blocks.size(); ++i)
+        add_block(*snapshot, *reg.blocks[i]);
+}
+
+/* counts made by other threads while resetting may survive or be lost */
+void
+TS_instr_reset(void)
+{
+    instr_registry& reg = registry();
+    std::lock_guard<std::mutex> lock(reg.mutex);
+    std::memset(&reg.retired, 0, sizeof(reg.retired));
+    for (size_t i = 0; i < reg.blocks.size(); ++i)
+        clear_block(*reg.blocks[i]);
+}
+
+void
+TS_instr_print(FILE *fp)
+{
+    TS_INSTR_SNAPSHOT snapshot;
+    TS_instr_snapshot(&snapshot);
+    std::fprintf(fp, "{");
+    print_reduction(fp, "connect_and_tri", snapshot.connect_and);
+    std::fprintf(fp, ",");
+    print_reduction(fp, "connect_or_tri", snapshot.connect_or);
+    std::fprintf(fp, ",\"to_bool\":{\"calls\":%llu,\"untouched\":%llu}}\n",
+                 (unsigned long long)snapshot.to_bool_calls,
+                 (unsigned long long)snapshot.to_bool_untouched);
+}
+#endif  /* def TRISTATE_INSTRUMENT */
+
 /****************************************************************************/
 /* unit test */
 
 #ifdef TRISTATE_UNITTEST
+#ifdef TRISTATE_INSTRUMENT
+    #include <thread>
+#endif
+
+#ifdef __cplusplus
+    #include <limits>
+
+    struct tri_record_key
+    {
+        TRISTATE operator()(const std::pair<int, int>& record) const {
+            return (TRISTATE)record.first;
+        }
+    };
+#endif
+
 int main(void)
 {
 #ifdef __cplusplus
@@ -651,6 +858,525 @@ int main(void)
     assert(!TS_not(true));
     assert(TS_not(false));
 
+    {
+        bool bools[70];
+        TS_WORD bits[TS_WORDS(70)];
+        TRISTATE tris[70];
+        size_t i;
+
+        assert(TS_popcount(0) == 0);
+        assert(TS_popcount(~(TS_WORD)0) == 64);
+        assert(TS_ctz(1) == 0);
+        assert(TS_ctz((TS_WORD)1 << 63) == 63);
+
+        for (i = 0; i < 70; ++i)
+            bools[i] = (i % 3 == 0);
+        TS_bool_to_bits(70, bools, bits);
+        assert(TS_bits_count(70, bits) == 24);
+        for (i = 0; i < 70; ++i)
+            assert(TS_bits_get(i, bits) == bools[i]);
+        TS_bits_to_tri(70, bits, tris);
+        assert(tris[0] == TS_TRUE && tris[1] == TS_FALSE);
+        assert(TS_bits_connect_and(70, bits) == TS_connect_and(70, bools));
+        assert(TS_bits_connect_or(70, bits) == TS_connect_or(70, bools));
+        TS_bits_get_tri_totality(&value, 70, bits);
+        assert(value == TS_UNKNOWN);
+
+        TS_bits_each_not(70, bits);
+        TS_each_not(70, bools);
+        for (i = 0; i < 70; ++i)
+            assert(TS_bits_get(i, bits) == bools[i]);
+        TS_bits_to_bool(70, bits, bools);
+        assert(bools[0] == false && bools[1] == true);
+        assert(TS_bits_count(70, bits) == 46);
+        assert(!TS_bits_get(0, bits) && TS_bits_get(1, bits));
+
+        TS_bits_each_or(true, 70, bits);
+        assert(TS_bits_connect_and(70, bits));
+        TS_bits_get_tri_totality(&value, 70, bits);
+        assert(value == TS_TRUE);
+        TS_bits_set(false, 69, bits);
+        assert(!TS_bits_connect_and(70, bits));
+        assert(TS_bits_connect_and(69, bits));
+        flag = false;
+        TS_bits_get_totality(&flag, 70, bits);
+        assert(!flag);
+
+        TS_bits_each_and(false, 70, bits);
+        assert(!TS_bits_connect_or(70, bits));
+        assert(TS_bits_count(70, bits) == 0);
+        TS_bits_get_tri_totality(&value, 70, bits);
+        assert(value == TS_FALSE);
+        TS_bits_set_tri_totality(TS_TRUE, 65, bits);
+        assert(TS_bits_count(70, bits) == 65);
+        TS_bits_set_tri_totality(TS_UNKNOWN, 70, bits);
+        assert(TS_bits_count(70, bits) == 65);
+        TS_bits_get_tri_totality(&value, 0, bits);
+        assert(value == TS_UNKNOWN);
+    }
+
+    {
+        TRISTATE tris[200];
+        TRISTATE8 tri8s[200];
+        bool bools[200];
+        size_t i;
+
+        assert(TS_is_valid_tri8(-1) && TS_is_valid_tri8(0));
+        assert(TS_is_valid_tri8(1) && !TS_is_valid_tri8(2));
+
+        for (i = 0; i < 200; ++i)
+            tris[i] = (TRISTATE)((int)(i % 3) - 1);
+        TS_tri_to_tri8(200, tris, tri8s);
+        for (i = 0; i < 200; ++i)
+            assert(tri8s[i] == tris[i]);
+        assert(TS_connect_and_tri8(200, tri8s) ==
+               TS_connect_and_tri(200, tris));
+        assert(TS_connect_or_tri8(200, tri8s) == TS_connect_or_tri(200, tris));
+        TS_get_tri_totality_tri8(&value, 200, tri8s);
+        assert(value == TS_UNKNOWN);
+
+        TS_tri_each_and_tri8(TS_UNKNOWN, 200, tri8s);
+        TS_tri_each_and_tri(TS_UNKNOWN, 200, tris);
+        for (i = 0; i < 200; ++i)
+            assert(tri8s[i] == tris[i]);
+        TS_each_not_tri8(200, tri8s);
+        TS_each_not_tri(200, tris);
+        for (i = 0; i < 200; ++i)
+            assert(tri8s[i] == tris[i]);
+        TS_tri_each_or_tri8(TS_UNKNOWN, 200, tri8s);
+        TS_tri_each_or_tri(TS_UNKNOWN, 200, tris);
+        TS_tri8_to_tri(200, tri8s, tris);
+        for (i = 0; i < 200; ++i)
+            assert(tri8s[i] == tris[i]);
+        TS_get_tri_totality_tri8(&value, 200, tri8s);
+        assert(value == TS_TRUE);
+        assert(TS_connect_and_tri8(200, tri8s) == TS_UNKNOWN);
+        assert(TS_connect_or_tri8(200, tri8s) == TS_TRUE);
+
+        TS_set_tri_totality_tri8(TS_UNKNOWN, 200, tri8s);
+        TS_set_totality_tri8(false, 200, tri8s);
+        TS_get_tri_totality_tri8(&value, 200, tri8s);
+        assert(value == TS_FALSE);
+        assert(TS_connect_or_tri8(200, tri8s) == TS_FALSE);
+        TS_each_or_tri8(true, 100, tri8s);
+        flag = false;
+        TS_get_totality_tri8(&flag, 100, tri8s);
+        assert(flag);
+        TS_each_and_tri8(false, 200, tri8s);
+        assert(TS_connect_and_tri8(200, tri8s) == TS_FALSE);
+        assert(TS_connect_and_tri8(0, tri8s) == TS_TRUE);
+        assert(TS_connect_or_tri8(0, tri8s) == TS_FALSE);
+
+        tri8s[0] = TS_TRUE;
+        tri8s[1] = TS_FALSE;
+        tri8s[2] = TS_UNKNOWN;
+        bools[2] = true;
+        TS_tri8_to_bool(3, tri8s, bools);
+        assert(bools[0] && !bools[1] && bools[2]);
+        TS_tri8_to_bool_def(3, tri8s, bools, false);
+        assert(bools[0] && !bools[1] && !bools[2]);
+        TS_bool_to_tri8(3, bools, tri8s);
+        assert(tri8s[0] == TS_TRUE && tri8s[1] == TS_FALSE);
+        assert(tri8s[2] == TS_FALSE);
+    }
+
+    {
+        TRISTATE tris[150];
+        TRISTATE8 tri8s[150];
+        bool bools[150];
+        size_t i;
+        for (i = 0; i < 150; ++i)
+        {
+            tris[i] = (TRISTATE)((int)(i % 3) - 1);
+            tri8s[i] = (TRISTATE8)tris[i];
+            bools[i] = (i % 2 != 0);
+        }
+        assert(TS_find_invalid_tri(150, tris) == 150);
+        assert(TS_find_invalid_tri8(150, tri8s) == 150);
+        assert(TS_find_invalid_bool(150, bools) == 150);
+        assert(TS_find_invalid_tri(0, NULL) == 0);
+        tris[130] = (TRISTATE)-2;
+        tri8s[70] = 2;
+        tri8s[140] = -128;
+        assert(TS_find_invalid_tri(150, tris) == 130);
+        assert(TS_find_invalid_tri(130, tris) == 130);
+        assert(TS_find_invalid_tri8(150, tri8s) == 70);
+        if (sizeof(bool) == 1)
+        {
+            memset(&bools[99], 2, 1);
+            assert(TS_find_invalid_bool(150, bools) == 99);
+        }
+
+        assert(TS_connect_and_tri_unchecked(130, tris) == TS_FALSE);
+        assert(TS_connect_or_tri_unchecked(130, tris) == TS_TRUE);
+        assert(TS_connect_and_tri_unchecked(1, tris + 1) == TS_UNKNOWN);
+        TS_get_tri_totality_tri_unchecked(&value, 130, tris);
+        assert(value == TS_UNKNOWN);
+        TS_tri_each_or_tri_unchecked(TS_UNKNOWN, 130, tris);
+        assert(tris[0] == TS_UNKNOWN && tris[2] == TS_TRUE);
+        TS_each_not_tri_unchecked(130, tris);
+        assert(tris[2] == TS_FALSE);
+        TS_tri_each_and_tri_unchecked(TS_UNKNOWN, 3, tris);
+        assert(tris[1] == TS_UNKNOWN && tris[2] == TS_FALSE);
+        TS_tri_to_bool_def_unchecked(3, tris, bools, true);
+        assert(bools[0] && bools[1] && !bools[2]);
+        flag = true;
+        TS_get_totality_tri_unchecked(&flag, 3, tris);
+        assert(!flag);
+        bools[0] = false;
+        TS_tri_to_bool_unchecked(2, tris, bools);
+        assert(!bools[0] && bools[1]);
+    }
+
+    {
+        TRISTATE tris[200], results[200], expected[200];
+        TS_WORD trues[4], falses[4];
+        size_t i, k;
+        for (k = 0; k < 4; ++k)
+        {
+            for (i = 0; i < 200; ++i)
+                tris[i] = (i * 7 % (40 + 50 * k) ? TS_TRUE : TS_UNKNOWN);
+            tris[130 - 20 * k] = (k == 3 ? TS_TRUE : TS_FALSE);
+            tris[0] = (k == 2 ? TS_UNKNOWN : TS_TRUE);
+
+            expected[0] = tris[0];
+            for (i = 1; i < 200; ++i)
+                expected[i] = TS_tri_and(expected[i - 1], tris[i]);
+            TS_inclusive_scan_and_tri(200, tris, results);
+            assert(memcmp(results, expected, sizeof(results)) == 0);
+            TS_exclusive_scan_and_tri(200, tris, results);
+            assert(results[0] == TS_TRUE);
+            assert(memcmp(results + 1, expected, 199 * sizeof(TRISTATE)) == 0);
+
+            TS_tri_to_packed(200, tris, trues, falses);
+            TS_packed_inclusive_scan_and(200, trues, falses);
+            TS_packed_to_tri(200, trues, falses, results);
+            assert(memcmp(results, expected, sizeof(results)) == 0);
+
+            TS_each_not_tri(200, tris);
+            TS_each_not_tri(200, expected);
+            TS_inclusive_scan_or_tri(200, tris, results);
+            assert(memcmp(results, expected, sizeof(results)) == 0);
+            TS_tri_to_packed(200, tris, trues, falses);
+            TS_packed_exclusive_scan_or(200, trues, falses);
+            TS_packed_to_tri(200, trues, falses, results);
+            assert(results[0] == TS_FALSE);
+            assert(memcmp(results + 1, expected, 199 * sizeof(TRISTATE)) == 0);
+            TS_exclusive_scan_or_tri(200, tris, tris);
+            assert(memcmp(tris, results, sizeof(results)) == 0);
+        }
+        TS_inclusive_scan_and_tri(0, NULL, NULL);
+
+        memset(trues, 0, sizeof(trues));
+        TS_bits_set_range(true, 3, 140, trues);
+        assert(TS_bits_count(200, trues) == 137);
+        assert(TS_bits_find(true, 0, 200, trues) == 3);
+        assert(TS_bits_find(false, 3, 200, trues) == 140);
+        assert(TS_bits_find(true, 140, 200, trues) == 200);
+        TS_bits_set_range(false, 64, 128, trues);
+        assert(TS_bits_find(false, 5, 200, trues) == 64);
+        assert(TS_bits_find(true, 64, 200, trues) == 128);
+    }
+
+    {
+        TRISTATE tris[300], results[40];
+        size_t offsets[41];
+        size_t i;
+        for (i = 0; i < 300; ++i)
+            tris[i] = (i % 11 ? (i % 13 ? TS_TRUE : TS_FALSE) : TS_UNKNOWN);
+        offsets[0] = 0;
+        for (i = 0; i < 40; ++i)
+            offsets[i + 1] = offsets[i] + (i % 5 == 4 ? 0 : i % 7 + 1);
+        offsets[40] = 300;
+        assert(TS_is_valid_offsets(40, offsets));
+
+        TS_segmented_connect_and_tri(40, offsets, tris, results);
+        for (i = 0; i < 40; ++i)
+        {
+            value = TS_connect_and_tri(offsets[i + 1] - offsets[i],
+                                       tris + offsets[i]);
+            assert(results[i] == value);
+        }
+        TS_segmented_connect_or_tri(40, offsets, tris, results);
+        for (i = 0; i < 40; ++i)
+        {
+            value = TS_connect_or_tri(offsets[i + 1] - offsets[i],
+                                      tris + offsets[i]);
+            assert(results[i] == value);
+        }
+        TS_segmented_get_tri_totality_tri(40, offsets, tris, results);
+        for (i = 0; i < 40; ++i)
+        {
+            TS_get_tri_totality_tri(&value, offsets[i + 1] - offsets[i],
+                                    tris + offsets[i]);
+            assert(results[i] == value);
+        }
+        assert(results[4] == TS_UNKNOWN && results[39] == TS_UNKNOWN);
+        offsets[3] = offsets[4] + 1;
+        assert(!TS_is_valid_offsets(40, offsets));
+    }
+
+    {
+        const TRISTATE tris[6] = {
+            TS_TRUE, TS_UNKNOWN, TS_FALSE, TS_TRUE, TS_UNKNOWN, TS_TRUE
+        };
+        size_t trues, falses, unknowns;
+        TS_count_tri(&trues, &falses, &unknowns, 6, tris);
+        assert(trues == 3 && falses == 1 && unknowns == 2);
+        TS_count_tri(&trues, &falses, &unknowns, 0, NULL);
+        assert(trues == 0 && falses == 0 && unknowns == 0);
+    }
+
+    {
+        TRISTATE pattern[70];
+        TS_WORD trues[2], falses[2], key[2] = { 0, 0 };
+        for (size_t i = 0; i < 70; ++i)
+            pattern[i] = TS_UNKNOWN;
+        pattern[3] = TS_TRUE;
+        pattern[66] = TS_FALSE;
+        TS_tri_to_packed(70, pattern, trues, falses);
+        assert(!TS_packed_match(70, trues, falses, key));
+        TS_bits_set(true, 3, key);
+        assert(TS_packed_match(70, trues, falses, key));
+        TS_bits_set(true, 66, key);
+        assert(!TS_packed_match(70, trues, falses, key));
+        trues[1] |= (TS_WORD)1 << 10;
+        TS_bits_set(false, 66, key);
+        assert(TS_packed_match(70, trues, falses, key));
+    }
+
+    {
+        /* five arrays of 70 values; the query is the first one */
+        TRISTATE tris[5][70];
+        TS_WORD trues[5 * 2], falses[5 * 2];
+        TS_PACKED_DISTANCE distance;
+        size_t indices[3];
+        double similarities[3];
+        size_t r, j;
+        for (r = 0; r < 5; ++r)
+        {
+            for (j = 0; j < 70; ++j)
+                tris[r][j] = (j < 60 ? TS_TRUE : TS_UNKNOWN);
+            for (j = 0; j < r * 10; ++j)
+                tris[r][j] = (r % 2 ? TS_FALSE : TS_UNKNOWN);
+            TS_tri_to_packed(70, tris[r], trues + 2 * r, falses + 2 * r);
+        }
+        TS_packed_distance(&distance, 70, trues, falses,
+                           trues + 2, falses + 2);
+        assert(distance.agree == 50 && distance.disagree == 10);
+        assert(distance.both_known == 60 && distance.either_known == 60);
+        TS_packed_distance(&distance, 70, trues, falses,
+                           trues + 4, falses + 4);
+        assert(distance.both_known == 40 && distance.either_known == 60);
+        assert(TS_packed_similarity(70, trues + 8, falses + 8,
+                                    trues + 8, falses + 8) == 1);
+
+        assert(TS_packed_top_k(3, 70, trues, falses, 5, trues, falses,
+                               indices, similarities) == 3);
+        assert(indices[0] == 0 && similarities[0] == 1);
+        assert(indices[1] == 1 && indices[2] == 2);
+        assert(TS_packed_top_k(9, 70, trues, falses, 2, trues, falses,
+                               indices, similarities) == 2);
+    }
+
+    {
+        TRISTATE tris[150], compacted[150];
+        bool bools[150];
+        TS_WORD trues[3], falses[3];
+        size_t indices[150], packed_indices[150], first, n, m, i;
+        for (i = 0; i < 150; ++i)
+        {
+            tris[i] = (i % 5 == 0 ? TS_TRUE :
+                       (i % 5 == 1 ? TS_FALSE : TS_UNKNOWN));
+            bools[i] = (i % 3 == 0);
+        }
+        TS_tri_to_packed(150, tris, trues, falses);
+
+        first = 0;
+        n = TS_select_tri(TS_SELECT_TRUE, &first, 150, tris, 150, indices);
+        assert(n == 30 && first == 150);
+        for (i = 0; i < n; ++i)
+            assert(indices[i] == i * 5);
+        first = 0;
+        n = TS_select_tri(TS_SELECT_KNOWN, &first, 150, tris, 150, indices);
+        assert(n == 60 && indices[1] == 1 && indices[59] == 146);
+        first = 0;
+        n = TS_select_bool(false, &first, 150, bools, 150, indices);
+        assert(n == 100 && indices[0] == 1 && indices[99] == 149);
+
+        /* in chunks of 7 */
+        first = n = 0;
+        while ((m = TS_select_tri(TS_SELECT_UNKNOWN, &first, 150, tris, 7,
+                                  indices + n)) != 0)
+        {
+            assert(m == 7 || first == 150);
+            n += m;
+        }
+        assert(n == 90 && indices[89] == 149);
+        first = m = 0;
+        while (first < 150)
+        {
+            m += TS_packed_select(TS_SELECT_UNKNOWN, &first, 150, trues,
+                                  falses, 7, packed_indices + m);
+        }
+        assert(m == 90);
+        for (i = 0; i < 90; ++i)
+            assert(packed_indices[i] == indices[i]);
+        first = 0;
+        assert(TS_packed_select(TS_SELECT_TRUE, &first, 150, trues, falses,
+                                0, indices) == 0 && first == 0);
+
+        n = TS_compact_tri(TS_SELECT_KNOWN, 150, tris, compacted);
+        assert(n == 60 && compacted[0] == TS_TRUE &&
+               compacted[1] == TS_FALSE);
+        n = TS_compact_tri(TS_SELECT_UNKNOWN, 150, tris, tris);
+        assert(n == 90);
+        assert(TS_connect_or_tri(n, tris) == TS_UNKNOWN);
+#ifndef TRISTATE_STRICT
+        /* out-of-range values go by their sign */
+        tris[0] = TS_TRUE;
+        tris[1] = (TRISTATE)-2;
+        first = 0;
+        n = TS_select_tri(TS_SELECT_FALSE, &first, 2, tris, 1, indices);
+        assert(n == 1 && indices[0] == 1);
+        n = TS_compact_tri(TS_SELECT_KNOWN, 3, tris, compacted);
+        assert(n == 2 && compacted[1] == (TRISTATE)-2);
+#endif
+    }
+
+    {
+        const TRISTATE keys[7] = {
+            TS_TRUE, TS_UNKNOWN, TS_FALSE, TS_TRUE, TS_FALSE, TS_UNKNOWN,
+            TS_TRUE
+        };
+        const size_t expected[7] = { 2, 4, 1, 5, 0, 3, 6 };
+        size_t order[7], bounds[2], i;
+        TS_stable_order_tri(7, keys, order, bounds);
+        assert(bounds[0] == 2 && bounds[1] == 4);
+        for (i = 0; i < 7; ++i)
+            assert(order[i] == expected[i]);
+        TS_stable_order_tri(0, NULL, NULL, bounds);
+        assert(bounds[0] == 0 && bounds[1] == 0);
+#ifndef TRISTATE_STRICT
+        {
+            /* out-of-range keys go by their sign */
+            const TRISTATE loose[3] = {
+                TS_TRUE, (TRISTATE)-2, TS_UNKNOWN
+            };
+            TS_stable_order_tri(3, loose, order, bounds);
+            assert(order[0] == 1 && order[1] == 2 && order[2] == 0);
+        }
+#endif
+    }
+
+    {
+        TRISTATE tris[150], masked[150], indexed[150];
+        TS_WORD mask[3] = { 0, 0, 0 };
+        size_t indices[150], num_indices = 0, i, op;
+        for (i = 0; i < 150; ++i)
+        {
+            tris[i] = (TRISTATE)((int)(i % 3) - 1);
+            if (i % 4 == 1 || (i >= 64 && i < 128))
+            {
+                TS_bits_set(true, i, mask);
+                indices[num_indices++] = i;
+            }
+        }
+        for (op = 0; op < 7; ++op)
+        {
+            const TRISTATE value = (TRISTATE)((int)(op % 3) - 1);
+            memcpy(masked, tris, sizeof(tris));
+            memcpy(indexed, tris, sizeof(tris));
+            switch (op / 3)
+            {
+            case 0:
+                TS_tri_each_and_tri_masked(value, 150, masked, mask);
+                TS_tri_each_and_tri_indexed(value, num_indices, indices,
+                                            indexed);
+                break;
+            case 1:
+                TS_tri_each_or_tri_masked(value, 150, masked, mask);
+                TS_tri_each_or_tri_indexed(value, num_indices, indices,
+                                           indexed);
+                break;
+            default:
+                TS_each_not_tri_masked(150, masked, mask);
+                TS_each_not_tri_indexed(num_indices, indices, indexed);
+                break;
+            }
+            for (i = 0; i < 150; ++i)
+            {
+                TRISTATE expected = tris[i];
+                if (TS_bits_get(i, mask))
+                {
+                    expected = (op / 3 == 0 ? TS_tri_and(tris[i], value) :
+                                (op / 3 == 1 ? TS_tri_or(tris[i], value)
+                                             : TS_tri_not(tris[i])));
+                }
+                assert(masked[i] == expected && indexed[i] == expected);
+            }
+        }
+        memcpy(masked, tris, sizeof(tris));
+        memcpy(indexed, tris, sizeof(tris));
+        TS_reset_tri_totality_tri_masked(TS_UNKNOWN, 150, masked, mask);
+        TS_reset_tri_totality_tri_indexed(TS_UNKNOWN, num_indices, indices,
+                                          indexed);
+        assert(memcmp(masked, indexed, sizeof(tris)) == 0);
+        assert(masked[1] == TS_UNKNOWN && masked[0] == TS_FALSE);
+        assert(masked[100] == TS_UNKNOWN && masked[146] == TS_TRUE);
+    }
+
+    {
+        /* 150 values from bit 5 of bitmaps of 20 bytes */
+        TRISTATE tris[150], back[150];
+        uint8_t validity[20], values[20];
+        TS_WORD trues[3], falses[3];
+        TRISTATE value;
+        size_t i;
+        memset(validity, 0xA5, sizeof(validity));
+        memset(values, 0x5A, sizeof(values));
+        for (i = 0; i < 150; ++i)
+            tris[i] = (TRISTATE)((int)(i * 7 % 3) - 1);
+        TS_tri_to_arrow(150, tris, 5, validity, values);
+        assert((validity[0] & 0x1F) == 0x05 && (values[0] & 0x1F) == 0x1A);
+        assert((validity[19] & 0xF8) == 0xA0 && (values[19] & 0xF8) == 0x58);
+        for (i = 0; i < 150; ++i)
+            assert(TS_arrow_get(i, 5, validity, values) == tris[i]);
+        TS_arrow_to_tri(150, 5, validity, values, back);
+        assert(memcmp(tris, back, sizeof(tris)) == 0);
+        TS_arrow_to_packed(150, 5, validity, values, trues, falses);
+        for (i = 0; i < 150; ++i)
+            assert(TS_packed_get(i, trues, falses) == tris[i]);
+
+        assert(TS_arrow_count(TS_UNKNOWN, 150, 5, validity, values) == 50);
+        assert(TS_arrow_count(TS_TRUE, 150, 5, validity, values) == 50);
+        assert(TS_arrow_connect_and(150, 5, validity, values) == TS_FALSE);
+        assert(TS_arrow_connect_or(150, 5, validity, values) == TS_TRUE);
+        assert(TS_arrow_connect_or(1, 6, validity, values) == TS_UNKNOWN);
+        TS_arrow_get_tri_totality(&value, 150, 5, validity, values);
+        assert(value == TS_UNKNOWN);
+
+        TS_arrow_tri_each_or(TS_UNKNOWN, 150, 5, validity, values);
+        assert(TS_arrow_count(TS_FALSE, 150, 5, validity, values) == 0);
+        TS_arrow_get_tri_totality(&value, 150, 5, validity, values);
+        assert(value == TS_TRUE);
+        TS_arrow_each_not(150, 5, values);
+        assert(TS_arrow_connect_or(150, 5, validity, values) == TS_UNKNOWN);
+        TS_arrow_tri_each_and(TS_FALSE, 150, 5, validity, values);
+        assert(TS_arrow_count(TS_FALSE, 150, 5, validity, values) == 150);
+        assert((validity[0] & 0x1F) == 0x05 && (values[19] & 0xF8) == 0x58);
+
+        TS_packed_to_arrow(150, trues, falses, 5, validity, values);
+        TS_arrow_set(TS_TRUE, 2, 5, validity, values);
+        tris[2] = TS_TRUE;
+        TS_arrow_to_tri(150, 5, validity, values, back);
+        assert(memcmp(tris, back, sizeof(tris)) == 0);
+
+        /* no validity bitmap: nothing is null */
+        assert(TS_arrow_connect_and(150, 5, NULL, values) == TS_FALSE);
+        assert(TS_arrow_count(TS_UNKNOWN, 150, 5, NULL, values) == 0);
+    }
+
 #ifdef __cplusplus
     assert((TriS)false == TriS::F);
     assert((TriS)true == TriS::T);
@@ -828,6 +1554,1163 @@ int main(void)
     assert(0 < (!TriS::F));
     assert(0 > (!TriS::T));
     assert(0 == (!TriS::U));
+
+    {
+        TriS8 ts8;
+        std::vector<TriS8> vec(3);
+        assert(sizeof(TriS8) == 1);
+        assert(ts8 == TriS::U);
+        ts8 = TriS::T;
+        assert(ts8 == TriS::T && ts8 == TS_TRUE && ts8.is_valid());
+        vec[0] = TS_FALSE;
+        vec[1] = true;
+        vec[2] = ts8;
+        assert(vec[0] == TriS::F && vec[1] == TriS::T && vec[2] == ts8);
+        assert((vec[0] && vec[1]) == TriS::F);
+        assert((vec[0] || vec[1]) == TriS::T);
+        assert((!vec[1]) == TriS::F);
+        ts = vec[1];
+        assert(ts == TriS::T);
+        assert(TS_connect_or_tri8(3, (const TRISTATE8 *)&vec[0]) == TS_TRUE);
+        vec[1] = TriS::U;
+        std::sort(vec.begin(), vec.end());
+        assert(vec[0] == TS_FALSE && vec[1] < vec[2] && vec[2] >= ts);
+        assert((bool)vec[2] && !(bool)vec[1] && vec[1] <= TriS::U);
+        const TRISTATE value = vec[0];
+        assert(value == TS_FALSE && TriS8("unknown").str() == "unknown");
+    }
+
+#ifndef TRISTATE_STRICT
+    {
+        /* out-of-range values narrow by their sign */
+        assert(TriS8(256) == TS_TRUE && TriS8(128) == TS_TRUE);
+        assert(TriS8(-512) == TS_FALSE);
+        assert(TriS8((TRISTATE)256).value() == TS_TRUE);
+        const TRISTATE wide[3] = {
+            (TRISTATE)256, (TRISTATE)-512, TS_UNKNOWN
+        };
+        TRISTATE8 narrow[3];
+        TS_tri_to_tri8(3, wide, narrow);
+        assert(narrow[0] == 1 && narrow[1] == -1 && narrow[2] == 0);
+        TS_reset_tri_totality_tri8((TRISTATE)-300, 3, narrow);
+        assert(narrow[2] == -1);
+    }
+#endif
+
+    {
+        const TRISTATE dense1[6] = {
+            TS_TRUE, TS_UNKNOWN, TS_FALSE, TS_TRUE, TS_UNKNOWN, TS_UNKNOWN
+        };
+        const TRISTATE dense2[6] = {
+            TS_TRUE, TS_TRUE, TS_UNKNOWN, TS_FALSE, TS_UNKNOWN, TS_FALSE
+        };
+        TRISTATE dense3[6];
+        TriSparse sparse1(6, dense1), sparse2(6, dense2), sparse3;
+
+        assert(sparse1.size() == 6);
+        assert(sparse1.count_true() == 2);
+        assert(sparse1.count_false() == 1);
+        assert(sparse1.count_unknown() == 3);
+        assert(sparse1[0] == TriS::T);
+        assert(sparse1[1] == TriS::U);
+        assert(sparse1[2] == TriS::F);
+        sparse1.to_tri(dense3);
+        assert(memcmp(dense1, dense3, sizeof(dense1)) == 0);
+
+        sparse3 = sparse1 && sparse2;
+        for (size_t i = 0; i < 6; ++i)
+            assert(sparse3.get(i) == TS_tri_and(dense1[i], dense2[i]));
+        sparse3 = sparse1 || sparse2;
+        for (size_t i = 0; i < 6; ++i)
+            assert(sparse3.get(i) == TS_tri_or(dense1[i], dense2[i]));
+        sparse3 = !sparse1;
+        for (size_t i = 0; i < 6; ++i)
+            assert(sparse3.get(i) == TS_tri_not(dense1[i]));
+
+        assert(sparse1.connect_and() == TS_connect_and_tri(6, dense1));
+        assert(sparse1.connect_or() == TS_connect_or_tri(6, dense1));
+        TS_get_tri_totality_tri(&value, 6, dense1);
+        assert(sparse1.get_tri_totality() == value);
+        TS_get_tri_totality_tri(&value, 6, dense2);
+        assert(sparse2.get_tri_totality() == value);
+
+        size_t count = 0, prev = 0;
+        TriSparse::const_iterator it, end = sparse2.end();
+        for (it = sparse2.begin(); it != end; ++it, ++count)
+        {
+            assert(count == 0 || prev < it.index());
+            assert(it.value() == dense2[it.index()]);
+            prev = it.index();
+        }
+        assert(count == sparse2.count_known());
+
+        sparse3 = sparse1;
+        sparse3.set(1, TS_FALSE);
+        sparse3.set(0, TS_UNKNOWN);
+        assert(sparse3.get(0) == TS_UNKNOWN);
+        assert(sparse3.get(1) == TS_FALSE);
+        assert(sparse3.connect_and() == TS_FALSE);
+        sparse3.tri_each_or(TS_UNKNOWN);
+        assert(sparse3.count_false() == 0);
+        assert(sparse3.get_tri_totality() == TS_TRUE);
+        sparse3.tri_each_and(TS_FALSE);
+        assert(sparse3.count_false() == 6);
+        sparse3.resize(3);
+        assert(sparse3.count_false() == 3);
+        assert(sparse3 != sparse1);
+    }
+
+    {
+        TRISTATE dense[100];
+        for (size_t i = 0; i < 100; ++i)
+            dense[i] = (i % 7 == 0 ? TS_FALSE :
+                        (i % 2 ? TS_TRUE : TS_UNKNOWN));
+        TriVector<> vec1(100, dense), vec2(100, TriS::T), vec3;
+
+        assert(vec1.size() == 100 && vec2.size() == 100 && vec3.empty());
+        for (size_t i = 0; i < 100; ++i)
+            assert(vec1[i] == dense[i]);
+        assert(vec1.count(TriS::F) == 15);
+        assert(vec1.count(TriS::T) + vec1.count(TriS::U) == 85);
+        assert(vec1.count(TriS::U) ==
+               (size_t)std::count(dense, dense + 100, TS_UNKNOWN));
+        assert(vec1.find(TriS::U) - vec1.begin() == 2);
+        assert(vec1.find(TriS::F).index() == 0);
+        assert(vec2.find(TriS::F) == vec2.end());
+        assert(vec1.connect_and() == TS_connect_and_tri(100, dense));
+        assert(vec1.connect_or() == TS_connect_or_tri(100, dense));
+        assert(vec2.connect_and() == TS_TRUE);
+        assert(vec2.get_tri_totality() == TS_TRUE);
+
+        vec3 = vec1 && vec2;
+        assert(vec3 == vec1);
+        vec3 = vec1 || vec2;
+        assert(vec3 == vec2);
+        TS_PACKED_DISTANCE distance = vec1.distance(vec2);
+        assert(distance.agree == 43 && distance.disagree == 15);
+        assert(distance.both_known == 58 && distance.either_known == 100);
+        assert(vec1.similarity(vec2) == 0.43);
+        vec3 = !vec1;
+        for (size_t i = 0; i < 100; ++i)
+            assert(vec3[i] == TS_tri_not(dense[i]));
+        vec3.tri_each_and(TS_UNKNOWN);
+        for (size_t i = 0; i < 100; ++i)
+            assert(vec3[i] == TS_tri_and(TS_tri_not(dense[i]), TS_UNKNOWN));
+
+        vec3.clear();
+        for (size_t i = 0; i < 130; ++i)
+            vec3.push_back(i % 2 ? TriS::T : TriS::F);
+        assert(vec3.size() == 130 && vec3.count(TriS::T) == 65);
+        vec3.pop_back();
+        assert(vec3.size() == 129 && vec3.count(TriS::T) == 64);
+        vec3.resize(200, TriS::T);
+        assert(vec3.count(TriS::T) == 135 && vec3.count(TriS::U) == 0);
+        vec3.resize(10);
+        assert(vec3.count(TriS::T) == 5 && vec3.count(TriS::F) == 5);
+        vec3.resize(64);
+        assert(vec3.count(TriS::U) == 54);
+
+        vec3[0] = TriS::U;
+        vec3[1] = vec3[2];
+        assert(vec3[0] == TriS::U && vec3[1] == TriS::F);
+        vec3.front().flip();
+        vec3.back() = TS_TRUE;
+        assert(vec3.front() == TriS::U && vec3.back() == TriS::T);
+        assert((vec3[2] && vec3[3]) == TriS::F);
+        assert((vec3[2] || vec3[3]) == TriS::T);
+        assert((!vec3[3]) == TriS::F);
+
+        std::fill(vec3.begin(), vec3.end(), TriS::F);
+        assert(vec3.count(TriS::F) == 64);
+        vec3.fill(TriS::T);
+        assert(std::count(vec3.begin(), vec3.end(), TriS::T) == 64);
+        TriVector<>::const_iterator it = vec3.begin();
+        assert(it[63] == TriS::T && it + 64 == vec3.end());
+        std::reverse(vec3.begin(), vec3.begin() + 3);
+        vec3[0] = TriS::F;
+        std::sort(vec3.begin(), vec3.end());
+        assert(vec3[0] == TriS::F && vec3[1] == TriS::T);
+        assert(vec3.at(63) == TriS::T);
+    }
+
+    {
+        TriArena arena(256);
+        bool bools[5] = { true, false, true, true, false };
+        TriArena::marker mark = arena.mark();
+        TRISTATE *tris = arena.bool_to_tri(5, bools);
+        assert(tris[0] == TS_TRUE && tris[1] == TS_FALSE);
+        assert((size_t)tris % TriAlignOf<TRISTATE>::value == 0);
+        TRISTATE *unknowns = arena.alloc_tri(1000, TS_UNKNOWN);
+        assert(unknowns[999] == TS_UNKNOWN && tris[4] == TS_FALSE);
+        assert(arena.block_count() == 2);
+        {
+            TriArena::scope scope(arena);
+            TS_WORD *bits = arena.alloc_bits(300);
+            assert(bits[4] == 0);
+        }
+        const size_t used = arena.bytes_used();
+        const size_t blocks = arena.block_count();
+        assert(arena.high_water() > used);
+        arena.rewind(mark);
+        assert(arena.bytes_used() == 0 && arena.high_water() > used);
+        assert(arena.alloc_tri(5) == tris);
+        arena.reset();
+        arena.alloc_tri(1000);
+        assert(arena.block_count() == blocks);
+
+        TriArenaAllocator<TriS> alloc(arena);
+        TriVector<TriArenaAllocator<TriS> > vec(100, TriS::T, alloc);
+        vec.push_back(TriS::F);
+        assert(vec.connect_and() == TS_FALSE);
+        assert(vec.get_allocator() == alloc);
+        std::vector<TRISTATE, TriArenaAllocator<TRISTATE> > tris2(10, TS_TRUE,
+                                                                  alloc);
+        assert(TS_connect_and_tri(tris2.size(), &tris2[0]) == TS_TRUE);
+        arena.release();
+        assert(arena.block_count() == 0 && arena.bytes_reserved() == 0);
+
+        bool thrown = false;
+        try
+        {
+            arena.alloc_tri((size_t)-1 / 2);
+        }
+        catch (const std::bad_alloc&)
+        {
+            thrown = true;
+        }
+        assert(thrown && arena.bytes_used() == 0);
+    }
+
+    {
+        TriBufferPool pool;
+        bool bools[3] = { true, false, true };
+        TRISTATE *tris1 = pool.bool_to_tri(3, bools);
+        assert(tris1[2] == TS_TRUE);
+        TRISTATE *tris2 = pool.acquire_tri(1000);
+        assert(pool.misses() == 2 && pool.hits() == 0);
+        pool.release(tris1);
+        assert(pool.acquire_tri(10) == tris1);
+        assert(pool.hits() == 1);
+        pool.release(tris1);
+        pool.release(tris2);
+        assert(pool.bytes_outstanding() == 0);
+        assert(pool.high_water() >= 1000 * sizeof(TRISTATE));
+        pool.trim();
+        assert(pool.bytes_cached() == 0);
+
+        size_t failures = 0;
+        try
+        {
+            pool.acquire((size_t)-1);
+        }
+        catch (const std::bad_alloc&)
+        {
+            ++failures;
+        }
+        try
+        {
+            pool.acquire_tri((size_t)-1 / 2);
+        }
+        catch (const std::bad_alloc&)
+        {
+            ++failures;
+        }
+        assert(failures == 2 && pool.bytes_outstanding() == 0);
+    }
+
+    {
+        TRISTATE tris[5] = {
+            TS_TRUE, TS_UNKNOWN, TS_TRUE, TS_TRUE, TS_UNKNOWN
+        };
+        bool bools[5] = { false, false, false, false, false };
+        TriValidArray array(5, tris);
+        assert(array.valid() && array.size() == 5);
+        assert(array.connect_and() == TS_UNKNOWN);
+        assert(array.connect_or() == TS_TRUE);
+        assert(array.get_tri_totality() == TS_TRUE);
+        array.to_bool(bools);
+        assert(bools[0] && !bools[1]);
+        array.to_bool_def(bools, true);
+        assert(bools[1] && bools[4]);
+        array.each_not();
+        assert(array[0] == TriS::F && array.connect_or() == TS_UNKNOWN);
+        array.set(1, TriS::T);
+        array.tri_each_or(TriS::U);
+        assert(tris[0] == TS_UNKNOWN && tris[1] == TS_TRUE);
+        array.tri_each_and(TriS::F);
+        assert(array.connect_or() == TS_FALSE);
+
+        tris[3] = (TRISTATE)-2;
+        assert(array.valid() && !array.revalidate());
+        assert(array.first_invalid() == 3);
+        array.reset(TriS::U);
+        assert(array.valid() && array.connect_and() == TS_UNKNOWN);
+    }
+
+    {
+        TRISTATE tris[6] = {
+            TS_TRUE, TS_UNKNOWN, TS_TRUE, TS_TRUE, TS_UNKNOWN, TS_TRUE
+        };
+        TriCountedArray array(6, tris);
+        assert(array.tally().trues == 4 && array.tally().unknowns == 2);
+        assert(array.connect_and() == TS_UNKNOWN);
+        assert(array.get_tri_totality() == TS_TRUE);
+        array.set(1, TriS::F);
+        assert(array.connect_and() == TS_FALSE);
+        assert(array.get_tri_totality() == TS_UNKNOWN);
+        array.each_not();
+        assert(array.tally().falses == 4 && array[1] == TriS::T);
+        array.tri_each_or(TriS::U);
+        assert(array.tally().unknowns == 5 && array.connect_or() == TS_TRUE);
+        array.fill(0, 4, TriS::F);
+        assert(array.tally().falses == 4 && array.tally().trues == 0);
+        bool flag = true;
+        array.get_totality(flag);
+        assert(!flag);
+        array.tri_each_and(TriS::U);
+        assert(array.connect_or() == TS_UNKNOWN);
+        array.reset(TriS::T);
+        assert(array.connect_and() == TS_TRUE && tris[5] == TS_TRUE);
+
+        TS_each_not_tri(3, array.data());
+        assert(array.connect_and() == TS_TRUE);
+        array.resync();
+        assert(array.tally().falses == 3);
+        assert(array.get_tri_totality() == TS_UNKNOWN);
+    }
+
+    {
+        TriGroupBy<int> by_int;
+        const int keys[8] = { 3, 1, 3, 2, 1, 3, -5, 2 };
+        const TRISTATE tris[8] = {
+            TS_TRUE, TS_FALSE, TS_UNKNOWN, TS_TRUE,
+            TS_FALSE, TS_TRUE, TS_UNKNOWN, TS_FALSE
+        };
+        by_int.add(8, keys, tris);
+        assert(by_int.size() == 4 && by_int.groups()[0].key == 3);
+        const TriGroupBy<int>::group *g = by_int.find(3);
+        assert(g && g->count() == 3 && g->trues == 2 && g->unknowns == 1);
+        assert(g->connect_and() == TS_UNKNOWN && g->connect_or() == TS_TRUE);
+        assert(g->get_tri_totality() == TS_TRUE);
+        g = by_int.find(1);
+        assert(g->connect_or() == TS_FALSE);
+        assert(g->get_tri_totality() == TS_FALSE);
+        g = by_int.find(2);
+        assert(g->connect_and() == TS_FALSE && g->connect_or() == TS_TRUE);
+        assert(g->get_tri_totality() == TS_UNKNOWN);
+        assert(by_int.find(-5)->connect_and() == TS_UNKNOWN);
+        assert(by_int.find(4) == NULL);
+
+        TriGroupBy<std::string> by_name;
+        by_name.add("alpha", TS_TRUE);
+        by_name.add("beta", TS_FALSE);
+        by_name.add(std::string("alpha"), TS_TRUE);
+        TriGroupBy<std::string> other;
+        other.add("beta", TS_TRUE);
+        other.add("gamma", TS_UNKNOWN);
+        by_name.merge(other);
+        assert(by_name.size() == 3);
+        assert(by_name.find("alpha")->connect_and() == TS_TRUE);
+        assert(by_name.find("beta")->count() == 2);
+        assert(by_name.find("gamma")->connect_or() == TS_UNKNOWN);
+
+        std::vector<unsigned> many_keys(TriGroupBy<unsigned>::partition_min);
+        std::vector<TRISTATE> many_tris(many_keys.size());
+        for (size_t i = 0; i < many_keys.size(); ++i)
+        {
+            many_keys[i] = (unsigned)(i * 2654435761U % 5000);
+            many_tris[i] = (TRISTATE)((int)(i % 3) - 1);
+        }
+        TriGroupBy<unsigned> partitioned, direct;
+        partitioned.add(many_keys.size(), &many_keys[0], &many_tris[0]);
+        for (size_t i = 0; i < many_keys.size(); ++i)
+            direct.add(many_keys[i], many_tris[i]);
+        assert(partitioned.size() == 5000 && direct.size() == 5000);
+        for (size_t i = 0; i < direct.size(); ++i)
+        {
+            const TriGroupBy<unsigned>::group& d = direct.groups()[i];
+            const TriGroupBy<unsigned>::group *p = partitioned.find(d.key);
+            assert(p && p->trues == d.trues && p->falses == d.falses);
+            assert(p->unknowns == d.unknowns);
+            assert(partitioned.groups()[i].key == d.key);
+        }
+#ifdef TRISTATE_PARALLEL
+        TriGroupBy<unsigned> parallel;
+        parallel.add(TriExec(4, 1000), many_keys.size(), &many_keys[0],
+                     &many_tris[0]);
+        assert(parallel.size() == 5000);
+        for (size_t i = 0; i < direct.size(); ++i)
+        {
+            const TriGroupBy<unsigned>::group& d = direct.groups()[i];
+            const TriGroupBy<unsigned>::group *p = parallel.find(d.key);
+            assert(p && p->count() == d.count());
+            assert(parallel.groups()[i].key == d.key);
+            assert(p->get_tri_totality() == d.get_tri_totality());
+        }
+#endif
+    }
+
+    {
+        TriWindow window(3);
+        assert(window.empty() && window.connect_and() == TS_TRUE);
+        window.push(TS_TRUE);
+        window.push(TS_FALSE);
+        assert(window.get_tri_totality() == TS_UNKNOWN);
+        window.push(TS_TRUE);
+        window.push(TS_TRUE);
+        assert(window.full() && window.oldest() == TriS::F);
+        window.push(TS_UNKNOWN);
+        assert(window.size() == 3 && window.newest() == TriS::U);
+        assert(window.connect_and() == TS_UNKNOWN);
+        assert(window.get_tri_totality() == TS_TRUE);
+        window.pop();
+        assert(window.size() == 2 && window.tally().trues == 1);
+
+        TRISTATE burst[100];
+        for (size_t i = 0; i < 100; ++i)
+            burst[i] = (TRISTATE)((int)(i * 7 % 3) - 1);
+        TriWindow naive(7), batched(7);
+        for (size_t i = 0; i < 100; ++i)
+        {
+            naive.push(burst[i]);
+            const size_t first = (i < 6 ? 0 : i - 6);
+            assert(naive.connect_or() ==
+                   TS_connect_or_tri(i + 1 - first, burst + first));
+            TRISTATE totality;
+            TS_get_tri_totality_tri(&totality, i + 1 - first, burst + first);
+            assert(naive.get_tri_totality() == totality);
+        }
+        batched.push(3, burst);
+        batched.push(97, burst + 3);
+        for (size_t i = 0; i < 7; ++i)
+            assert(batched[i] == naive[i]);
+        assert(batched.tally().unknowns == naive.tally().unknowns);
+
+        TriTimeWindow<int> timed(10);
+        timed.push(0, TS_FALSE);
+        timed.push(5, TS_TRUE);
+        assert(timed.connect_and() == TS_FALSE);
+        timed.push(10, TS_TRUE);
+        assert(timed.size() == 2 && timed.connect_and() == TS_TRUE);
+        const int times[3] = { 12, 14, 30 };
+        const TRISTATE tris[3] = { TS_UNKNOWN, TS_FALSE, TS_TRUE };
+        timed.push(2, times, tris);
+        assert(timed.size() == 4 && timed.get_tri_totality() == TS_UNKNOWN);
+        timed.push(1, times + 2, tris + 2);
+        assert(timed.size() == 1 && timed.connect_or() == TS_TRUE);
+        timed.expire(40);
+        assert(timed.empty() && timed.connect_or() == TS_FALSE);
+    }
+
+#ifndef TRISTATE_STRICT
+    {
+        /* an out-of-range value is evicted as it was counted */
+        TriWindow window(1);
+        window.push((TRISTATE)256);
+        window.push(TS_TRUE);
+        assert(window.tally().trues == 1 && window.tally().unknowns == 0);
+        assert(window.connect_and() == TS_TRUE);
+        TriTimeWindow<int> timed(2);
+        timed.push(0, (TRISTATE)-300);
+        timed.push(5, TS_UNKNOWN);
+        assert(timed.size() == 1 && timed.tally().falses == 0);
+        assert(timed.tally().unknowns == 1);
+    }
+#endif
+
+    {
+        TriRuleTable table(8);
+        const TRISTATE any[8] = {
+            TS_UNKNOWN, TS_UNKNOWN, TS_UNKNOWN, TS_UNKNOWN,
+            TS_UNKNOWN, TS_UNKNOWN, TS_UNKNOWN, TS_UNKNOWN
+        };
+        const TRISTATE low[8] = {
+            TS_TRUE, TS_FALSE, TS_UNKNOWN, TS_UNKNOWN,
+            TS_UNKNOWN, TS_UNKNOWN, TS_UNKNOWN, TS_UNKNOWN
+        };
+        assert(table.add(any, -1) == 0);
+        assert(table.add(low) == 1);
+        assert(table.add(low, 5) == 2);
+        assert(!table.compiled());
+        table.compile();
+        TS_WORD key = 0x01;
+        std::vector<size_t> ids;
+        assert(table.match_first(&key) == 2);
+        assert(table.match_all(&key, ids) == 3);
+        assert(ids[0] == 2 && ids[1] == 1 && ids[2] == 0);
+        key = 0x03;
+        assert(table.match_first(&key) == 0);
+
+        const size_t width = 100, words = TS_WORDS(100);
+        TriRuleTable wide(width);
+        std::vector<TRISTATE> patterns(600 * width);
+        unsigned seed = 12345;
+        for (size_t r = 0; r < 600; ++r)
+        {
+            for (size_t b = 0; b < width; ++b)
+            {
+                seed = seed * 1103515245 + 12345;
+                const unsigned roll = (seed >> 16) % 32;
+                if (b < 8)
+                    patterns[r * width + b] = (roll & 1 ? TS_TRUE : TS_FALSE);
+                else if (roll < 2)
+                    patterns[r * width + b] = (roll ? TS_TRUE : TS_FALSE);
+                else
+                    patterns[r * width + b] = TS_UNKNOWN;
+            }
+            wide.add(&patterns[r * width], (int)(r % 7));
+        }
+        std::vector<TS_WORD> keys(50 * words);
+        for (size_t k = 0; k < 50; ++k)
+        {
+            for (size_t b = 0; b < width; ++b)
+            {
+                seed = seed * 1103515245 + 12345;
+                const TRISTATE value = patterns[k * 11 * width + b];
+                TS_bits_set(value ? value > 0 : ((seed >> 16) & 1) != 0, b,
+                            &keys[k * words]);
+            }
+        }
+        std::vector<size_t> linear(50), indexed(50), ids2;
+        wide.compile(false);
+        wide.match_first(50, &keys[0], &linear[0]);
+        wide.compile(true);
+        assert(wide.indexed());
+        wide.match_first(50, &keys[0], &indexed[0]);
+        for (size_t k = 0; k < 50; ++k)
+        {
+            const TS_WORD *key_k = &keys[k * words];
+            size_t expected = TriRuleTable::npos;
+            int best = -1;
+            std::vector<TS_WORD> trues(words), falses(words);
+            for (size_t r = 0; r < 600; ++r)
+            {
+                TS_tri_to_packed(width, &patterns[r * width],
+                                 &trues[0], &falses[0]);
+                if (TS_packed_match(width, &trues[0], &falses[0], key_k) &&
+                    (int)(r % 7) > best)
+                {
+                    expected = r;
+                    best = (int)(r % 7);
+                }
+            }
+            assert(linear[k] == expected && indexed[k] == expected);
+            wide.match_all(key_k, ids);
+            wide.compile(false);
+            wide.match_all(key_k, ids2);
+            wide.compile(true);
+            assert(ids == ids2);
+            assert(ids.empty() ? expected == TriRuleTable::npos
+                               : ids[0] == expected);
+        }
+    }
+
+    {
+        TRISTATE keys[100], keys_out[100];
+        int payload[100], payload_out[100];
+        size_t sort_bounds[2];
+        std::vector<std::pair<int, int> > records, stable;
+        for (int i = 0; i < 100; ++i)
+        {
+            keys[i] = (TRISTATE)((i * 7 + i / 3) % 3 - 1);
+            payload[i] = i;
+            records.push_back(std::make_pair((int)keys[i], i));
+        }
+        stable = records;
+        std::pair<std::vector<std::pair<int, int> >::iterator,
+                  std::vector<std::pair<int, int> >::iterator> bounds =
+            TS_partition3(records.begin(), records.end(),
+                          tri_record_key());
+        for (size_t i = 0; i < records.size(); ++i)
+        {
+            const int expected = (records.begin() + i < bounds.first ? -1 :
+                                  (records.begin() + i < bounds.second ? 0
+                                                                       : 1));
+            assert(records[i].first == expected);
+        }
+
+        bounds = TS_stable_partition3(stable.begin(), stable.end(),
+                                      tri_record_key());
+        assert(bounds.first - stable.begin() ==
+               std::count(keys, keys + 100, TS_FALSE));
+        for (size_t i = 1; i < stable.size(); ++i)
+        {
+            assert(stable[i - 1].first <= stable[i].first);
+            assert(stable[i - 1].first < stable[i].first ||
+                   stable[i - 1].second < stable[i].second);
+        }
+
+        TS_counting_sort_tri(100, keys, payload, keys_out, payload_out,
+                             sort_bounds);
+        assert(sort_bounds[0] == (size_t)(bounds.first - stable.begin()));
+        assert(sort_bounds[1] == (size_t)(bounds.second - stable.begin()));
+        for (size_t i = 0; i < 100; ++i)
+        {
+            assert(keys_out[i] == stable[i].first);
+            assert(payload_out[i] == stable[i].second);
+        }
+    }
+
+    {
+        int64_t value;
+        for (int a = -200; a <= 200; ++a)
+        {
+            for (int b = -200; b <= 200; b += 13)
+            {
+                const TriInteger x(a), y(b);
+                assert((x + y).to_int64(value) && value == a + b);
+                assert((x - y).to_int64(value) && value == a - b);
+                assert((x * y).to_int64(value) && value == a * b);
+                assert(x.compare(y) == (a < b ? -1 : (a > b ? 1 : 0)));
+            }
+        }
+        assert(TriInteger(8).str() == "+0-" && TriInteger().str() == "0");
+        assert(TriInteger(-8).str() == "-0+" && TriInteger(-8).sign() < 0);
+        assert((-TriInteger(8)).str() == "-0+");
+        const TRISTATE trits[4] = {
+            TS_FALSE, TS_UNKNOWN, TS_TRUE, TS_UNKNOWN
+        };
+        assert(TriInteger(4, trits) == TriInteger(8));
+        assert(TriInteger(4, trits).size() == 3);
+
+        const int64_t max = (int64_t)(~(uint64_t)0 >> 1), min = -max - 1;
+        assert(TriInteger(max).to_int64(value) && value == max);
+        assert(TriInteger(min).to_int64(value) && value == min);
+        assert(!(TriInteger(max) + 1).to_int64(value));
+        assert(!(TriInteger(min) - 1).to_int64(value));
+
+        TriInteger power(1), three(3);
+        for (int i = 0; i < 100; ++i)
+            power *= three;
+        assert(power.size() == 101 && power.sign() > 0);
+        assert((power + 1) * (power - 1) == power * power - 1);
+        assert(power * power - 1 < power * power);
+        assert((power - power).is_zero() && !power.to_int64(value));
+    }
+
+    {
+        uint8_t validity[4] = { 0xFF, 0x0F, 0, 0 };
+        uint8_t values[4] = { 0x0F, 0x03, 0, 0 };
+        TriArrowView view(12, 0, validity, values);
+        assert(view.size() == 12 && view.null_count() == 0);
+        assert(view[0] == TriS::T && view[4] == TriS::F);
+        assert(view.get_tri_totality() == TS_UNKNOWN);
+        view.set(4, TriS::U);
+        assert(view.null_count() == 1 && validity[0] == 0xEF);
+        view.tri_each_and(TriS::U);
+        assert(view.count(TriS::T) == 0 && view.connect_or() == TS_UNKNOWN);
+
+        const TriArrowView tail(4, 8, (const uint8_t *)validity,
+                                (const uint8_t *)values);
+        assert(tail.connect_and() == TS_FALSE);
+        TriVector<> vec;
+        tail.to_vector(vec);
+        assert(vec.size() == 4 && vec.count(TriS::F) == 2);
+        vec.each_not();
+        TriArrowView head(4, 0, validity, values);
+        head.assign(vec);
+        assert(view[0] == TriS::U && view[2] == TriS::T);
+        TRISTATE tris[12];
+        view.to_tri(tris);
+        assert(tris[3] == TS_TRUE && tris[4] == TS_UNKNOWN);
+        assert(tris[11] == TS_FALSE);
+    }
+
+    {
+        int ints[100];
+        double reals[100];
+        uint8_t validity[13] = { 0 };
+        for (size_t i = 0; i < 100; ++i)
+        {
+            ints[i] = (int)(i % 7) - 3;
+            reals[i] = (i % 11 == 0 ? -1.0 : (double)(i % 5) - 1.5);
+            if (i % 9)
+                validity[(i + 3) / 8] |= (uint8_t)(1 << ((i + 3) % 8));
+        }
+        reals[50] = std::numeric_limits<double>::quiet_NaN();
+        const TriNullable<int> a(ints, validity, 3);
+        const TriNullable<double> b(reals, -1.0);
+        assert(a.is_null(0) && !a.is_null(1) && b.is_null(11));
+        TRISTATE results[100], verdicts[100];
+        TS_compare_tri(TS_CMP_LT, 100, a, b, results);
+        for (size_t i = 0; i < 100; ++i)
+        {
+            if (i % 9 == 0 || i % 11 == 0)
+                assert(results[i] == TS_UNKNOWN);
+            else
+                assert(results[i] == (ints[i] < reals[i] ? TS_TRUE
+                                                         : TS_FALSE));
+        }
+        assert(results[50] == TS_FALSE);
+
+        const TriNullable<double> c(reals,
+            std::numeric_limits<double>::quiet_NaN());
+        TS_compare_tri(TS_CMP_GE, 100, c, TriNullableScalar<double>(0),
+                       results);
+        assert(results[50] == TS_UNKNOWN && results[11] == TS_FALSE);
+        assert(results[2] == TS_TRUE && results[1] == TS_FALSE);
+        TS_compare_tri(TS_CMP_EQ, 100, a, TriNullableScalar<int>(),
+                       results);
+        size_t trues, falses, unknowns;
+        TS_count_tri(&trues, &falses, &unknowns, 100, results);
+        assert(unknowns == 100);
+
+        for (size_t i = 0; i < 100; ++i)
+            verdicts[i] = TS_TRUE;
+        verdicts[4] = TS_UNKNOWN;
+        TS_between_tri_and(100, a, TriNullableScalar<int>(-1),
+                           TriNullableScalar<int>(1), verdicts);
+        TriVector<> vec(100, TriS::T);
+        vec[4] = TriS::U;
+        TS_between_packed_and(100, a, TriNullableScalar<int>(-1),
+                              TriNullableScalar<int>(1),
+                              vec.trues(), vec.falses());
+        for (size_t i = 0; i < 100; ++i)
+        {
+            TRISTATE expected = TS_UNKNOWN;
+            if (i % 9)
+                expected = (ints[i] >= -1 && ints[i] <= 1 ? TS_TRUE
+                                                          : TS_FALSE);
+            if (i == 4)
+                expected = TS_tri_and(expected, TS_UNKNOWN);
+            assert(verdicts[i] == expected && vec[i] == expected);
+        }
+
+        TS_compare_packed(TS_CMP_NE, 100, a, a, vec.trues(), vec.falses());
+        assert(vec.count(TriS::T) == 0 && vec.count(TriS::U) == 12);
+    }
+
+#ifdef TRISTATE_PARALLEL
+    {
+        std::vector<TRISTATE> tris(10000), results(10000), expected(10000);
+        for (size_t i = 0; i < tris.size(); ++i)
+            tris[i] = (i % 1000 ? TS_TRUE : TS_UNKNOWN);
+        tris[7777] = TS_FALSE;
+        TriExec exec(4, 100);
+        assert(exec.chunks(10000) == 4 && exec.chunks(250) == 2);
+        assert(TriExec(4, 1).chunk_begin(10, 3) == 8);
+        std::vector<int> seen(4);
+        exec.for_chunks(10000, [&](size_t index, size_t begin, size_t end) {
+            seen[index] = (int)(end - begin);
+        });
+        assert(seen[0] == 2500 && seen[3] == 2500);
+
+        TS_inclusive_scan_and_tri(10000, &tris[0], &expected[0]);
+        TS_inclusive_scan_and_tri(exec, 10000, &tris[0], &results[0]);
+        assert(results == expected && results[2000] == TS_UNKNOWN);
+        TS_exclusive_scan_and_tri(10000, &tris[0], &expected[0]);
+        TS_exclusive_scan_and_tri(exec, 10000, &tris[0], &results[0]);
+        assert(results == expected && results[7778] == TS_FALSE);
+        TS_inclusive_scan_or_tri(10000, &tris[0], &expected[0]);
+        TS_inclusive_scan_or_tri(exec, 10000, &tris[0], &results[0]);
+        assert(results == expected);
+        TS_exclusive_scan_or_tri(10000, &tris[0], &expected[0]);
+        TS_exclusive_scan_or_tri(exec, 10000, &tris[0], &tris[0]);
+        assert(tris == expected && tris[0] == TS_FALSE);
+    }
+
+    {
+        std::vector<TRISTATE> tris(100000, TS_TRUE);
+        std::vector<size_t> offsets(1, 0);
+        for (size_t i = 0; offsets.back() < tris.size(); ++i)
+        {
+            const size_t next = offsets.back() + (i % 100 == 0 ? 5000 : i % 9);
+            offsets.push_back(std::min(next, tris.size()));
+        }
+        for (size_t i = 0; i < tris.size(); i += 777)
+            tris[i] = (i % 2 ? TS_FALSE : TS_UNKNOWN);
+        const size_t segments = offsets.size() - 1;
+        std::vector<TRISTATE> results(segments), expected(segments);
+        TriExec exec(4, 1000);
+        TS_segmented_connect_and_tri(segments, &offsets[0], &tris[0],
+                                     &expected[0]);
+        TS_segmented_connect_and_tri(exec, segments, &offsets[0], &tris[0],
+                                     &results[0]);
+        assert(results == expected);
+        TS_segmented_connect_or_tri(segments, &offsets[0], &tris[0],
+                                    &expected[0]);
+        TS_segmented_connect_or_tri(exec, segments, &offsets[0], &tris[0],
+                                    &results[0]);
+        assert(results == expected);
+        TS_segmented_get_tri_totality_tri(segments, &offsets[0], &tris[0],
+                                          &expected[0]);
+        TS_segmented_get_tri_totality_tri(exec, segments, &offsets[0],
+                                          &tris[0], &results[0]);
+        assert(results == expected);
+    }
+
+    {
+        const size_t num = 200, words = TS_WORDS(200), count = 5000;
+        std::vector<TS_WORD> trues(count * words), falses(count * words);
+        std::vector<TRISTATE> tris(num);
+        for (size_t i = 0; i < count; ++i)
+        {
+            for (size_t j = 0; j < num; ++j)
+                tris[j] = (TRISTATE)((int)((i * 31 + j * j) % 7 % 3) - 1);
+            TS_tri_to_packed(num, &tris[0], &trues[i * words],
+                             &falses[i * words]);
+        }
+        const TS_WORD *query_trues = &trues[17 * words];
+        const TS_WORD *query_falses = &falses[17 * words];
+        std::vector<size_t> serial(10), parallel(10);
+        std::vector<double> serial_sims(10), parallel_sims(10);
+        assert(TS_packed_top_k(10, num, query_trues, query_falses, count,
+                               &trues[0], &falses[0], &serial[0],
+                               &serial_sims[0]) == 10);
+        assert(TS_packed_top_k(TriExec(4, 500), 10, num, query_trues,
+                               query_falses, count, &trues[0], &falses[0],
+                               &parallel[0], &parallel_sims[0]) == 10);
+        assert(serial == parallel && serial_sims == parallel_sims);
+        assert(serial[0] == 3 && serial_sims[9] == 1);
+
+        /* a k over count sizes nothing by k */
+        serial.resize(count);
+        parallel.resize(count);
+        serial_sims.resize(count);
+        parallel_sims.resize(count);
+        assert(TS_packed_top_k(count, num, query_trues, query_falses, count,
+                               &trues[0], &falses[0], &serial[0],
+                               &serial_sims[0]) == count);
+        assert(TS_packed_top_k(TriExec(4, 500), (size_t)-1, num,
+                               query_trues, query_falses, count, &trues[0],
+                               &falses[0], &parallel[0],
+                               &parallel_sims[0]) == count);
+        assert(serial == parallel && serial_sims == parallel_sims);
+    }
+
+    {
+        const size_t num = 100000;
+        std::vector<TRISTATE> keys(num), keys_out(num), expected_keys(num);
+        std::vector<size_t> order(num), expected(num);
+        std::vector<double> payload(num), payload_out(num);
+        for (size_t i = 0; i < num; ++i)
+        {
+            keys[i] = (TRISTATE)((int)((i * i + i / 7) % 3) - 1);
+            payload[i] = (double)i;
+        }
+        size_t bounds[2], expected_bounds[2];
+        TS_stable_order_tri(num, &keys[0], &expected[0], expected_bounds);
+        TS_stable_order_tri(TriExec(4, 1000), num, &keys[0], &order[0],
+                            bounds);
+        assert(order == expected);
+        assert(bounds[0] == expected_bounds[0]);
+        assert(bounds[1] == expected_bounds[1]);
+        TS_counting_sort_tri(TriExec(3, 1000), num, &keys[0], &payload[0],
+                             &keys_out[0], &payload_out[0]);
+        for (size_t i = 0; i < num; ++i)
+        {
+            assert(payload_out[i] == (double)expected[i]);
+            assert(keys_out[i] == keys[expected[i]]);
+        }
+    }
+
+    {
+        const size_t num = 100001;
+        std::vector<TRISTATE> tris(num), expected(num);
+        for (size_t i = 0; i < num; ++i)
+            tris[i] = (TRISTATE)((int)(i * 7 % 5 % 3) - 1);
+        TriThreadPool pool(3);
+        TriExec exec(pool, 1000);
+        assert(exec.threads() == 3 && &exec.backend() == &pool);
+
+        expected = tris;
+        TS_each_not_tri(num, &expected[0]);
+        TS_tri_each_and_tri(TS_UNKNOWN, num, &expected[0]);
+        std::vector<TRISTATE> results(tris);
+        TS_each_not_tri(exec, num, &results[0]);
+        TS_tri_each_and_tri(exec, TS_UNKNOWN, num, &results[0]);
+        assert(results == expected);
+
+        bool *bools = new bool[num];
+        bool *expected_bools = new bool[num];
+        TS_tri_to_bool_def(num, &tris[0], expected_bools, true);
+        TS_tri_to_bool_def(exec, num, &tris[0], bools, true);
+        assert(std::equal(bools, bools + num, expected_bools));
+        TS_bool_to_tri(exec, num, bools, &results[0]);
+        assert(TS_connect_and_tri(exec, num, &results[0]) == TS_FALSE);
+        delete[] bools;
+        delete[] expected_bools;
+
+        size_t counts[3], expected_counts[3];
+        TS_count_tri(&expected_counts[0], &expected_counts[1],
+                     &expected_counts[2], num, &tris[0]);
+        TS_count_tri(exec, &counts[0], &counts[1], &counts[2], num, &tris[0]);
+        assert(std::equal(counts, counts + 3, expected_counts));
+        TRISTATE value;
+        TS_get_tri_totality_tri(exec, &value, num, &tris[0]);
+        assert(value == TS_UNKNOWN);
+        assert(TS_connect_and_tri(exec, num, &tris[0]) == TS_FALSE);
+        assert(TS_connect_or_tri(exec, num, &tris[0]) == TS_TRUE);
+
+        TriVector<> vec(num), parallel(num);
+        TS_tri_to_packed(num, &tris[0], vec.trues(), vec.falses());
+        TS_tri_to_packed(exec, num, &tris[0], parallel.trues(),
+                         parallel.falses());
+        assert(vec == parallel);
+        assert(TS_packed_count(exec, TS_UNKNOWN, num, vec.trues(),
+                               vec.falses()) == expected_counts[2]);
+        TS_packed_each_not(exec, num, parallel.trues(), parallel.falses());
+        TS_packed_and(exec, num, parallel.trues(), parallel.falses(),
+                      vec.trues(), vec.falses());
+        assert(TS_packed_connect_or(exec, num, parallel.trues(),
+                                    parallel.falses()) == TS_UNKNOWN);
+        TS_packed_get_tri_totality(exec, &value, num, parallel.trues(),
+                                   parallel.falses());
+        assert(value == TS_FALSE);
+
+        /* runs nested in the tasks of the same pool */
+        pool.run(4, [&](size_t index) {
+            TRISTATE *part = &results[0] + index * 25000;
+            TS_reset_tri_totality_tri(exec, TS_TRUE, 25000, part);
+        });
+        assert(TS_connect_and_tri(exec, 100000, &results[0]) == TS_TRUE);
+
+        /* an executor which runs every task at once */
+        auto inline_submit = [](std::function<void()> task) { task(); };
+        auto adapter = TS_make_executor_adapter(inline_submit, 4);
+        TriExec adapted(adapter, 1000);
+        TS_reset_tri_totality_tri(adapted, TS_FALSE, num, &results[0]);
+        assert(TS_connect_or_tri(adapted, num, &results[0]) == TS_FALSE);
+
+        /* a throwing task is rethrown once every task has returned */
+        TriExecBackend *backends[2] = { &pool, &adapter };
+        for (size_t k = 0; k < 2; ++k)
+        {
+            for (size_t thrower = 0; thrower < 8; thrower += 7)
+            {
+                std::atomic<size_t> ran(0);
+                bool thrown = false;
+                try
+                {
+                    backends[k]->run(8, [&](size_t index) {
+                        ++ran;
+                        if (index == thrower)
+                            throw std::runtime_error("task");
+                    });
+                }
+                catch (const std::runtime_error&)
+                {
+                    thrown = true;
+                }
+                assert(thrown && ran == 8);
+            }
+        }
+    }
+
+#ifdef TRISTATE_NUMA
+    {
+        std::vector<int> items;
+        assert(TS_numa_parse_list("0-3,8,10-11\n", items));
+        assert(items.size() == 7 && items[3] == 3 && items[6] == 11);
+        assert(!TS_numa_parse_list("3-1", items));
+        const std::vector<int> nodes = TS_numa_nodes();
+        assert(!nodes.empty() && !TS_numa_cpus(nodes[0]).empty());
+
+        /* two groups on the same node act as two nodes */
+        TriNumaPool pool(std::vector<int>(2, nodes[0]), 2);
+        assert(pool.threads() == 4 && pool.groups() == 2);
+        assert(pool.node_of(0, 8) == nodes[0]);
+        TriExec exec(pool, 1000);
+        const size_t num = 100000, size = num * sizeof(TRISTATE);
+        TRISTATE *tris = static_cast<TRISTATE *>(TS_numa_alloc(size));
+        assert(tris != NULL);
+        pool.place(exec, tris, num, sizeof(TRISTATE));
+        TS_numa_place(tris, size, TS_NUMA_INTERLEAVE, nodes);
+        TS_set_tri_totality_tri(exec, TS_TRUE, num, tris);
+        tris[num - 1] = TS_UNKNOWN;
+        assert(TS_connect_and_tri(exec, num, tris) == TS_UNKNOWN);
+        TS_numa_free(tris, size);
+    }
+#endif
+
+    {
+        TriCowArray array(10000, TriS::T, 1000);
+        TriCowArray::reader reader(array);
+        {
+            TriCowArray::snapshot before(reader);
+            array.set(2500, TriS::F);
+            array.tri_each_or(TriS::U);
+            assert(before.connect_and() == TS_TRUE);
+            assert(array.retired() == 2);
+
+            TriCowArray::reader other(array);
+            TriCowArray::snapshot after(other);
+            assert(after[2500] == TriS::U && after[2499] == TriS::T);
+            assert(after.connect_and() == TS_UNKNOWN);
+            assert(after.tally().unknowns == 1);
+            /* only the chunk changed was copied */
+            size_t count, other_count;
+            assert(before.chunk(0, count) == after.chunk(0, other_count));
+            assert(before.chunk(2, count) != after.chunk(2, other_count));
+        }
+        array.tri_each_and(TriS::T);
+        assert(array.retired() == 0);
+
+        {
+            TriCowArray::batch changes(array);
+            changes.set(0, TriS::F);
+            changes.set(9999, TriS::F);
+            assert(changes[0] == TriS::F);
+        }   /* not committed */
+        TriCowArray::snapshot current(reader);
+        assert(current.get_tri_totality() == TS_TRUE);
+        std::vector<TRISTATE> tris(current.size());
+        current.to_tri(&tris[0]);
+        assert(tris[0] == TS_TRUE && tris[2500] == TS_UNKNOWN);
+    }
+
+    {
+        /* readers never see a half-written version */
+        TriCowArray array(5000, TriS::T, 256);
+        std::atomic<bool> done(false);
+        std::vector<std::thread> readers;
+        for (int i = 0; i < 3; ++i)
+        {
+            readers.push_back(std::thread([&array, &done]() {
+                TriCowArray::reader reader(array);
+                while (!done)
+                {
+                    TriCowArray::snapshot view(reader);
+                    const TRISTATE value = view.get_tri_totality();
+                    assert(value != TS_UNKNOWN);
+                    assert(view.connect_or() == value);
+                }
+            }));
+        }
+        for (int i = 0; i < 200; ++i)
+            array.each_not();
+        done = true;
+        for (size_t i = 0; i < readers.size(); ++i)
+            readers[i].join();
+        array.each_not();
+        assert(array.retired() == 0);
+    }
+
+    {
+        TriMemo memo(100);
+        assert(memo.get(7) == TriS::U && memo.count_computed() == 0);
+        int calls = 0;
+        auto is_odd = [&calls](size_t i) { ++calls; return (i & 1) != 0; };
+        assert(memo.get_or_compute(7, is_odd));
+        assert(!memo.get_or_compute(40, is_odd));
+        assert(memo.get_or_compute(7, is_odd) && calls == 2);
+        assert(memo.get(7) == TriS::T && memo.get(40) == TriS::F);
+        assert(memo.try_set(99, true) && !memo.try_set(99, false));
+        assert(memo.count_computed() == 3);
+        assert(memo.reset(40) && !memo.reset(41));
+        assert(memo.get(40) == TriS::U);
+        bool thrown = false;
+        try
+        {
+            memo.get_or_compute(5, [](size_t) -> bool { throw 1; });
+        }
+        catch (int)
+        {
+            thrown = true;
+        }
+        assert(thrown && memo.state(5) == TriMemo::not_computed);
+        std::vector<TRISTATE> tris(memo.size());
+        memo.to_tri(&tris[0]);
+        assert(tris[7] == TS_TRUE && tris[5] == TS_UNKNOWN);
+        size_t trues, falses, unknowns;
+        TS_count_tri(&trues, &falses, &unknowns, tris.size(), &tris[0]);
+        assert(trues == 2 && falses == 0 && unknowns == 98);
+
+        TriHashMemo<std::string> names(4);
+        auto is_long = [](const std::string& s) { return s.size() > 3; };
+        assert(names.get("tri") == TriS::U);
+        assert(!names.get_or_compute("tri", is_long));
+        assert(names.get_or_compute("state", is_long));
+        assert(names.get("state") == TriS::T && names.size() == 2);
+
+        /* a full table computes the keys it has no room for every time */
+        TriHashMemo<uint64_t> small(1);
+        int small_calls = 0;
+        auto is_even = [&small_calls](uint64_t key) {
+            ++small_calls;
+            return (key & 1) == 0;
+        };
+        for (uint64_t key = 0; key < 4; ++key)
+            assert(small.get_or_compute(key, is_even) == ((key & 1) == 0));
+        assert(small.size() == 2 && small_calls == 4);
+        assert(small.get_or_compute(3, is_even) == false);
+        assert(small.get(3) == TriS::U && small_calls == 5);
+    }
+
+    {
+        /* each index is computed once however many threads ask */
+        TriMemo memo(1000);
+        TriHashMemo<uint64_t> hashed(1000);
+        std::atomic<int> calls(0), hashed_calls(0);
+        std::vector<std::thread> workers;
+        for (int t = 0; t < 4; ++t)
+        {
+            workers.push_back(std::thread([&]() {
+                for (size_t i = 0; i < 1000; ++i)
+                {
+                    const bool odd = memo.get_or_compute(i, [&](size_t j) {
+                        ++calls;
+                        std::this_thread::yield();
+                        return (j & 1) != 0;
+                    });
+                    assert(odd == ((i & 1) != 0));
+                    hashed.get_or_compute(i * 7919, [&](uint64_t) {
+                        ++hashed_calls;
+                        return true;
+                    });
+                }
+            }));
+        }
+        for (size_t i = 0; i < workers.size(); ++i)
+            workers[i].join();
+        assert(calls == 1000 && memo.count_computed() == 1000);
+        assert(hashed_calls == 1000 && hashed.size() == 1000);
+    }
+#endif
+
+#ifdef TRISTATE_INSTRUMENT
+    {
+        const TRISTATE tris[6] = {
+            TS_TRUE, TS_UNKNOWN, TS_TRUE, TS_FALSE, TS_TRUE, TS_TRUE
+        };
+        TS_INSTR_SNAPSHOT snapshot;
+        TS_instr_reset();
+        assert(TS_connect_and_tri(6, tris) == TS_FALSE);
+        assert(TS_connect_or_tri(6, tris) == TS_TRUE);
+        assert(TS_connect_or_tri(3, tris + 1) == TS_TRUE);
+        flag = true;
+        TS_to_bool(TS_UNKNOWN, &flag);
+        TS_to_bool(TS_FALSE, &flag);
+        TS_instr_snapshot(&snapshot);
+        assert(snapshot.connect_and.calls == 1);
+        assert(snapshot.connect_and.scanned == 4);
+        assert(snapshot.connect_and.unknowns == 1);
+        assert(snapshot.connect_and.short_circuits == 1);
+        assert(snapshot.connect_and.histogram[3] == 1);
+        assert(snapshot.connect_or.calls == 2);
+        assert(snapshot.connect_or.scanned == 3);
+        assert(snapshot.connect_or.short_circuits == 2);
+        assert(snapshot.to_bool_calls == 2);
+        assert(snapshot.to_bool_untouched == 1);
+        bool bools[6] = { false, false, false, false, false, false };
+        TS_tri_to_bool(6, tris, bools);
+        TS_instr_snapshot(&snapshot);
+        assert(snapshot.to_bool_calls == 8);
+        assert(snapshot.to_bool_untouched == 2);
+
+        std::thread worker([&tris]() {
+            TS_connect_and_tri(3, tris);
+        });
+        worker.join();
+        TS_instr_snapshot(&snapshot);
+        assert(snapshot.connect_and.calls == 2);
+        assert(snapshot.connect_and.scanned == 7);
+        assert(snapshot.connect_and.short_circuits == 1);
+        TS_instr_reset();
+        TS_instr_snapshot(&snapshot);
+        assert(snapshot.connect_and.calls == 0);
+    }
+#endif
 #endif  /* def __cplusplus */
 
     return 0;
@@ -835,3 +2718,876 @@ int main(void)
 #endif  /* def TRISTATE_UNITTEST */
 
 /****************************************************************************/
+/* benchmark */
+
+/* g++ -O2 -DTRISTATE_BENCHMARK tristate.cpp [-DTRISTATE_NO_INLINING]
+ *     [-DTRISTATE_STRICT] [-DTRISTATE_PARALLEL -pthread]
+ *     [-DTRISTATE_NUMA -pthread]
+ * ./a.out [--csv] [--min NUM] [--max NUM] [--time MSEC] [--filter TEXT]
+ *     [--numa]
+ *
+ * Prints one JSON object per line (or CSV with --csv).  Each record
+ * carries the build configuration, so output of several builds can be
+ * concatenated and compared.  gb_per_sec assumes a full pass over the
+ * arrays, so it overstates the early_exit reductions.  In-place kernels
+ * get their input back before each call, outside the timing.
+ * --numa (TRISTATE_NUMA) instead compares the placements of one array
+ * of --max values across the NUMA nodes. */
+
+#if defined(TRISTATE_BENCHMARK) && !defined(TRISTATE_UNITTEST)
+#ifndef __cplusplus
+    #error The benchmark needs C++.
+#endif
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+#include <algorithm>
+#ifdef TRISTATE_CXX11
+    #include <chrono>
+#else
+    #include <ctime>
+#endif
+
+#ifdef TRISTATE_NO_INLINING
+    #define BENCH_INLINE    0
+#else
+    #define BENCH_INLINE    1
+#endif
+#ifdef TRISTATE_STRICT
+    #define BENCH_STRICT    1
+#else
+    #define BENCH_STRICT    0
+#endif
+
+namespace
+{
+    volatile int s_sink;
+
+    double now_nsec()
+    {
+#ifdef TRISTATE_CXX11
+        using namespace std::chrono;
+        return (double)duration_cast<nanoseconds>(
+            steady_clock::now().time_since_epoch()).count();
+#else
+        return std::clock() * (1e9 / CLOCKS_PER_SEC);
+#endif
+    }
+
+    struct bench_data
+    {
+        size_t                  num;
+        std::vector<bool>       flags;      // source of the bool arrays
+        bool *                  bools;
+        bool *                  bools_out;
+        std::vector<TRISTATE>   tris;
+        std::vector<TRISTATE>   tris_out;
+        std::vector<TRISTATE8>  tri8s;
+        std::vector<TRISTATE8>  tri8s_out;
+        std::vector<TS_WORD>    bits;
+        std::vector<TS_WORD>    bits_out;
+        std::vector<TS_WORD>    trues, falses;
+        std::vector<TS_WORD>    trues_out, falses_out;
+        std::vector<size_t>     indices;
+        std::vector<double>     reals;      // nullable by bits
+
+        explicit bench_data(size_t num_)
+            : num(num_), bools(new bool[num_ + 1]),
+              bools_out(new bool[num_ + 1]),
+              tris(num_ + 1), tris_out(num_ + 1),
+              tri8s(num_ + 1), tri8s_out(num_ + 1),
+              bits(TS_WORDS(num_) + 1), bits_out(TS_WORDS(num_) + 1),
+              trues(TS_WORDS(num_) + 1), falses(TS_WORDS(num_) + 1),
+              trues_out(TS_WORDS(num_) + 1), falses_out(TS_WORDS(num_) + 1),
+              indices(num_ + 1), reals(num_ + 1)
+        {
+        }
+        ~bench_data()
+        {
+            delete[] bools;
+            delete[] bools_out;
+        }
+
+        /* copies the inputs to the in-place buffers */
+        void restore()
+        {
+            std::copy(bools, bools + num, bools_out);
+            std::copy(tris.begin(), tris.end(), tris_out.begin());
+            std::copy(tri8s.begin(), tri8s.end(), tri8s_out.begin());
+            std::copy(bits.begin(), bits.end(), bits_out.begin());
+            std::copy(trues.begin(), trues.end(), trues_out.begin());
+            std::copy(falses.begin(), falses.end(), falses_out.begin());
+        }
+
+    private:
+        bench_data(const bench_data&);
+        bench_data& operator=(const bench_data&);
+    };
+
+    enum bench_dist
+    {
+        DIST_ALL_TRUE,
+        DIST_RANDOM,
+        DIST_SKEWED_UNKNOWN,    // 90% unknown, no false
+        DIST_EARLY_EXIT,        // false and true at the front
+        DIST_LATE_EXIT,         // one false at the back
+        DIST_LATE_EXIT_OR,      // all false but one true at the back
+        DIST_COUNT
+    };
+
+    const char *const s_dist_names[DIST_COUNT] =
+    {
+        "all_true", "random", "skewed_unknown", "early_exit", "late_exit",
+        "late_exit_or"
+    };
+
+    void fill_data(bench_data& data, bench_dist dist)
+    {
+        TS_WORD seed = 0x9E3779B97F4A7C15ULL;
+        const size_t num = data.num;
+        for (size_t i = 0; i < num; ++i)
+        {
+            seed ^= seed << 13;
+            seed ^= seed >> 7;
+            seed ^= seed << 17;
+            TRISTATE value = TS_TRUE;
+            switch (dist)
+            {
+            case DIST_RANDOM:
+                value = (TRISTATE)((int)(seed % 3) - 1);
+                break;
+            case DIST_SKEWED_UNKNOWN:
+                value = (seed % 10 ? TS_UNKNOWN : TS_TRUE);
+                break;
+            case DIST_EARLY_EXIT:
+                if (i == 0)
+                    value = TS_FALSE;
+                break;
+            case DIST_LATE_EXIT:
+                if (i + 2 == num)
+                    value = TS_FALSE;
+                break;
+            case DIST_LATE_EXIT_OR:
+                if (i + 2 != num)
+                    value = TS_FALSE;
+                break;
+            default:
+                break;
+            }
+            data.tris[i] = value;
+            data.reals[i] = (double)(seed >> 40) / (1 << 24);
+            if (value == TS_UNKNOWN && dist == DIST_RANDOM)
+                data.bools[i] = ((seed >> 32) & 1) != 0;
+            else if (value == TS_UNKNOWN)
+                data.bools[i] = true;
+            else
+                data.bools[i] = (value == TS_TRUE);
+        }
+        if (dist == DIST_EARLY_EXIT && num > 1)
+            data.bools[1] = true;
+        TS_tri_to_tri8(num, &data.tris[0], &data.tri8s[0]);
+        TS_bool_to_bits(num, data.bools, &data.bits[0]);
+        TS_tri_to_packed(num, &data.tris[0], &data.trues[0], &data.falses[0]);
+        data.restore();
+    }
+
+    typedef void (*bench_fn)(bench_data& data);
+
+    struct bench_kernel
+    {
+        const char *    name;
+        const char *    repr;
+        double          bytes;      // bytes touched per element
+        bench_fn        fn;
+        bench_fn        reset;      // if not NULL, run untimed before fn
+    };
+
+    /* the in-place kernels get their input back before every call */
+    void r_bools_out(bench_data& d)
+    {
+        std::copy(d.bools, d.bools + d.num, d.bools_out);
+    }
+    void r_tris_out(bench_data& d)
+    {
+        std::copy(d.tris.begin(), d.tris.begin() + d.num,
+                  d.tris_out.begin());
+    }
+    void r_tri8s_out(bench_data& d)
+    {
+        std::copy(d.tri8s.begin(), d.tri8s.begin() + d.num,
+                  d.tri8s_out.begin());
+    }
+
+    /* bool arrays */
+    void b_bool_to_tri(bench_data& d)
+    {
+        TS_bool_to_tri(d.num, d.bools, &d.tris_out[0]);
+    }
+    void b_tri_to_bool(bench_data& d)
+    {
+        TS_tri_to_bool(d.num, &d.tris[0], d.bools_out);
+    }
+    void b_tri_to_bool_def(bench_data& d)
+    {
+        TS_tri_to_bool_def(d.num, &d.tris[0], d.bools_out, false);
+    }
+    void b_get_totality(bench_data& d)
+    {
+        bool value = false;
+        TS_get_totality(&value, d.num, d.bools);
+        s_sink += value;
+    }
+    void b_set_totality(bench_data& d)
+    {
+        TS_set_totality(true, d.num, d.bools_out);
+    }
+    void b_get_tri_totality(bench_data& d)
+    {
+        TRISTATE value;
+        TS_get_tri_totality(&value, d.num, d.bools);
+        s_sink += value;
+    }
+    void b_set_tri_totality(bench_data& d)
+    {
+        TS_set_tri_totality(TS_FALSE, d.num, d.bools_out);
+    }
+    void b_each_and(bench_data& d)
+    {
+        TS_each_and(false, d.num, d.bools_out);
+    }
+    void b_each_or(bench_data& d)
+    {
+        TS_each_or(true, d.num, d.bools_out);
+    }
+    void b_each_not(bench_data& d)
+    {
+        TS_each_not(d.num, d.bools_out);
+    }
+    void b_connect_and(bench_data& d)
+    {
+        s_sink += TS_connect_and(d.num, d.bools);
+    }
+    void b_connect_or(bench_data& d)
+    {
+        s_sink += TS_connect_or(d.num, d.bools);
+    }
+
+    /* TRISTATE arrays */
+    void b_get_totality_tri(bench_data& d)
+    {
+        bool value = false;
+        TS_get_totality_tri(&value, d.num, &d.tris[0]);
+        s_sink += value;
+    }
+    void b_set_totality_tri(bench_data& d)
+    {
+        TS_set_totality_tri(true, d.num, &d.tris_out[0]);
+    }
+    void b_get_tri_totality_tri(bench_data& d)
+    {
+        TRISTATE value;
+        TS_get_tri_totality_tri(&value, d.num, &d.tris[0]);
+        s_sink += value;
+    }
+    void b_set_tri_totality_tri(bench_data& d)
+    {
+        TS_set_tri_totality_tri(TS_TRUE, d.num, &d.tris_out[0]);
+    }
+    void b_reset_tri_totality_tri(bench_data& d)
+    {
+        TS_reset_tri_totality_tri(TS_UNKNOWN, d.num, &d.tris_out[0]);
+    }
+    void b_each_and_tri(bench_data& d)
+    {
+        TS_each_and_tri(false, d.num, &d.tris_out[0]);
+    }
+    void b_each_or_tri(bench_data& d)
+    {
+        TS_each_or_tri(true, d.num, &d.tris_out[0]);
+    }
+    void b_each_not_tri(bench_data& d)
+    {
+        TS_each_not_tri(d.num, &d.tris_out[0]);
+    }
+    void b_tri_each_and_tri(bench_data& d)
+    {
+        TS_tri_each_and_tri(TS_UNKNOWN, d.num, &d.tris_out[0]);
+    }
+    void b_tri_each_or_tri(bench_data& d)
+    {
+        TS_tri_each_or_tri(TS_UNKNOWN, d.num, &d.tris_out[0]);
+    }
+    void b_connect_and_tri(bench_data& d)
+    {
+        s_sink += TS_connect_and_tri(d.num, &d.tris[0]);
+    }
+    void b_connect_or_tri(bench_data& d)
+    {
+        s_sink += TS_connect_or_tri(d.num, &d.tris[0]);
+    }
+    void b_inclusive_scan_and_tri(bench_data& d)
+    {
+        TS_inclusive_scan_and_tri(d.num, &d.tris[0], &d.tris_out[0]);
+    }
+    void b_exclusive_scan_or_tri(bench_data& d)
+    {
+        TS_exclusive_scan_or_tri(d.num, &d.tris[0], &d.tris_out[0]);
+    }
+    void b_tri_each_and_tri_masked(bench_data& d)
+    {
+        TS_tri_each_and_tri_masked(TS_UNKNOWN, d.num, &d.tris_out[0],
+                                   &d.bits[0]);
+    }
+    void b_each_not_tri_masked(bench_data& d)
+    {
+        TS_each_not_tri_masked(d.num, &d.tris_out[0], &d.bits[0]);
+    }
+    void b_select_tri(bench_data& d)
+    {
+        size_t first = 0;
+        s_sink += (int)TS_select_tri(TS_SELECT_TRUE, &first, d.num,
+                                     &d.tris[0], d.num, &d.indices[0]);
+    }
+    void b_compact_tri(bench_data& d)
+    {
+        s_sink += (int)TS_compact_tri(TS_SELECT_KNOWN, d.num, &d.tris[0],
+                                      &d.tris_out[0]);
+    }
+
+    /* bitsets */
+    void b_bool_to_bits(bench_data& d)
+    {
+        TS_bool_to_bits(d.num, d.bools, &d.bits_out[0]);
+    }
+    void b_bits_to_bool(bench_data& d)
+    {
+        TS_bits_to_bool(d.num, &d.bits[0], d.bools_out);
+    }
+    void b_bits_to_tri(bench_data& d)
+    {
+        TS_bits_to_tri(d.num, &d.bits[0], &d.tris_out[0]);
+    }
+    void b_bits_count(bench_data& d)
+    {
+        s_sink += (int)TS_bits_count(d.num, &d.bits[0]);
+    }
+    void b_bits_get_tri_totality(bench_data& d)
+    {
+        TRISTATE value;
+        TS_bits_get_tri_totality(&value, d.num, &d.bits[0]);
+        s_sink += value;
+    }
+    void b_bits_each_not(bench_data& d)
+    {
+        TS_bits_each_not(d.num, &d.bits_out[0]);
+    }
+    void b_bits_connect_and(bench_data& d)
+    {
+        s_sink += TS_bits_connect_and(d.num, &d.bits[0]);
+    }
+    void b_bits_connect_or(bench_data& d)
+    {
+        s_sink += TS_bits_connect_or(d.num, &d.bits[0]);
+    }
+
+    /* TRISTATE8 arrays */
+    void b_tri_to_tri8(bench_data& d)
+    {
+        TS_tri_to_tri8(d.num, &d.tris[0], &d.tri8s_out[0]);
+    }
+    void b_tri8_to_tri(bench_data& d)
+    {
+        TS_tri8_to_tri(d.num, &d.tri8s[0], &d.tris_out[0]);
+    }
+    void b_tri8_to_bool_def(bench_data& d)
+    {
+        TS_tri8_to_bool_def(d.num, &d.tri8s[0], d.bools_out, false);
+    }
+    void b_get_tri_totality_tri8(bench_data& d)
+    {
+        TRISTATE value;
+        TS_get_tri_totality_tri8(&value, d.num, &d.tri8s[0]);
+        s_sink += value;
+    }
+    void b_each_not_tri8(bench_data& d)
+    {
+        TS_each_not_tri8(d.num, &d.tri8s_out[0]);
+    }
+    void b_tri_each_and_tri8(bench_data& d)
+    {
+        TS_tri_each_and_tri8(TS_UNKNOWN, d.num, &d.tri8s_out[0]);
+    }
+    void b_connect_and_tri8(bench_data& d)
+    {
+        s_sink += TS_connect_and_tri8(d.num, &d.tri8s[0]);
+    }
+    void b_connect_or_tri8(bench_data& d)
+    {
+        s_sink += TS_connect_or_tri8(d.num, &d.tri8s[0]);
+    }
+
+    /* packed arrays */
+    void b_tri_to_packed(bench_data& d)
+    {
+        TS_tri_to_packed(d.num, &d.tris[0], &d.trues_out[0],
+                         &d.falses_out[0]);
+    }
+    void b_packed_to_tri(bench_data& d)
+    {
+        TS_packed_to_tri(d.num, &d.trues[0], &d.falses[0], &d.tris_out[0]);
+    }
+    void b_packed_count(bench_data& d)
+    {
+        s_sink += (int)TS_packed_count(TS_UNKNOWN, d.num,
+                                       &d.trues[0], &d.falses[0]);
+    }
+    void b_packed_get_tri_totality(bench_data& d)
+    {
+        TRISTATE value;
+        TS_packed_get_tri_totality(&value, d.num, &d.trues[0], &d.falses[0]);
+        s_sink += value;
+    }
+    void b_packed_each_not(bench_data& d)
+    {
+        TS_packed_each_not(d.num, &d.trues_out[0], &d.falses_out[0]);
+    }
+    void b_packed_and(bench_data& d)
+    {
+        TS_packed_and(d.num, &d.trues_out[0], &d.falses_out[0],
+                      &d.trues[0], &d.falses[0]);
+    }
+    void b_packed_connect_and(bench_data& d)
+    {
+        s_sink += TS_packed_connect_and(d.num, &d.trues[0], &d.falses[0]);
+    }
+    void b_packed_connect_or(bench_data& d)
+    {
+        s_sink += TS_packed_connect_or(d.num, &d.trues[0], &d.falses[0]);
+    }
+    void b_packed_select(bench_data& d)
+    {
+        size_t first = 0;
+        s_sink += (int)TS_packed_select(TS_SELECT_TRUE, &first, d.num,
+                                        &d.trues[0], &d.falses[0], d.num,
+                                        &d.indices[0]);
+    }
+    void b_arrow_to_tri(bench_data& d)
+    {
+        TS_arrow_to_tri(d.num, 3, (const uint8_t *)&d.bits[0],
+                        (const uint8_t *)&d.trues[0], &d.tris_out[0]);
+    }
+    void b_arrow_connect_and(bench_data& d)
+    {
+        s_sink += TS_arrow_connect_and(d.num, 3, (const uint8_t *)&d.bits[0],
+                                       (const uint8_t *)&d.trues[0]);
+    }
+    void b_compare_tri(bench_data& d)
+    {
+        TS_compare_tri(TS_CMP_LT, d.num,
+                       TriNullable<double>(&d.reals[0],
+                                           (const uint8_t *)&d.bits[0]),
+                       TriNullableScalar<double>(0.5), &d.tris_out[0]);
+    }
+    void b_compare_tri_and(bench_data& d)
+    {
+        TS_compare_tri_and(TS_CMP_LT, d.num,
+                           TriNullable<double>(&d.reals[0],
+                                               (const uint8_t *)&d.bits[0]),
+                           TriNullableScalar<double>(0.5), &d.tris_out[0]);
+    }
+    void b_between_packed(bench_data& d)
+    {
+        TS_between_packed(d.num,
+                          TriNullable<double>(&d.reals[0],
+                                              (const uint8_t *)&d.bits[0]),
+                          TriNullableScalar<double>(0.25),
+                          TriNullableScalar<double>(0.75),
+                          &d.trues_out[0], &d.falses_out[0]);
+    }
+    void b_packed_inclusive_scan_and(bench_data& d)
+    {
+        std::copy(d.trues.begin(), d.trues.end(), d.trues_out.begin());
+        std::copy(d.falses.begin(), d.falses.end(), d.falses_out.begin());
+        TS_packed_inclusive_scan_and(d.num, &d.trues_out[0],
+                                     &d.falses_out[0]);
+    }
+
+    const double B = sizeof(bool);
+    const double T = sizeof(TRISTATE);
+    const double T8 = sizeof(TRISTATE8);
+    const double BIT = 1.0 / 8;
+    const double D = sizeof(double);
+
+    const bench_kernel s_kernels[] =
+    {
+        { "TS_bool_to_tri", "bool", B + T, b_bool_to_tri, NULL },
+        { "TS_tri_to_bool", "tri", T + B, b_tri_to_bool, NULL },
+        { "TS_tri_to_bool_def", "tri", T + B, b_tri_to_bool_def, NULL },
+        { "TS_get_totality", "bool", B, b_get_totality, NULL },
+        { "TS_set_totality", "bool", B, b_set_totality, NULL },
+        { "TS_get_tri_totality", "bool", B, b_get_tri_totality, NULL },
+        { "TS_set_tri_totality", "bool", B, b_set_tri_totality, NULL },
+        { "TS_each_and", "bool", 2 * B, b_each_and, r_bools_out },
+        { "TS_each_or", "bool", 2 * B, b_each_or, r_bools_out },
+        { "TS_each_not", "bool", 2 * B, b_each_not, NULL },
+        { "TS_connect_and", "bool", B, b_connect_and, NULL },
+        { "TS_connect_or", "bool", B, b_connect_or, NULL },
+        { "TS_get_totality_tri", "tri", T, b_get_totality_tri, NULL },
+        { "TS_set_totality_tri", "tri", T, b_set_totality_tri, NULL },
+        { "TS_get_tri_totality_tri", "tri", T, b_get_tri_totality_tri, NULL },
+        { "TS_set_tri_totality_tri", "tri", T, b_set_tri_totality_tri, NULL },
+        { "TS_reset_tri_totality_tri", "tri", T,
+          b_reset_tri_totality_tri, NULL },
+        { "TS_each_and_tri", "tri", 2 * T, b_each_and_tri, r_tris_out },
+        { "TS_each_or_tri", "tri", 2 * T, b_each_or_tri, r_tris_out },
+        { "TS_each_not_tri", "tri", 2 * T, b_each_not_tri, NULL },
+        { "TS_tri_each_and_tri", "tri", 2 * T, b_tri_each_and_tri,
+          r_tris_out },
+        { "TS_tri_each_or_tri", "tri", 2 * T, b_tri_each_or_tri,
+          r_tris_out },
+        { "TS_connect_and_tri", "tri", T, b_connect_and_tri, NULL },
+        { "TS_connect_or_tri", "tri", T, b_connect_or_tri, NULL },
+        { "TS_inclusive_scan_and_tri", "tri", 2 * T,
+          b_inclusive_scan_and_tri, NULL },
+        { "TS_exclusive_scan_or_tri", "tri", 2 * T,
+          b_exclusive_scan_or_tri, NULL },
+        { "TS_tri_each_and_tri_masked", "tri", 2 * T + BIT,
+          b_tri_each_and_tri_masked, r_tris_out },
+        { "TS_each_not_tri_masked", "tri", 2 * T + BIT,
+          b_each_not_tri_masked, NULL },
+        { "TS_select_tri", "tri", T, b_select_tri, NULL },
+        { "TS_compact_tri", "tri", 2 * T, b_compact_tri, NULL },
+        { "TS_bool_to_bits", "bits", B + BIT, b_bool_to_bits, NULL },
+        { "TS_bits_to_bool", "bits", BIT + B, b_bits_to_bool, NULL },
+        { "TS_bits_to_tri", "bits", BIT + T, b_bits_to_tri, NULL },
+        { "TS_bits_count", "bits", BIT, b_bits_count, NULL },
+        { "TS_bits_get_tri_totality", "bits", BIT,
+          b_bits_get_tri_totality, NULL },
+        { "TS_bits_each_not", "bits", 2 * BIT, b_bits_each_not, NULL },
+        { "TS_bits_connect_and", "bits", BIT, b_bits_connect_and, NULL },
+        { "TS_bits_connect_or", "bits", BIT, b_bits_connect_or, NULL },
+        { "TS_tri_to_tri8", "tri8", T + T8, b_tri_to_tri8, NULL },
+        { "TS_tri8_to_tri", "tri8", T8 + T, b_tri8_to_tri, NULL },
+        { "TS_tri8_to_bool_def", "tri8", T8 + B, b_tri8_to_bool_def, NULL },
+        { "TS_get_tri_totality_tri8", "tri8", T8,
+          b_get_tri_totality_tri8, NULL },
+        { "TS_each_not_tri8", "tri8", 2 * T8, b_each_not_tri8, NULL },
+        { "TS_tri_each_and_tri8", "tri8", 2 * T8, b_tri_each_and_tri8,
+          r_tri8s_out },
+        { "TS_connect_and_tri8", "tri8", T8, b_connect_and_tri8, NULL },
+        { "TS_connect_or_tri8", "tri8", T8, b_connect_or_tri8, NULL },
+        { "TS_tri_to_packed", "packed", T + 2 * BIT, b_tri_to_packed, NULL },
+        { "TS_packed_to_tri", "packed", 2 * BIT + T, b_packed_to_tri, NULL },
+        { "TS_packed_count", "packed", 2 * BIT, b_packed_count, NULL },
+        { "TS_packed_get_tri_totality", "packed", 2 * BIT,
+          b_packed_get_tri_totality, NULL },
+        { "TS_packed_each_not", "packed", 4 * BIT, b_packed_each_not, NULL },
+        { "TS_packed_and", "packed", 6 * BIT, b_packed_and, NULL },
+        { "TS_packed_connect_and", "packed", 2 * BIT,
+          b_packed_connect_and, NULL },
+        { "TS_packed_connect_or", "packed", 2 * BIT,
+          b_packed_connect_or, NULL },
+        { "TS_packed_inclusive_scan_and", "packed", 8 * BIT,
+          b_packed_inclusive_scan_and, NULL },
+        { "TS_packed_select", "packed", 2 * BIT, b_packed_select, NULL },
+        { "TS_arrow_to_tri", "arrow", 2 * BIT + T, b_arrow_to_tri, NULL },
+        { "TS_arrow_connect_and", "arrow", 2 * BIT,
+          b_arrow_connect_and, NULL },
+        { "TS_compare_tri", "nullable", D + BIT + T, b_compare_tri, NULL },
+        { "TS_compare_tri_and", "nullable", D + BIT + 2 * T,
+          b_compare_tri_and, NULL },
+        { "TS_between_packed", "nullable", D + BIT + 2 * BIT,
+          b_between_packed, NULL },
+    };
+
+    /* nanoseconds for reps calls, less the time of their resets */
+    double time_reps(const bench_kernel& kernel, bench_data& data,
+                     size_t reps)
+    {
+        double start = now_nsec();
+        if (!kernel.reset)
+        {
+            for (size_t i = 0; i < reps; ++i)
+                kernel.fn(data);
+            return now_nsec() - start;
+        }
+        for (size_t i = 0; i < reps; ++i)
+        {
+            kernel.reset(data);
+            kernel.fn(data);
+        }
+        const double both = now_nsec() - start;
+        start = now_nsec();
+        for (size_t i = 0; i < reps; ++i)
+            kernel.reset(data);
+        const double resets = now_nsec() - start;
+        return (both > resets ? both - resets : 0);
+    }
+
+    /* nanoseconds per call: the minimum and the median of the trials */
+    void measure(const bench_kernel& kernel, bench_data& data,
+                 double time_nsec, size_t& reps, double& best,
+                 double& median)
+    {
+        data.restore();
+        kernel.fn(data);    // warm-up
+
+        reps = 1;
+        for (;;)
+        {
+            const double elapsed = time_reps(kernel, data, reps);
+            if (elapsed >= time_nsec / 10 || reps >= ((size_t)1 << 30))
+                break;
+            reps *= (elapsed <= 0 ? 16 : 2);
+        }
+
+        const int trials = 5;
+        double times[trials];
+        for (int k = 0; k < trials; ++k)
+            times[k] = time_reps(kernel, data, reps) / reps;
+        std::sort(times, times + trials);
+        best = times[0];
+        median = times[trials / 2];
+    }
+
+    const char *compiler_name()
+    {
+#if defined(__clang__)
+        return "clang " __clang_version__;
+#elif defined(__GNUC__)
+        return "gcc " __VERSION__;
+#elif defined(_MSC_VER)
+        return "msvc";
+#else
+        return "unknown";
+#endif
+    }
+
+#ifdef TRISTATE_NUMA
+    /* --numa: passes over num TRISTATEs bound to the first node (local),
+     * to the last node (remote), interleaved over the nodes, or split by
+     * chunk (partition), run by one thread bound to the first node and by
+     * a TriExec on a TriNumaPool.  With one node, remote is local. */
+    enum numa_placement
+    {
+        NUMA_LOCAL,
+        NUMA_REMOTE,
+        NUMA_INTERLEAVE,
+        NUMA_PARTITION,
+        NUMA_COUNT
+    };
+
+    const char *const s_numa_names[NUMA_COUNT] =
+    {
+        "local", "remote", "interleave", "partition"
+    };
+
+    /* the best of five passes after a warm-up, in nanoseconds */
+    template <typename T_FN>
+    double numa_measure(T_FN fn)
+    {
+        fn();
+        double best = 0;
+        for (int k = 0; k < 5; ++k)
+        {
+            const double start = now_nsec();
+            fn();
+            const double elapsed = now_nsec() - start;
+            if (k == 0 || elapsed < best)
+                best = elapsed;
+        }
+        return best;
+    }
+
+    void bench_numa(size_t num, bool csv)
+    {
+        const std::vector<int> nodes = TS_numa_nodes();
+        TriNumaPool pool;
+        const TriExec serial(1), parallel(pool);
+        TS_numa_bind_thread(nodes[0]);
+
+        const size_t size = num * sizeof(TRISTATE);
+        if (csv)
+        {
+            std::printf("# compiler: %s\n", compiler_name());
+            std::printf("placement,mode,function,num,nodes,threads,placed,"
+                        "ns_per_elem,gb_per_sec\n");
+        }
+        for (int placement = 0; placement < NUMA_COUNT; ++placement)
+        {
+            TRISTATE *tris = static_cast<TRISTATE *>(TS_numa_alloc(size));
+            if (!tris)
+            {
+                std::fprintf(stderr, "cannot allocate %lu bytes\n",
+                             (unsigned long)size);
+                return;
+            }
+            bool placed = false;
+            switch (placement)
+            {
+            case NUMA_LOCAL:
+                placed = TS_numa_place(tris, size, TS_NUMA_BIND,
+                                       std::vector<int>(1, nodes[0]));
+                break;
+            case NUMA_REMOTE:
+                placed = TS_numa_place(tris, size, TS_NUMA_BIND,
+                                       std::vector<int>(1, nodes.back()));
+                break;
+            case NUMA_INTERLEAVE:
+                placed = TS_numa_place(tris, size, TS_NUMA_INTERLEAVE,
+                                       nodes);
+                break;
+            default:
+                placed = pool.place(parallel, tris, num, sizeof(TRISTATE));
+                break;
+            }
+            /* touched after the placement, as the pages follow it */
+            TS_set_tri_totality_tri(parallel, TS_TRUE, num, tris);
+
+            for (int mode = 0; mode < 2; ++mode)
+            {
+                const TriExec& exec = (mode ? parallel : serial);
+                for (int fn = 0; fn < 2; ++fn)
+                {
+                    const double best = (fn == 0
+                        ? numa_measure([&]() {
+                              s_sink += TS_connect_and_tri(exec, num, tris);
+                          })
+                        : numa_measure([&]() {
+                              TS_each_not_tri(exec, num, tris);
+                          }));
+                    const double bytes = (fn == 0 ? 1.0 : 2.0) * size;
+                    const char *format = csv
+                        ? "%s,%s,%s,%lu,%d,%u,%d,%.4f,%.3f\n"
+                        : "{\"type\":\"numa\",\"placement\":\"%s\","
+                          "\"mode\":\"%s\",\"function\":\"%s\","
+                          "\"num\":%lu,\"nodes\":%d,\"threads\":%u,"
+                          "\"placed\":%d,\"ns_per_elem\":%.4f,"
+                          "\"gb_per_sec\":%.3f}\n";
+                    std::printf(format, s_numa_names[placement],
+                                (mode ? "parallel" : "serial"),
+                                (fn ? "TS_each_not_tri"
+                                    : "TS_connect_and_tri"),
+                                (unsigned long)num, (int)nodes.size(),
+                                exec.threads(), (int)placed, best / num,
+                                bytes / best);
+                    std::fflush(stdout);
+                }
+            }
+            TS_numa_free(tris, size);
+        }
+    }
+#endif  /* def TRISTATE_NUMA */
+} // namespace
+
+int main(int argc, char **argv)
+{
+    bool csv = false;
+    size_t min_num = 1024, max_num = 16 * 1024 * 1024;
+    double time_nsec = 20e6;
+    const char *filter = NULL;
+#ifdef TRISTATE_NUMA
+    bool numa = false;
+#endif
+
+    for (int i = 1; i < argc; ++i)
+    {
+        if (std::strcmp(argv[i], "--csv") == 0)
+            csv = true;
+        else if (std::strcmp(argv[i], "--min") == 0 && i + 1 < argc)
+            min_num = std::strtoul(argv[++i], NULL, 0);
+        else if (std::strcmp(argv[i], "--max") == 0 && i + 1 < argc)
+            max_num = std::strtoul(argv[++i], NULL, 0);
+        else if (std::strcmp(argv[i], "--time") == 0 && i + 1 < argc)
+            time_nsec = std::atof(argv[++i]) * 1e6;
+        else if (std::strcmp(argv[i], "--filter") == 0 && i + 1 < argc)
+            filter = argv[++i];
+#ifdef TRISTATE_NUMA
+        else if (std::strcmp(argv[i], "--numa") == 0)
+            numa = true;
+#endif
+        else
+        {
+            std::fprintf(stderr, "usage: %s [--csv] [--min NUM] [--max NUM] "
+                         "[--time MSEC] [--filter TEXT]%s\n", argv[0],
+#ifdef TRISTATE_NUMA
+                         " [--numa]"
+#else
+                         ""
+#endif
+                         );
+            return 1;
+        }
+    }
+    if (min_num < 4)
+        min_num = 4;
+
+#ifdef TRISTATE_NUMA
+    if (numa)
+    {
+        bench_numa(max_num, csv);
+        return 0;
+    }
+#endif
+
+    if (csv)
+    {
+        std::printf("# compiler: %s\n", compiler_name());
+        std::printf("function,repr,dist,num,inline,strict,reps,"
+                    "ns_per_call,ns_per_call_median,ns_per_elem,"
+                    "elems_per_sec,gb_per_sec\n");
+    }
+    else
+    {
+        std::printf("{\"type\":\"config\",\"compiler\":\"%s\","
+                    "\"inline\":%d,\"strict\":%d,\"sizeof_bool\":%d,"
+                    "\"sizeof_tristate\":%d}\n", compiler_name(),
+                    BENCH_INLINE, BENCH_STRICT, (int)sizeof(bool),
+                    (int)sizeof(TRISTATE));
+    }
+
+    const size_t num_kernels = sizeof(s_kernels) / sizeof(s_kernels[0]);
+    for (size_t num = min_num; num <= max_num; num *= 4)
+    {
+        bench_data data(num);
+        for (int dist = 0; dist < DIST_COUNT; ++dist)
+        {
+            fill_data(data, (bench_dist)dist);
+            for (size_t k = 0; k < num_kernels; ++k)
+            {
+                const bench_kernel& kernel = s_kernels[k];
+                if (filter && !std::strstr(kernel.name, filter))
+                    continue;
+
+                size_t reps;
+                double best, median;
+                measure(kernel, data, time_nsec, reps, best, median);
+                const double elems = num / (best * 1e-9);
+                const double gbps = kernel.bytes * num / best;
+
+                const char *format = csv
+                    ? "%s,%s,%s,%lu,%d,%d,%lu,%.1f,%.1f,%.4f,%.4g,%.3f\n"
+                    : "{\"type\":\"result\",\"function\":\"%s\","
+                      "\"repr\":\"%s\",\"dist\":\"%s\",\"num\":%lu,"
+                      "\"inline\":%d,\"strict\":%d,\"reps\":%lu,"
+                      "\"ns_per_call\":%.1f,\"ns_per_call_median\":%.1f,"
+                      "\"ns_per_elem\":%.4f,\"elems_per_sec\":%.4g,"
+                      "\"gb_per_sec\":%.3f}\n";
+                std::printf(format, kernel.name, kernel.repr,
+                            s_dist_names[dist], (unsigned long)num,
+                            BENCH_INLINE, BENCH_STRICT, (unsigned long)reps,
+                            best, median, best / num, elems, gbps);
+                std::fflush(stdout);
+            }
+        }
+    }
+#ifdef TRISTATE_INSTRUMENT
+    TS_instr_print(stderr);
+#endif
+    return 0;
+} /* main */
+#endif  /* TRISTATE_BENCHMARK && !TRISTATE_UNITTEST */
+
+/****************************************************************************/
@@ -14,16 +14,47 @@
 #ifdef __cplusplus
     #include <cstring>          /* for strcmp and wcscmp */
     #include <cassert>          /* for assert */
+    #include <cstdio>           /* for FILE */
     using std::size_t;
+
+    #if (__cplusplus >= 201103L) || (defined(_MSC_VER) && _MSC_VER >= 1900)
+        #define TRISTATE_CXX11      /* C++11 or later */
+    #endif
+
+    /* the threaded parts (TriExec, TriCowArray, TriMemo and the parallel
+     * overloads) bring in <thread>, <mutex>, ..., so they are opt-in.
+     * TRISTATE_NUMA adds the NUMA placement, which needs the POSIX
+     * headers on Linux, and implies TRISTATE_PARALLEL. */
+    #if defined(TRISTATE_NUMA) && !defined(TRISTATE_PARALLEL)
+        #define TRISTATE_PARALLEL
+    #endif
+    #if defined(TRISTATE_PARALLEL) && !defined(TRISTATE_CXX11)
+        #error TRISTATE_PARALLEL needs C++11.
+    #endif
 #else
     #include <string.h>         /* for strcmp and wcscmp */
     #include <assert.h>         /* for assert */
+    #include <stdio.h>          /* for FILE */
 
     #ifndef __bool_true_false_are_defined
         #include <stdbool.h>    /* for bool, true, false */
     #endif
 #endif
 
+#if !defined(_MSC_VER) || _MSC_VER >= 1600
+    #include <stdint.h>         /* for uint64_t */
+#else
+    #include <basetsd.h>        /* for UINT_PTR */
+    typedef unsigned char       uint8_t;
+    typedef signed char         int8_t;
+    typedef unsigned __int64    uint64_t;
+    typedef __int64             int64_t;
+    #ifndef _UINTPTR_T_DEFINED
+        typedef UINT_PTR        uintptr_t;
+        #define _UINTPTR_T_DEFINED
+    #endif
+#endif
+
 /****************************************************************************/
 /* TRISTATE */
 
@@ -36,6 +67,31 @@ typedef enum TRISTATE
 
 typedef const TRISTATE *PCTRISTATE;
 
+/* 0, 1 or 2 for a false, unknown or true value, taken by its sign */
+#define TS_TRI_INDEX(value)     (((value) > 0) - ((value) < 0) + 1)
+
+/****************************************************************************/
+/* TS_WORD --- a word of a bitset */
+
+typedef uint64_t TS_WORD;
+
+#define TS_WORD_BITS        64
+#define TS_WORDS(num)       (((num) + TS_WORD_BITS - 1) / TS_WORD_BITS)
+
+/* the valid bits of the last word of a bitset of num bits */
+#define TS_TAIL_MASK(num) \
+    (((num) % TS_WORD_BITS) ? \
+        (((TS_WORD)1 << ((num) % TS_WORD_BITS)) - 1) : ~(TS_WORD)0)
+
+/****************************************************************************/
+/* TRISTATE8 --- one-byte TRISTATE */
+
+typedef int8_t TRISTATE8, *PTRISTATE8;
+typedef const TRISTATE8 *PCTRISTATE8;
+
+/* a value narrowed to a TRISTATE8 by its sign */
+#define TS_TO_TRI8(value)       ((TRISTATE8)(TS_TRI_INDEX(value) - 1))
+
 /****************************************************************************/
 /* TRISTATE functions */
 
@@ -46,6 +102,10 @@ extern "C" {
 bool TS_is_valid_bool(bool value);
 bool TS_is_valid_tri(TRISTATE value);
 
+/* the index of the first invalid value, or num if all are valid */
+size_t TS_find_invalid_bool(size_t num, const bool *values);
+size_t TS_find_invalid_tri(size_t num, const TRISTATE *values);
+
 TRISTATE  TS_from_bool(bool value);
 void      TS_to_bool(TRISTATE value, bool *flag);
 void      TS_to_bool_def(TRISTATE value, bool *flag, bool default_value);
@@ -102,6 +162,9 @@ TS_set_tri_totality_tri(TRISTATE   value, size_t num,       TRISTATE *values);
 void
 TS_reset_tri_totality_tri(TRISTATE value, size_t num,       TRISTATE *values);
 
+void TS_count_tri(size_t *trues, size_t *falses, size_t *unknowns,
+                  size_t num, const TRISTATE *values);
+
 void TS_each_and(bool value, size_t num, bool *values);
 void TS_each_or (bool value, size_t num, bool *values);
 void TS_each_not(            size_t num, bool *values);
@@ -119,6 +182,332 @@ bool TS_connect_or (size_t num, const bool *values);
 TRISTATE TS_connect_and_tri(size_t num, const TRISTATE *values);
 TRISTATE TS_connect_or_tri (size_t num, const TRISTATE *values);
 
+/* The same as above but without the TRISTATE_STRICT checks.  The arrays
+ * must be valid, e.g. checked once by TS_find_invalid_tri. */
+void TS_tri_to_bool_unchecked(size_t num, const TRISTATE *tris, bool *bools);
+void TS_tri_to_bool_def_unchecked(size_t num, const TRISTATE *tris,
+                                  bool *bools, bool default_value);
+void TS_get_totality_tri_unchecked(bool *value, size_t num,
+                                   const TRISTATE *values);
+void TS_get_tri_totality_tri_unchecked(TRISTATE *value, size_t num,
+                                       const TRISTATE *values);
+void TS_each_not_tri_unchecked(size_t num, TRISTATE *values);
+void TS_tri_each_and_tri_unchecked(TRISTATE value, size_t num,
+                                   TRISTATE *values);
+void TS_tri_each_or_tri_unchecked (TRISTATE value, size_t num,
+                                   TRISTATE *values);
+TRISTATE TS_connect_and_tri_unchecked(size_t num, const TRISTATE *values);
+TRISTATE TS_connect_or_tri_unchecked (size_t num, const TRISTATE *values);
+
+/* masked variants change only the values whose bit is set in mask, a
+ * bitset of TS_WORDS(num) words */
+void TS_tri_each_and_tri_masked(TRISTATE value, size_t num,
+                                TRISTATE *values, const TS_WORD *mask);
+void TS_tri_each_or_tri_masked (TRISTATE value, size_t num,
+                                TRISTATE *values, const TS_WORD *mask);
+void TS_each_not_tri_masked(size_t num, TRISTATE *values,
+                            const TS_WORD *mask);
+void TS_reset_tri_totality_tri_masked(TRISTATE value, size_t num,
+                                      TRISTATE *values, const TS_WORD *mask);
+/* indexed variants change values[indices[i]] for each i; an index given
+ * twice is negated twice by TS_each_not_tri_indexed */
+void TS_tri_each_and_tri_indexed(TRISTATE value, size_t num_indices,
+                                 const size_t *indices, TRISTATE *values);
+void TS_tri_each_or_tri_indexed (TRISTATE value, size_t num_indices,
+                                 const size_t *indices, TRISTATE *values);
+void TS_each_not_tri_indexed(size_t num_indices, const size_t *indices,
+                             TRISTATE *values);
+void TS_reset_tri_totality_tri_indexed(TRISTATE value, size_t num_indices,
+                                       const size_t *indices,
+                                       TRISTATE *values);
+
+int TS_popcount(TS_WORD word);
+int TS_ctz(TS_WORD word);
+
+bool TS_bits_get(size_t index, const TS_WORD *bits);
+void TS_bits_set(bool value, size_t index, TS_WORD *bits);
+size_t TS_bits_count(size_t num, const TS_WORD *bits);
+
+void TS_bool_to_bits(size_t num, const bool *bools, TS_WORD *bits);
+void TS_bits_to_bool(size_t num, const TS_WORD *bits, bool *bools);
+void TS_bits_to_tri(size_t num, const TS_WORD *bits, TRISTATE *tris);
+
+void TS_bits_get_totality(bool *value, size_t num, const TS_WORD *bits);
+void TS_bits_set_totality(bool  value, size_t num,       TS_WORD *bits);
+
+void
+TS_bits_get_tri_totality(TRISTATE * value, size_t num, const TS_WORD *bits);
+void
+TS_bits_set_tri_totality(TRISTATE   value, size_t num,       TS_WORD *bits);
+
+void TS_bits_each_and(bool value, size_t num, TS_WORD *bits);
+void TS_bits_each_or (bool value, size_t num, TS_WORD *bits);
+void TS_bits_each_not(            size_t num, TS_WORD *bits);
+
+bool TS_bits_connect_and(size_t num, const TS_WORD *bits);
+bool TS_bits_connect_or (size_t num, const TS_WORD *bits);
+
+/* the index of the first bit of value in [first, num), or num */
+size_t TS_bits_find(bool value, size_t first, size_t num,
+                    const TS_WORD *bits);
+void TS_bits_set_range(bool value, size_t first, size_t last,
+                       TS_WORD *bits);
+
+bool TS_is_valid_tri8(TRISTATE8 value);
+size_t TS_find_invalid_tri8(size_t num, const TRISTATE8 *values);
+
+void TS_tri_to_tri8(size_t num, const TRISTATE *tris, TRISTATE8 *tri8s);
+void TS_tri8_to_tri(size_t num, const TRISTATE8 *tri8s, TRISTATE *tris);
+void TS_bool_to_tri8(size_t num, const bool *bools, TRISTATE8 *tris);
+void TS_tri8_to_bool(size_t num, const TRISTATE8 *tris, bool *bools);
+void TS_tri8_to_bool_def(size_t num, const TRISTATE8 *tris, bool *bools,
+                         bool default_value);
+
+void TS_get_totality_tri8(bool *value, size_t num, const TRISTATE8 *values);
+void TS_set_totality_tri8(bool  value, size_t num,       TRISTATE8 *values);
+
+void
+TS_get_tri_totality_tri8(TRISTATE *value, size_t num, const TRISTATE8 *values);
+void
+TS_set_tri_totality_tri8(TRISTATE value, size_t num, TRISTATE8 *values);
+void
+TS_reset_tri_totality_tri8(TRISTATE value, size_t num, TRISTATE8 *values);
+
+void TS_each_and_tri8(bool value, size_t num, TRISTATE8 *values);
+void TS_each_or_tri8 (bool value, size_t num, TRISTATE8 *values);
+void TS_each_not_tri8(            size_t num, TRISTATE8 *values);
+
+void TS_tri_each_and_tri8(TRISTATE value, size_t num, TRISTATE8 *values);
+void TS_tri_each_or_tri8 (TRISTATE value, size_t num, TRISTATE8 *values);
+
+TRISTATE TS_connect_and_tri8(size_t num, const TRISTATE8 *values);
+TRISTATE TS_connect_or_tri8 (size_t num, const TRISTATE8 *values);
+
+/* packed arrays: two bitsets of TS_WORDS(num) words, trues and falses.
+ * A set bit in trues means TS_TRUE, a set bit in falses means TS_FALSE,
+ * and neither means TS_UNKNOWN.  No bit is set in both. */
+
+TRISTATE TS_packed_get(size_t index,
+                       const TS_WORD *trues, const TS_WORD *falses);
+void TS_packed_set(TRISTATE value, size_t index,
+                   TS_WORD *trues, TS_WORD *falses);
+
+void TS_tri_to_packed(size_t num, const TRISTATE *tris,
+                      TS_WORD *trues, TS_WORD *falses);
+void TS_packed_to_tri(size_t num, const TS_WORD *trues,
+                      const TS_WORD *falses, TRISTATE *tris);
+
+size_t TS_packed_count(TRISTATE value, size_t num,
+                       const TS_WORD *trues, const TS_WORD *falses);
+size_t TS_packed_find(TRISTATE value, size_t num,
+                      const TS_WORD *trues, const TS_WORD *falses);
+bool TS_packed_equal(size_t num,
+                     const TS_WORD *trues1, const TS_WORD *falses1,
+                     const TS_WORD *trues2, const TS_WORD *falses2);
+/* whether the bitset key matches the packed pattern, where TS_UNKNOWN
+ * matches either bit */
+bool TS_packed_match(size_t num, const TS_WORD *trues, const TS_WORD *falses,
+                     const TS_WORD *key);
+
+void TS_packed_get_tri_totality(TRISTATE *value, size_t num,
+                                const TS_WORD *trues, const TS_WORD *falses);
+void TS_packed_reset_tri_totality(TRISTATE value, size_t num,
+                                  TS_WORD *trues, TS_WORD *falses);
+
+void TS_packed_tri_each_and(TRISTATE value, size_t num,
+                            TS_WORD *trues, TS_WORD *falses);
+void TS_packed_tri_each_or (TRISTATE value, size_t num,
+                            TS_WORD *trues, TS_WORD *falses);
+void TS_packed_each_not(size_t num, TS_WORD *trues, TS_WORD *falses);
+
+void TS_packed_and(size_t num, TS_WORD *trues, TS_WORD *falses,
+                   const TS_WORD *trues2, const TS_WORD *falses2);
+void TS_packed_or (size_t num, TS_WORD *trues, TS_WORD *falses,
+                   const TS_WORD *trues2, const TS_WORD *falses2);
+
+TRISTATE TS_packed_connect_and(size_t num,
+                               const TS_WORD *trues, const TS_WORD *falses);
+TRISTATE TS_packed_connect_or (size_t num,
+                               const TS_WORD *trues, const TS_WORD *falses);
+
+/* agreement of two packed arrays.  agree, disagree and both_known count
+ * the positions known in both; either_known those known in either. */
+typedef struct TS_PACKED_DISTANCE
+{
+    size_t agree;
+    size_t disagree;
+    size_t both_known;
+    size_t either_known;
+} TS_PACKED_DISTANCE;
+
+void TS_packed_distance(TS_PACKED_DISTANCE *distance, size_t num,
+                        const TS_WORD *trues1, const TS_WORD *falses1,
+                        const TS_WORD *trues2, const TS_WORD *falses2);
+/* agree / either_known, or 0 if neither knows anything */
+double TS_packed_similarity(size_t num,
+                            const TS_WORD *trues1, const TS_WORD *falses1,
+                            const TS_WORD *trues2, const TS_WORD *falses2);
+/* finds the up to k arrays of a collection most similar to the query.
+ * The collection has count arrays of num values, each TS_WORDS(num) words
+ * long in all_trues and in all_falses.  The results are sorted by
+ * similarity, then by index; returns their number. */
+size_t TS_packed_top_k(size_t k, size_t num,
+                       const TS_WORD *trues, const TS_WORD *falses,
+                       size_t count, const TS_WORD *all_trues,
+                       const TS_WORD *all_falses,
+                       size_t *indices, double *similarities);
+
+/* compaction: a state mask selects TS_FALSE, TS_UNKNOWN and TS_TRUE by
+ * the bits 1 << (value + 1) */
+#define TS_SELECT_FALSE     1
+#define TS_SELECT_UNKNOWN   2
+#define TS_SELECT_TRUE      4
+#define TS_SELECT_KNOWN     (TS_SELECT_FALSE | TS_SELECT_TRUE)
+#define TS_SELECT_ALL       7
+
+/* writes the indices of the selected values in [*first, num), at most
+ * max_out of them, and returns their number.  *first is moved past the
+ * last index examined, so calling again continues where it stopped. */
+size_t TS_select_tri(int mask, size_t *first, size_t num,
+                     const TRISTATE *values, size_t max_out,
+                     size_t *indices);
+size_t TS_select_bool(bool value, size_t *first, size_t num,
+                      const bool *values, size_t max_out, size_t *indices);
+size_t TS_packed_select(int mask, size_t *first, size_t num,
+                        const TS_WORD *trues, const TS_WORD *falses,
+                        size_t max_out, size_t *indices);
+/* copies the selected values to results in order and returns their
+ * number.  results may be values. */
+size_t TS_compact_tri(int mask, size_t num, const TRISTATE *values,
+                      TRISTATE *results);
+
+/* writes to order the indices of keys stably sorted as F < U < T, the
+ * permutation of a counting sort.  bounds (if not NULL) receives the
+ * first U and the first T. */
+void TS_stable_order_tri(size_t num, const TRISTATE *keys, size_t *order,
+                         size_t *bounds);
+
+/* Arrow layout: nullable booleans as a validity bitmap (a set bit for a
+ * value that is not null) and a value bitmap.  Both are LSB-first bytes
+ * starting at the bit offset.  A null is TS_UNKNOWN.  validity may be
+ * NULL when nothing is null, except where the function may write a
+ * TS_UNKNOWN; the value bits of nulls are ignored. */
+TS_WORD TS_arrow_load(const uint8_t *bitmap, size_t pos, size_t count);
+void TS_arrow_store(uint8_t *bitmap, size_t pos, size_t count,
+                    TS_WORD bits);
+
+TRISTATE TS_arrow_get(size_t index, size_t offset, const uint8_t *validity,
+                      const uint8_t *values);
+void TS_arrow_set(TRISTATE value, size_t index, size_t offset,
+                  uint8_t *validity, uint8_t *values);
+
+void TS_arrow_to_tri(size_t num, size_t offset, const uint8_t *validity,
+                     const uint8_t *values, TRISTATE *tris);
+void TS_tri_to_arrow(size_t num, const TRISTATE *tris, size_t offset,
+                     uint8_t *validity, uint8_t *values);
+void TS_arrow_to_packed(size_t num, size_t offset, const uint8_t *validity,
+                        const uint8_t *values,
+                        TS_WORD *trues, TS_WORD *falses);
+void TS_packed_to_arrow(size_t num,
+                        const TS_WORD *trues, const TS_WORD *falses,
+                        size_t offset, uint8_t *validity, uint8_t *values);
+
+size_t TS_arrow_count(TRISTATE value, size_t num, size_t offset,
+                      const uint8_t *validity, const uint8_t *values);
+TRISTATE TS_arrow_connect_and(size_t num, size_t offset,
+                              const uint8_t *validity, const uint8_t *values);
+TRISTATE TS_arrow_connect_or (size_t num, size_t offset,
+                              const uint8_t *validity, const uint8_t *values);
+void TS_arrow_get_tri_totality(TRISTATE *value, size_t num, size_t offset,
+                               const uint8_t *validity,
+                               const uint8_t *values);
+
+void TS_arrow_each_not(size_t num, size_t offset, uint8_t *values);
+void TS_arrow_tri_each_and(TRISTATE value, size_t num, size_t offset,
+                           uint8_t *validity, uint8_t *values);
+void TS_arrow_tri_each_or (TRISTATE value, size_t num, size_t offset,
+                           uint8_t *validity, uint8_t *values);
+
+/* comparison operators of the nullable comparison kernels (see
+ * TS_compare_tri) */
+typedef enum TS_CMP
+{
+    TS_CMP_EQ,
+    TS_CMP_NE,
+    TS_CMP_LT,
+    TS_CMP_LE,
+    TS_CMP_GT,
+    TS_CMP_GE
+} TS_CMP;
+
+/* scans: results[i] is the Kleene AND/OR of values[0] to values[i]
+ * (inclusive) or to values[i - 1] (exclusive; results[0] is TS_TRUE for
+ * AND and TS_FALSE for OR).  results may be values. */
+void TS_inclusive_scan_and_tri(size_t num, const TRISTATE *values,
+                               TRISTATE *results);
+void TS_inclusive_scan_or_tri (size_t num, const TRISTATE *values,
+                               TRISTATE *results);
+void TS_exclusive_scan_and_tri(size_t num, const TRISTATE *values,
+                               TRISTATE *results);
+void TS_exclusive_scan_or_tri (size_t num, const TRISTATE *values,
+                               TRISTATE *results);
+
+/* scans of packed arrays, in place */
+void TS_packed_inclusive_scan_and(size_t num, TS_WORD *trues,
+                                  TS_WORD *falses);
+void TS_packed_inclusive_scan_or (size_t num, TS_WORD *trues,
+                                  TS_WORD *falses);
+void TS_packed_exclusive_scan_and(size_t num, TS_WORD *trues,
+                                  TS_WORD *falses);
+void TS_packed_exclusive_scan_or (size_t num, TS_WORD *trues,
+                                  TS_WORD *falses);
+
+/* segmented reductions: offsets has num_segments + 1 ascending entries,
+ * and results[i] is the reduction of values[offsets[i]] to
+ * values[offsets[i + 1] - 1] */
+bool TS_is_valid_offsets(size_t num_segments, const size_t *offsets);
+void TS_segmented_connect_and_tri(size_t num_segments, const size_t *offsets,
+                                  const TRISTATE *values, TRISTATE *results);
+void TS_segmented_connect_or_tri (size_t num_segments, const size_t *offsets,
+                                  const TRISTATE *values, TRISTATE *results);
+void TS_segmented_get_tri_totality_tri(size_t num_segments,
+                                       const size_t *offsets,
+                                       const TRISTATE *values,
+                                       TRISTATE *results);
+
+/* instrumentation (define TRISTATE_INSTRUMENT; needs C++11).
+ * Each thread counts into its own block with relaxed atomic increments;
+ * TS_instr_snapshot sums the live threads and the exited ones. */
+#ifdef TRISTATE_INSTRUMENT
+    #define TS_INSTR_HIST_SIZE  65  /* [0]: 0, [k]: [2^(k-1), 2^k) */
+
+    typedef struct TS_INSTR_REDUCTION
+    {
+        uint64_t calls;
+        uint64_t short_circuits;    /* calls which stopped before the end */
+        uint64_t scanned;           /* elements examined */
+        uint64_t unknowns;          /* TS_UNKNOWN elements examined */
+        uint64_t histogram[TS_INSTR_HIST_SIZE];     /* by scan length */
+    } TS_INSTR_REDUCTION;
+
+    typedef struct TS_INSTR_SNAPSHOT
+    {
+        TS_INSTR_REDUCTION connect_and;     /* TS_connect_and_tri */
+        TS_INSTR_REDUCTION connect_or;      /* TS_connect_or_tri */
+        uint64_t to_bool_calls;             /* TS_to_bool */
+        uint64_t to_bool_untouched;         /* TS_to_bool of TS_UNKNOWN */
+    } TS_INSTR_SNAPSHOT;
+
+    /* hooks */
+    void TS_instr_connect(bool is_or, size_t scanned, size_t unknowns,
+                          bool short_circuit);
+    void TS_instr_to_bool(TRISTATE value);
+
+    void TS_instr_snapshot(TS_INSTR_SNAPSHOT *snapshot);
+    void TS_instr_reset(void);
+    void TS_instr_print(FILE *fp);      /* as a JSON object */
+#endif  /* def TRISTATE_INSTRUMENT */
+
 #ifdef __cplusplus
 } // extern "C"
 #endif
@@ -128,6 +517,8 @@ TRISTATE TS_connect_or_tri (size_t num, const TRISTATE *values);
 
 #ifdef __cplusplus
     #include <string>   // for std::string, std::wstring, ...
+    class TriS8;
+
     class TriS
     {
     public:
@@ -153,6 +544,7 @@ TRISTATE TS_connect_or_tri (size_t num, const TRISTATE *values);
             : m_value(TS_from_str(str, converted)) { }
         TriS(const wchar_t *wstr, bool *converted)
             : m_value(TS_from_wstr(wstr, converted)) { }
+        TriS(const TriS8& value);
 
         bool is_valid() const {
             return TS_is_valid_tri(m_value);
@@ -191,6 +583,7 @@ TRISTATE TS_connect_or_tri (size_t num, const TRISTATE *values);
             m_value = value.m_value;
             return *this;
         }
+        TriS& operator=(const TriS8& value);
 
         inline friend bool
         operator==(const TriS& value1, const TriS& value2) {
@@ -371,7 +764,5419 @@ TRISTATE TS_connect_or_tri (size_t num, const TRISTATE *values);
     /*static*/ const TriS   TriS::T(TS_TRUE);
     /*static*/ const TriS   TriS::F(TS_FALSE);
     /*static*/ const TriS   TriS::U(TS_UNKNOWN);
-#endif  /* def __cplusplus */
+
+    /* TriS8 is a TriS stored in one byte (as a TRISTATE8).
+     * It converts to and from TriS, and its operators work like TriS's. */
+    class TriS8
+    {
+    public:
+        TriS8()
+            : m_value(TS_UNKNOWN) { }
+        TriS8(TRISTATE value)
+            : m_value(narrow(value)) { }
+        TriS8(const TriS& value)
+            : m_value(narrow(value.value())) { }
+        TriS8(const TriS8& value)
+            : m_value(value.m_value) { }
+        TriS8(bool value)
+            : m_value(value ? TS_TRUE : TS_FALSE) { }
+        TriS8(int value)
+            : m_value(narrow(TS_from_int(value))) { }
+        TriS8(const char *str)
+            : m_value(narrow(TS_from_str(str))) { }
+        TriS8(const wchar_t *wstr)
+            : m_value(narrow(TS_from_wstr(wstr))) { }
+        TriS8(const char *str, bool *converted)
+            : m_value(narrow(TS_from_str(str, converted))) { }
+        TriS8(const wchar_t *wstr, bool *converted)
+            : m_value(narrow(TS_from_wstr(wstr, converted))) { }
+
+        bool is_valid() const {
+            return TS_is_valid_tri8(m_value);
+        }
+        operator bool() const {
+            return TriS(value());
+        }
+        operator TRISTATE() const {
+            return value();
+        }
+
+        TRISTATE value() const      { return (TRISTATE)m_value; }
+        void value(TRISTATE value)  { m_value = narrow(value); }
+
+        std::string   str() const { return TS_to_str(value());  }
+        std::wstring wstr() const { return TS_to_wstr(value()); }
+
+#if defined(UNICODE) || defined(_UNICODE)
+        std::wstring tstr() const { return wstr(); }
+#else
+        std::string  tstr() const { return  str(); }
+#endif
+
+        TriS8& operator=(bool value) {
+            m_value = narrow(TS_from_bool(value));
+            return *this;
+        }
+        TriS8& operator=(int value) {
+            m_value = narrow(TS_from_int(value));
+            return *this;
+        }
+        TriS8& operator=(TRISTATE value) {
+            m_value = narrow(value);
+            return *this;
+        }
+        TriS8& operator=(const TriS& value) {
+            m_value = narrow(value.value());
+            return *this;
+        }
+        TriS8& operator=(const TriS8& value) {
+            m_value = value.m_value;
+            return *this;
+        }
+
+        inline friend bool
+        operator==(const TriS8& value1, const TriS8& value2) {
+            return TriS(value1.value()) == TriS(value2.value());
+        }
+        inline friend bool
+        operator==(const TriS8& value1, const TriS& value2) {
+            return TriS(value1.value()) == value2;
+        }
+        inline friend bool
+        operator==(const TriS& value1, const TriS8& value2) {
+            return value1 == TriS(value2.value());
+        }
+        inline friend bool
+        operator==(const TriS8& value1, int value2) {
+            return TriS(value1.value()) == TriS(value2);
+        }
+        inline friend bool
+        operator==(const TriS8& value1, bool value2) {
+            return TriS(value1.value()) == TriS(value2);
+        }
+        inline friend bool
+        operator==(int value1, const TriS8& value2) {
+            return TriS(value1) == TriS(value2.value());
+        }
+        inline friend bool
+        operator==(bool value1, const TriS8& value2) {
+            return TriS(value1) == TriS(value2.value());
+        }
+
+        inline friend bool
+        operator!=(const TriS8& value1, const TriS8& value2) {
+            return TriS(value1.value()) != TriS(value2.value());
+        }
+        inline friend bool
+        operator!=(const TriS8& value1, const TriS& value2) {
+            return TriS(value1.value()) != value2;
+        }
+        inline friend bool
+        operator!=(const TriS& value1, const TriS8& value2) {
+            return value1 != TriS(value2.value());
+        }
+        inline friend bool
+        operator!=(const TriS8& value1, int value2) {
+            return TriS(value1.value()) != TriS(value2);
+        }
+        inline friend bool
+        operator!=(const TriS8& value1, bool value2) {
+            return TriS(value1.value()) != TriS(value2);
+        }
+        inline friend bool
+        operator!=(int value1, const TriS8& value2) {
+            return TriS(value1) != TriS(value2.value());
+        }
+        inline friend bool
+        operator!=(bool value1, const TriS8& value2) {
+            return TriS(value1) != TriS(value2.value());
+        }
+
+        inline friend bool
+        operator>(const TriS8& value1, const TriS8& value2) {
+            return TriS(value1.value()) > TriS(value2.value());
+        }
+        inline friend bool
+        operator>(const TriS8& value1, const TriS& value2) {
+            return TriS(value1.value()) > value2;
+        }
+        inline friend bool
+        operator>(const TriS& value1, const TriS8& value2) {
+            return value1 > TriS(value2.value());
+        }
+        inline friend bool
+        operator>(const TriS8& value1, int value2) {
+            return TriS(value1.value()) > TriS(value2);
+        }
+        inline friend bool
+        operator>(const TriS8& value1, bool value2) {
+            return TriS(value1.value()) > TriS(value2);
+        }
+        inline friend bool
+        operator>(int value1, const TriS8& value2) {
+            return TriS(value1) > TriS(value2.value());
+        }
+        inline friend bool
+        operator>(bool value1, const TriS8& value2) {
+            return TriS(value1) > TriS(value2.value());
+        }
+
+        inline friend bool
+        operator<(const TriS8& value1, const TriS8& value2) {
+            return TriS(value1.value()) < TriS(value2.value());
+        }
+        inline friend bool
+        operator<(const TriS8& value1, const TriS& value2) {
+            return TriS(value1.value()) < value2;
+        }
+        inline friend bool
+        operator<(const TriS& value1, const TriS8& value2) {
+            return value1 < TriS(value2.value());
+        }
+        inline friend bool
+        operator<(const TriS8& value1, int value2) {
+            return TriS(value1.value()) < TriS(value2);
+        }
+        inline friend bool
+        operator<(const TriS8& value1, bool value2) {
+            return TriS(value1.value()) < TriS(value2);
+        }
+        inline friend bool
+        operator<(int value1, const TriS8& value2) {
+            return TriS(value1) < TriS(value2.value());
+        }
+        inline friend bool
+        operator<(bool value1, const TriS8& value2) {
+            return TriS(value1) < TriS(value2.value());
+        }
+
+        inline friend bool
+        operator>=(const TriS8& value1, const TriS8& value2) {
+            return TriS(value1.value()) >= TriS(value2.value());
+        }
+        inline friend bool
+        operator>=(const TriS8& value1, const TriS& value2) {
+            return TriS(value1.value()) >= value2;
+        }
+        inline friend bool
+        operator>=(const TriS& value1, const TriS8& value2) {
+            return value1 >= TriS(value2.value());
+        }
+        inline friend bool
+        operator>=(const TriS8& value1, int value2) {
+            return TriS(value1.value()) >= TriS(value2);
+        }
+        inline friend bool
+        operator>=(const TriS8& value1, bool value2) {
+            return TriS(value1.value()) >= TriS(value2);
+        }
+        inline friend bool
+        operator>=(int value1, const TriS8& value2) {
+            return TriS(value1) >= TriS(value2.value());
+        }
+        inline friend bool
+        operator>=(bool value1, const TriS8& value2) {
+            return TriS(value1) >= TriS(value2.value());
+        }
+
+        inline friend bool
+        operator<=(const TriS8& value1, const TriS8& value2) {
+            return TriS(value1.value()) <= TriS(value2.value());
+        }
+        inline friend bool
+        operator<=(const TriS8& value1, const TriS& value2) {
+            return TriS(value1.value()) <= value2;
+        }
+        inline friend bool
+        operator<=(const TriS& value1, const TriS8& value2) {
+            return value1 <= TriS(value2.value());
+        }
+        inline friend bool
+        operator<=(const TriS8& value1, int value2) {
+            return TriS(value1.value()) <= TriS(value2);
+        }
+        inline friend bool
+        operator<=(const TriS8& value1, bool value2) {
+            return TriS(value1.value()) <= TriS(value2);
+        }
+        inline friend bool
+        operator<=(int value1, const TriS8& value2) {
+            return TriS(value1) <= TriS(value2.value());
+        }
+        inline friend bool
+        operator<=(bool value1, const TriS8& value2) {
+            return TriS(value1) <= TriS(value2.value());
+        }
+
+        /* exact matches, ahead of the built-in enum operators */
+        inline friend bool
+        operator==(const TriS8& value1, TRISTATE value2) {
+            return value1.value() == value2;
+        }
+        inline friend bool
+        operator==(TRISTATE value1, const TriS8& value2) {
+            return value1 == value2.value();
+        }
+        inline friend bool
+        operator!=(const TriS8& value1, TRISTATE value2) {
+            return value1.value() != value2;
+        }
+        inline friend bool
+        operator!=(TRISTATE value1, const TriS8& value2) {
+            return value1 != value2.value();
+        }
+        inline friend bool
+        operator>(const TriS8& value1, TRISTATE value2) {
+            return value1.value() > value2;
+        }
+        inline friend bool
+        operator>(TRISTATE value1, const TriS8& value2) {
+            return value1 > value2.value();
+        }
+        inline friend bool
+        operator<(const TriS8& value1, TRISTATE value2) {
+            return value1.value() < value2;
+        }
+        inline friend bool
+        operator<(TRISTATE value1, const TriS8& value2) {
+            return value1 < value2.value();
+        }
+        inline friend bool
+        operator>=(const TriS8& value1, TRISTATE value2) {
+            return value1.value() >= value2;
+        }
+        inline friend bool
+        operator>=(TRISTATE value1, const TriS8& value2) {
+            return value1 >= value2.value();
+        }
+        inline friend bool
+        operator<=(const TriS8& value1, TRISTATE value2) {
+            return value1.value() <= value2;
+        }
+        inline friend bool
+        operator<=(TRISTATE value1, const TriS8& value2) {
+            return value1 <= value2.value();
+        }
+
+        inline friend TriS
+        operator&&(const TriS8& value1, const TriS8& value2) {
+            return TriS(value1.value()) && TriS(value2.value());
+        }
+        inline friend TriS
+        operator&&(const TriS8& value1, const TriS& value2) {
+            return TriS(value1.value()) && value2;
+        }
+        inline friend TriS
+        operator&&(const TriS& value1, const TriS8& value2) {
+            return value1 && TriS(value2.value());
+        }
+        inline friend TriS
+        operator&&(const TriS8& value1, int value2) {
+            return TriS(value1.value()) && TriS(value2);
+        }
+        inline friend TriS
+        operator&&(const TriS8& value1, bool value2) {
+            return TriS(value1.value()) && TriS(value2);
+        }
+        inline friend TriS
+        operator&&(int value1, const TriS8& value2) {
+            return TriS(value1) && TriS(value2.value());
+        }
+        inline friend TriS
+        operator&&(bool value1, const TriS8& value2) {
+            return TriS(value1) && TriS(value2.value());
+        }
+
+        inline friend TriS
+        operator||(const TriS8& value1, const TriS8& value2) {
+            return TriS(value1.value()) || TriS(value2.value());
+        }
+        inline friend TriS
+        operator||(const TriS8& value1, const TriS& value2) {
+            return TriS(value1.value()) || value2;
+        }
+        inline friend TriS
+        operator||(const TriS& value1, const TriS8& value2) {
+            return value1 || TriS(value2.value());
+        }
+        inline friend TriS
+        operator||(const TriS8& value1, int value2) {
+            return TriS(value1.value()) || TriS(value2);
+        }
+        inline friend TriS
+        operator||(const TriS8& value1, bool value2) {
+            return TriS(value1.value()) || TriS(value2);
+        }
+        inline friend TriS
+        operator||(int value1, const TriS8& value2) {
+            return TriS(value1) || TriS(value2.value());
+        }
+        inline friend TriS
+        operator||(bool value1, const TriS8& value2) {
+            return TriS(value1) || TriS(value2.value());
+        }
+
+        inline friend TriS
+        operator!(const TriS8& value) {
+            return TS_tri_not(value.value());
+        }
+
+    protected:
+        TRISTATE8 m_value;
+
+        static TRISTATE8 narrow(TRISTATE value) {
+            return TS_TO_TRI8(value);
+        }
+    }; // class TriS8
+
+    inline TriS::TriS(const TriS8& value)
+        : m_value(value.value()) { }
+
+    inline TriS& TriS::operator=(const TriS8& value) {
+        m_value = value.value();
+        return *this;
+    }
+
+    /* TriTally counts TS_TRUE, TS_FALSE and TS_UNKNOWN values, which is
+     * enough to know their Kleene AND, OR and totality. */
+    struct TriTally
+    {
+        size_t  trues;
+        size_t  falses;
+        size_t  unknowns;
+
+        TriTally() : trues(0), falses(0), unknowns(0) { }
+
+        void add(TRISTATE value) {
+            trues += (value > 0);
+            falses += (value < 0);
+            unknowns += (value == 0);
+        }
+        void remove(TRISTATE value) {
+            trues -= (value > 0);
+            falses -= (value < 0);
+            unknowns -= (value == 0);
+        }
+        void add(size_t num, const TRISTATE *values) {
+            size_t t, f, u;
+            TS_count_tri(&t, &f, &u, num, values);
+            trues += t;
+            falses += f;
+            unknowns += u;
+        }
+        void add(const TriTally& other) {
+            trues += other.trues;
+            falses += other.falses;
+            unknowns += other.unknowns;
+        }
+
+        size_t count() const {
+            return trues + falses + unknowns;
+        }
+        TRISTATE connect_and() const {
+            return (falses ? TS_FALSE : (unknowns ? TS_UNKNOWN : TS_TRUE));
+        }
+        TRISTATE connect_or() const {
+            return (trues ? TS_TRUE : (unknowns ? TS_UNKNOWN : TS_FALSE));
+        }
+        TRISTATE get_tri_totality() const {
+            if (trues && !falses)
+                return TS_TRUE;
+            if (falses && !trues)
+                return TS_FALSE;
+            return TS_UNKNOWN;
+        }
+    }; // struct TriTally
+
+    /* TriValidArray refers to a TRISTATE array which it checks once by
+     * TS_find_invalid_tri.  Its operations run the unchecked kernels, so
+     * TRISTATE_STRICT builds do not check every element again. */
+    class TriValidArray
+    {
+    public:
+        TriValidArray(size_t num, TRISTATE *values)
+            : m_num(num), m_values(values),
+              m_invalid(TS_find_invalid_tri(num, values)) { }
+
+        bool valid() const {
+            return m_invalid == m_num;
+        }
+        /* the index of the first invalid value, or size() if valid */
+        size_t first_invalid() const {
+            return m_invalid;
+        }
+        /* checks again after the array is written from outside */
+        bool revalidate() {
+            m_invalid = TS_find_invalid_tri(m_num, m_values);
+            return valid();
+        }
+
+        size_t size() const {
+            return m_num;
+        }
+        TRISTATE *data() const {
+            return m_values;
+        }
+
+        TriS operator[](size_t index) const {
+            assert(index < m_num && valid());
+            return m_values[index];
+        }
+        void set(size_t index, TriS value) {
+            assert(index < m_num);
+#ifdef TRISTATE_STRICT
+            assert(value.is_valid());
+#endif
+            m_values[index] = value.value();
+        }
+
+        TRISTATE connect_and() const {
+            assert(valid());
+            return TS_connect_and_tri_unchecked(m_num, m_values);
+        }
+        TRISTATE connect_or() const {
+            assert(valid());
+            return TS_connect_or_tri_unchecked(m_num, m_values);
+        }
+        TRISTATE get_tri_totality() const {
+            assert(valid());
+            TRISTATE value;
+            TS_get_tri_totality_tri_unchecked(&value, m_num, m_values);
+            return value;
+        }
+        void get_totality(bool& value) const {
+            assert(valid());
+            TS_get_totality_tri_unchecked(&value, m_num, m_values);
+        }
+        void to_bool(bool *bools) const {
+            assert(valid());
+            TS_tri_to_bool_unchecked(m_num, m_values, bools);
+        }
+        void to_bool_def(bool *bools, bool default_value) const {
+            assert(valid());
+            TS_tri_to_bool_def_unchecked(m_num, m_values, bools,
+                                         default_value);
+        }
+
+        void each_not() {
+            assert(valid());
+            TS_each_not_tri_unchecked(m_num, m_values);
+        }
+        void tri_each_and(TriS value) {
+            assert(valid());
+            TS_tri_each_and_tri_unchecked(value.value(), m_num, m_values);
+        }
+        void tri_each_or(TriS value) {
+            assert(valid());
+            TS_tri_each_or_tri_unchecked(value.value(), m_num, m_values);
+        }
+        void reset(TriS value) {
+            TS_reset_tri_totality_tri(value.value(), m_num, m_values);
+            m_invalid = m_num;
+        }
+
+    protected:
+        size_t      m_num;
+        TRISTATE *  m_values;
+        size_t      m_invalid;
+    }; // class TriValidArray
+
+    /* TriCountedArray refers to a TRISTATE array and keeps its TriTally
+     * up to date through its own writers, so connect_and, connect_or and
+     * totality are O(1).  Call resync() after writing data() from
+     * outside. */
+    class TriCountedArray
+    {
+    public:
+        TriCountedArray(size_t num, TRISTATE *values)
+            : m_num(num), m_values(values)
+        {
+            resync();
+        }
+
+        /* recounts the whole array */
+        void resync() {
+            m_tally = TriTally();
+            m_tally.add(m_num, m_values);
+        }
+
+        size_t size() const {
+            return m_num;
+        }
+        TRISTATE *data() const {
+            return m_values;
+        }
+        const TriTally& tally() const {
+            return m_tally;
+        }
+
+        TriS operator[](size_t index) const {
+            assert(index < m_num);
+            return m_values[index];
+        }
+        void set(size_t index, TriS value) {
+            assert(index < m_num);
+#ifdef TRISTATE_STRICT
+            assert(value.is_valid());
+#endif
+            m_tally.remove(m_values[index]);
+            m_values[index] = value.value();
+            m_tally.add(value.value());
+        }
+
+        TRISTATE connect_and() const {
+            return m_tally.connect_and();
+        }
+        TRISTATE connect_or() const {
+            return m_tally.connect_or();
+        }
+        TRISTATE get_tri_totality() const {
+            return m_tally.get_tri_totality();
+        }
+        void get_totality(bool& value) const {
+            const TRISTATE totality = m_tally.get_tri_totality();
+            if (totality != TS_UNKNOWN)
+                value = (totality > 0);
+        }
+
+        void each_not() {
+            TS_each_not_tri_unchecked(m_num, m_values);
+            const size_t trues = m_tally.trues;
+            m_tally.trues = m_tally.falses;
+            m_tally.falses = trues;
+        }
+        void tri_each_and(TriS value) {
+            TS_tri_each_and_tri_unchecked(value.value(), m_num, m_values);
+            if (value.value() < 0)
+                reset_tally(TS_FALSE);
+            else if (value.value() == 0)
+            {
+                m_tally.unknowns += m_tally.trues;
+                m_tally.trues = 0;
+            }
+        }
+        void tri_each_or(TriS value) {
+            TS_tri_each_or_tri_unchecked(value.value(), m_num, m_values);
+            if (value.value() > 0)
+                reset_tally(TS_TRUE);
+            else if (value.value() == 0)
+            {
+                m_tally.unknowns += m_tally.falses;
+                m_tally.falses = 0;
+            }
+        }
+        void reset(TriS value) {
+            TS_reset_tri_totality_tri(value.value(), m_num, m_values);
+            reset_tally(value.value());
+        }
+        void fill(size_t first, size_t last, TriS value) {
+            assert(first <= last && last <= m_num);
+#ifdef TRISTATE_STRICT
+            assert(value.is_valid());
+#endif
+            for (size_t i = first; i < last; ++i)
+            {
+                m_tally.remove(m_values[i]);
+                m_values[i] = value.value();
+            }
+            if (value.value() > 0)
+                m_tally.trues += last - first;
+            else if (value.value() < 0)
+                m_tally.falses += last - first;
+            else
+                m_tally.unknowns += last - first;
+        }
+
+    protected:
+        size_t      m_num;
+        TRISTATE *  m_values;
+        TriTally    m_tally;
+
+        void reset_tally(TRISTATE value) {
+            m_tally = TriTally();
+            if (value > 0)
+                m_tally.trues = m_num;
+            else if (value < 0)
+                m_tally.falses = m_num;
+            else
+                m_tally.unknowns = m_num;
+        }
+    }; // class TriCountedArray
+#endif  /* def __cplusplus */
+
+/****************************************************************************/
+/* TriSparse class --- sparse tri-state array */
+
+#ifdef __cplusplus
+    #include <vector>       // for std::vector
+    #include <algorithm>    // for std::lower_bound, std::set_union, ...
+    #include <iterator>     // for std::forward_iterator_tag
+    #include <utility>      // for std::pair
+
+    /* Only the known entries are stored, as two sorted index lists.
+     * Every other entry is TS_UNKNOWN. */
+    class TriSparse
+    {
+    public:
+        typedef std::vector<size_t> index_list;
+
+        TriSparse()
+            : m_size(0) { }
+        explicit TriSparse(size_t size)
+            : m_size(size) { }
+        TriSparse(size_t num, const TRISTATE *values)
+            : m_size(0) { assign(num, values); }
+
+        size_t size() const     { return m_size; }
+        bool empty() const      { return m_size == 0; }
+
+        size_t count_true() const       { return m_trues.size(); }
+        size_t count_false() const      { return m_falses.size(); }
+        size_t count_known() const {
+            return m_trues.size() + m_falses.size();
+        }
+        size_t count_unknown() const    { return m_size - count_known(); }
+
+        const index_list& trues() const     { return m_trues; }
+        const index_list& falses() const    { return m_falses; }
+
+        void clear() {
+            m_size = 0;
+            m_trues.clear();
+            m_falses.clear();
+        }
+        void reset() {
+            m_trues.clear();
+            m_falses.clear();
+        }
+        void resize(size_t size) {
+            if (size < m_size)
+            {
+                truncate(m_trues, size);
+                truncate(m_falses, size);
+            }
+            m_size = size;
+        }
+        void swap(TriSparse& other) {
+            std::swap(m_size, other.m_size);
+            m_trues.swap(other.m_trues);
+            m_falses.swap(other.m_falses);
+        }
+
+        TRISTATE get(size_t index) const {
+            assert(index < m_size);
+            if (contains(m_trues, index))
+                return TS_TRUE;
+            if (contains(m_falses, index))
+                return TS_FALSE;
+            return TS_UNKNOWN;
+        }
+        TriS operator[](size_t index) const {
+            return get(index);
+        }
+        void set(size_t index, TRISTATE value) {
+            assert(index < m_size);
+#ifdef TRISTATE_STRICT
+            assert(TS_is_valid_tri(value));
+#endif
+            erase(m_trues, index);
+            erase(m_falses, index);
+            if (value > 0)
+                insert(m_trues, index);
+            else if (value < 0)
+                insert(m_falses, index);
+        }
+
+        void assign(size_t num, const TRISTATE *values) {
+            assert(values != NULL || num == 0);
+#ifdef TRISTATE_STRICT
+            assert(TS_find_invalid_tri(num, values) == num);
+#endif
+            reset();
+            m_size = num;
+            for (size_t i = 0; i < num; ++i)
+            {
+                if (values[i] > 0)
+                    m_trues.push_back(i);
+                else if (values[i] < 0)
+                    m_falses.push_back(i);
+            }
+        }
+        void to_tri(TRISTATE *values) const {
+            assert(values != NULL || m_size == 0);
+            TS_reset_tri_totality_tri(TS_UNKNOWN, m_size, values);
+            for (size_t i = 0; i < m_trues.size(); ++i)
+                values[m_trues[i]] = TS_TRUE;
+            for (size_t i = 0; i < m_falses.size(); ++i)
+                values[m_falses[i]] = TS_FALSE;
+        }
+
+        /* same results as TS_connect_and_tri and friends, in O(1) */
+        TRISTATE connect_and() const {
+            if (!m_falses.empty())
+                return TS_FALSE;
+            if (m_trues.size() == m_size)
+                return TS_TRUE;
+            return TS_UNKNOWN;
+        }
+        TRISTATE connect_or() const {
+            if (!m_trues.empty())
+                return TS_TRUE;
+            if (m_falses.size() == m_size)
+                return TS_FALSE;
+            return TS_UNKNOWN;
+        }
+        TRISTATE get_tri_totality() const {
+            if (m_trues.empty() == m_falses.empty())
+                return TS_UNKNOWN;
+            return (m_trues.empty() ? TS_FALSE : TS_TRUE);
+        }
+
+        void each_not() {
+            m_trues.swap(m_falses);
+        }
+        void tri_each_and(TRISTATE value) {
+#ifdef TRISTATE_STRICT
+            assert(TS_is_valid_tri(value));
+#endif
+            if (value > 0)
+                return;
+            if (value < 0)
+                fill(m_falses);
+            m_trues.clear();
+        }
+        void tri_each_or(TRISTATE value) {
+#ifdef TRISTATE_STRICT
+            assert(TS_is_valid_tri(value));
+#endif
+            if (value < 0)
+                return;
+            if (value > 0)
+                fill(m_trues);
+            m_falses.clear();
+        }
+
+        /* Kleene AND: false if either is false, true if both are true */
+        inline friend TriSparse
+        operator&&(const TriSparse& value1, const TriSparse& value2) {
+            assert(value1.m_size == value2.m_size);
+            TriSparse ret(value1.m_size);
+            std::set_intersection(
+                value1.m_trues.begin(), value1.m_trues.end(),
+                value2.m_trues.begin(), value2.m_trues.end(),
+                std::back_inserter(ret.m_trues));
+            std::set_union(
+                value1.m_falses.begin(), value1.m_falses.end(),
+                value2.m_falses.begin(), value2.m_falses.end(),
+                std::back_inserter(ret.m_falses));
+            return ret;
+        }
+        /* Kleene OR: true if either is true, false if both are false */
+        inline friend TriSparse
+        operator||(const TriSparse& value1, const TriSparse& value2) {
+            assert(value1.m_size == value2.m_size);
+            TriSparse ret(value1.m_size);
+            std::set_union(
+                value1.m_trues.begin(), value1.m_trues.end(),
+                value2.m_trues.begin(), value2.m_trues.end(),
+                std::back_inserter(ret.m_trues));
+            std::set_intersection(
+                value1.m_falses.begin(), value1.m_falses.end(),
+                value2.m_falses.begin(), value2.m_falses.end(),
+                std::back_inserter(ret.m_falses));
+            return ret;
+        }
+        inline friend TriSparse
+        operator!(const TriSparse& value) {
+            TriSparse ret(value);
+            ret.each_not();
+            return ret;
+        }
+
+        inline friend bool
+        operator==(const TriSparse& value1, const TriSparse& value2) {
+            return value1.m_size == value2.m_size &&
+                   value1.m_trues == value2.m_trues &&
+                   value1.m_falses == value2.m_falses;
+        }
+        inline friend bool
+        operator!=(const TriSparse& value1, const TriSparse& value2) {
+            return !(value1 == value2);
+        }
+
+        /* iterates the known entries in index order */
+        class const_iterator
+        {
+        public:
+            typedef std::forward_iterator_tag           iterator_category;
+            typedef std::pair<size_t, TRISTATE>         value_type;
+            typedef std::ptrdiff_t                      difference_type;
+            typedef const value_type *                  pointer;
+            typedef value_type                          reference;
+
+            const_iterator()
+                : m_t(NULL), m_t_end(NULL), m_f(NULL), m_f_end(NULL) { }
+            const_iterator(const size_t *t, const size_t *t_end,
+                           const size_t *f, const size_t *f_end)
+                : m_t(t), m_t_end(t_end), m_f(f), m_f_end(f_end) { }
+
+            size_t index() const {
+                return (on_true() ? *m_t : *m_f);
+            }
+            TRISTATE value() const {
+                return (on_true() ? TS_TRUE : TS_FALSE);
+            }
+            value_type operator*() const {
+                return value_type(index(), value());
+            }
+
+            const_iterator& operator++() {
+                if (on_true())
+                    ++m_t;
+                else
+                    ++m_f;
+                return *this;
+            }
+            const_iterator operator++(int) {
+                const_iterator ret(*this);
+                ++*this;
+                return ret;
+            }
+
+            inline friend bool
+            operator==(const const_iterator& it1, const const_iterator& it2) {
+                return it1.m_t == it2.m_t && it1.m_f == it2.m_f;
+            }
+            inline friend bool
+            operator!=(const const_iterator& it1, const const_iterator& it2) {
+                return !(it1 == it2);
+            }
+
+        protected:
+            const size_t *m_t, *m_t_end;
+            const size_t *m_f, *m_f_end;
+
+            bool on_true() const {
+                return m_f == m_f_end || (m_t != m_t_end && *m_t < *m_f);
+            }
+        };
+
+        const_iterator begin() const {
+            return const_iterator(first(m_trues), last(m_trues),
+                                  first(m_falses), last(m_falses));
+        }
+        const_iterator end() const {
+            return const_iterator(last(m_trues), last(m_trues),
+                                  last(m_falses), last(m_falses));
+        }
+
+    protected:
+        size_t      m_size;
+        index_list  m_trues;
+        index_list  m_falses;
+
+        static const size_t *first(const index_list& list) {
+            return (list.empty() ? NULL : &list[0]);
+        }
+        static const size_t *last(const index_list& list) {
+            return (list.empty() ? NULL : &list[0] + list.size());
+        }
+        static bool contains(const index_list& list, size_t index) {
+            return std::binary_search(list.begin(), list.end(), index);
+        }
+        static void insert(index_list& list, size_t index) {
+            if (list.empty() || list.back() < index)
+                list.push_back(index);
+            else
+                list.insert(std::lower_bound(list.begin(), list.end(), index),
+                            index);
+        }
+        static void erase(index_list& list, size_t index) {
+            index_list::iterator it =
+                std::lower_bound(list.begin(), list.end(), index);
+            if (it != list.end() && *it == index)
+                list.erase(it);
+        }
+        static void truncate(index_list& list, size_t size) {
+            list.erase(std::lower_bound(list.begin(), list.end(), size),
+                       list.end());
+        }
+        void fill(index_list& list) const {
+            list.resize(m_size);
+            for (size_t i = 0; i < m_size; ++i)
+                list[i] = i;
+        }
+    }; // class TriSparse
+#endif  /* def __cplusplus */
+
+/****************************************************************************/
+/* TriVector class --- packed tri-state vector */
+
+#ifdef __cplusplus
+    #include <memory>       // for std::allocator
+    #include <stdexcept>    // for std::out_of_range
+
+    /* A std::vector-like container of TriS, stored as a packed array
+     * (see TS_packed_get).  Bulk operations are member functions that use
+     * the TS_packed_* functions on whole words. */
+    template <typename T_ALLOC = std::allocator<TriS> >
+    class TriVector
+    {
+    public:
+        typedef TriS                value_type;
+        typedef size_t              size_type;
+        typedef std::ptrdiff_t      difference_type;
+        typedef T_ALLOC             allocator_type;
+        typedef TriS                const_reference;
+#ifdef TRISTATE_CXX11
+        typedef typename std::allocator_traits<T_ALLOC>::
+            template rebind_alloc<TS_WORD>          word_allocator_type;
+#else
+        typedef typename T_ALLOC::template rebind<TS_WORD>::other
+                                                    word_allocator_type;
+#endif
+        typedef std::vector<TS_WORD, word_allocator_type> word_vector;
+
+        /* proxy for an element */
+        class reference
+        {
+        public:
+            reference(TS_WORD *trues, TS_WORD *falses, size_t index)
+                : m_trues(trues), m_falses(falses), m_index(index) { }
+
+            TRISTATE value() const {
+                return TS_packed_get(m_index, m_trues, m_falses);
+            }
+            operator TriS() const {
+                return value();
+            }
+            reference& operator=(const TriS& value) {
+                TS_packed_set(value.value(), m_index, m_trues, m_falses);
+                return *this;
+            }
+            reference& operator=(const reference& value) {
+                return *this = TriS(value.value());
+            }
+            void flip() {
+                *this = TS_tri_not(value());
+            }
+
+            /* swaps the values, not the proxies (for std::iter_swap) */
+            inline friend void
+            swap(reference value1, reference value2) {
+                const TriS tmp = value1;
+                value1 = value2;
+                value2 = tmp;
+            }
+
+            inline friend bool
+            operator==(const reference& value1, const reference& value2) {
+                return value1.value() == value2.value();
+            }
+            inline friend bool
+            operator==(const reference& value1, const TriS& value2) {
+                return TriS(value1.value()) == value2;
+            }
+            inline friend bool
+            operator==(const TriS& value1, const reference& value2) {
+                return value1 == TriS(value2.value());
+            }
+            inline friend bool
+            operator!=(const reference& value1, const reference& value2) {
+                return value1.value() != value2.value();
+            }
+            inline friend bool
+            operator!=(const reference& value1, const TriS& value2) {
+                return TriS(value1.value()) != value2;
+            }
+            inline friend bool
+            operator!=(const TriS& value1, const reference& value2) {
+                return value1 != TriS(value2.value());
+            }
+
+            inline friend bool
+            operator<(const reference& value1, const reference& value2) {
+                return value1.value() < value2.value();
+            }
+            inline friend bool
+            operator>(const reference& value1, const reference& value2) {
+                return value1.value() > value2.value();
+            }
+            inline friend bool
+            operator<=(const reference& value1, const reference& value2) {
+                return value1.value() <= value2.value();
+            }
+            inline friend bool
+            operator>=(const reference& value1, const reference& value2) {
+                return value1.value() >= value2.value();
+            }
+
+            inline friend TriS
+            operator&&(const reference& value1, const reference& value2) {
+                return TS_tri_and(value1.value(), value2.value());
+            }
+            inline friend TriS
+            operator&&(const reference& value1, const TriS& value2) {
+                return TS_tri_and(value1.value(), value2.value());
+            }
+            inline friend TriS
+            operator&&(const TriS& value1, const reference& value2) {
+                return TS_tri_and(value1.value(), value2.value());
+            }
+            inline friend TriS
+            operator||(const reference& value1, const reference& value2) {
+                return TS_tri_or(value1.value(), value2.value());
+            }
+            inline friend TriS
+            operator||(const reference& value1, const TriS& value2) {
+                return TS_tri_or(value1.value(), value2.value());
+            }
+            inline friend TriS
+            operator||(const TriS& value1, const reference& value2) {
+                return TS_tri_or(value1.value(), value2.value());
+            }
+            inline friend TriS
+            operator!(const reference& value) {
+                return TS_tri_not(value.value());
+            }
+
+        protected:
+            TS_WORD *m_trues;
+            TS_WORD *m_falses;
+            size_t m_index;
+        }; // class reference
+
+        template <typename T_REF, typename T_WORD_PTR>
+        class basic_iterator
+        {
+        public:
+            typedef std::random_access_iterator_tag     iterator_category;
+            typedef TriS                                value_type;
+            typedef std::ptrdiff_t                      difference_type;
+            typedef void                                pointer;
+            typedef T_REF                               reference;
+
+            basic_iterator()
+                : m_trues(NULL), m_falses(NULL), m_index(0) { }
+            basic_iterator(T_WORD_PTR trues, T_WORD_PTR falses, size_t index)
+                : m_trues(trues), m_falses(falses), m_index(index) { }
+
+            operator basic_iterator<TriS, const TS_WORD *>() const {
+                return basic_iterator<TriS, const TS_WORD *>(
+                    m_trues, m_falses, m_index);
+            }
+
+            size_t index() const {
+                return m_index;
+            }
+
+            T_REF operator*() const {
+                return TriVector::make_ref(m_trues, m_falses, m_index);
+            }
+            T_REF operator[](difference_type n) const {
+                return TriVector::make_ref(m_trues, m_falses, m_index + n);
+            }
+
+            basic_iterator& operator++() {
+                ++m_index;
+                return *this;
+            }
+            basic_iterator& operator--() {
+                --m_index;
+                return *this;
+            }
+            basic_iterator operator++(int) {
+                basic_iterator ret(*this);
+                ++m_index;
+                return ret;
+            }
+            basic_iterator operator--(int) {
+                basic_iterator ret(*this);
+                --m_index;
+                return ret;
+            }
+            basic_iterator& operator+=(difference_type n) {
+                m_index += n;
+                return *this;
+            }
+            basic_iterator& operator-=(difference_type n) {
+                m_index -= n;
+                return *this;
+            }
+
+            inline friend basic_iterator
+            operator+(const basic_iterator& it, difference_type n) {
+                return basic_iterator(it.m_trues, it.m_falses, it.m_index + n);
+            }
+            inline friend basic_iterator
+            operator+(difference_type n, const basic_iterator& it) {
+                return basic_iterator(it.m_trues, it.m_falses, it.m_index + n);
+            }
+            inline friend basic_iterator
+            operator-(const basic_iterator& it, difference_type n) {
+                return basic_iterator(it.m_trues, it.m_falses, it.m_index - n);
+            }
+            inline friend difference_type
+            operator-(const basic_iterator& it1, const basic_iterator& it2) {
+                return (difference_type)it1.m_index -
+                       (difference_type)it2.m_index;
+            }
+
+            inline friend bool
+            operator==(const basic_iterator& it1, const basic_iterator& it2) {
+                return it1.m_index == it2.m_index;
+            }
+            inline friend bool
+            operator!=(const basic_iterator& it1, const basic_iterator& it2) {
+                return it1.m_index != it2.m_index;
+            }
+            inline friend bool
+            operator<(const basic_iterator& it1, const basic_iterator& it2) {
+                return it1.m_index < it2.m_index;
+            }
+            inline friend bool
+            operator>(const basic_iterator& it1, const basic_iterator& it2) {
+                return it1.m_index > it2.m_index;
+            }
+            inline friend bool
+            operator<=(const basic_iterator& it1, const basic_iterator& it2) {
+                return it1.m_index <= it2.m_index;
+            }
+            inline friend bool
+            operator>=(const basic_iterator& it1, const basic_iterator& it2) {
+                return it1.m_index >= it2.m_index;
+            }
+
+        protected:
+            T_WORD_PTR m_trues;
+            T_WORD_PTR m_falses;
+            size_t m_index;
+        }; // class basic_iterator
+
+        typedef basic_iterator<reference, TS_WORD *>        iterator;
+        typedef basic_iterator<TriS, const TS_WORD *>       const_iterator;
+
+        TriVector()
+            : m_size(0) { }
+        explicit TriVector(const allocator_type& alloc)
+            : m_size(0), m_trues(word_allocator_type(alloc)),
+              m_falses(word_allocator_type(alloc)) { }
+        explicit TriVector(size_t size, const TriS& value = TriS::U,
+                           const allocator_type& alloc = allocator_type())
+            : m_size(size),
+              m_trues(TS_WORDS(size), 0, word_allocator_type(alloc)),
+              m_falses(TS_WORDS(size), 0, word_allocator_type(alloc))
+        {
+            fill(value);
+        }
+        TriVector(size_t num, const TRISTATE *values,
+                  const allocator_type& alloc = allocator_type())
+            : m_size(num),
+              m_trues(TS_WORDS(num), 0, word_allocator_type(alloc)),
+              m_falses(TS_WORDS(num), 0, word_allocator_type(alloc))
+        {
+            TS_tri_to_packed(num, values, trues(), falses());
+        }
+
+        allocator_type get_allocator() const {
+            return allocator_type(m_trues.get_allocator());
+        }
+
+        size_t size() const         { return m_size; }
+        bool empty() const          { return m_size == 0; }
+        size_t max_size() const     { return m_trues.max_size(); }
+        size_t capacity() const {
+            return std::min(m_trues.capacity(), m_falses.capacity()) *
+                   TS_WORD_BITS;
+        }
+        void reserve(size_t size) {
+            m_trues.reserve(TS_WORDS(size));
+            m_falses.reserve(TS_WORDS(size));
+        }
+
+        /* the planes, for the TS_packed_* functions */
+        TS_WORD *trues()                { return data(m_trues);  }
+        TS_WORD *falses()               { return data(m_falses); }
+        const TS_WORD *trues() const    { return data(m_trues);  }
+        const TS_WORD *falses() const   { return data(m_falses); }
+
+        void clear() {
+            m_size = 0;
+            m_trues.clear();
+            m_falses.clear();
+        }
+        void resize(size_t size, const TriS& value = TriS::U) {
+            const size_t old_size = m_size;
+            if (size < old_size)
+                clear_tail(size);
+            m_trues.resize(TS_WORDS(size), 0);
+            m_falses.resize(TS_WORDS(size), 0);
+            m_size = size;
+            if (old_size < size && value.value() != TS_UNKNOWN)
+            {
+                TS_WORD *bits = (value.value() > 0 ? trues() : falses());
+                for (size_t i = old_size; i < size; ++i)
+                    TS_bits_set(true, i, bits);
+            }
+        }
+        void push_back(const TriS& value) {
+            if (m_size % TS_WORD_BITS == 0)
+            {
+                m_trues.push_back(0);
+                m_falses.push_back(0);
+            }
+            TS_packed_set(value.value(), m_size++, trues(), falses());
+        }
+        void pop_back() {
+            assert(m_size > 0);
+            resize(m_size - 1);
+        }
+        void swap(TriVector& other) {
+            std::swap(m_size, other.m_size);
+            m_trues.swap(other.m_trues);
+            m_falses.swap(other.m_falses);
+        }
+
+        reference operator[](size_t index) {
+            assert(index < m_size);
+            return reference(trues(), falses(), index);
+        }
+        const_reference operator[](size_t index) const {
+            assert(index < m_size);
+            return TS_packed_get(index, trues(), falses());
+        }
+        reference at(size_t index) {
+            if (index >= m_size)
+                throw std::out_of_range("TriVector::at");
+            return (*this)[index];
+        }
+        const_reference at(size_t index) const {
+            if (index >= m_size)
+                throw std::out_of_range("TriVector::at");
+            return (*this)[index];
+        }
+        reference front()               { return (*this)[0]; }
+        const_reference front() const   { return (*this)[0]; }
+        reference back()                { return (*this)[m_size - 1]; }
+        const_reference back() const    { return (*this)[m_size - 1]; }
+
+        iterator begin() {
+            return iterator(trues(), falses(), 0);
+        }
+        iterator end() {
+            return iterator(trues(), falses(), m_size);
+        }
+        const_iterator begin() const {
+            return const_iterator(trues(), falses(), 0);
+        }
+        const_iterator end() const {
+            return const_iterator(trues(), falses(), m_size);
+        }
+
+        void assign(size_t num, const TRISTATE *values) {
+            clear();
+            resize(num);
+            TS_tri_to_packed(num, values, trues(), falses());
+        }
+        void to_tri(TRISTATE *values) const {
+            TS_packed_to_tri(m_size, trues(), falses(), values);
+        }
+
+        /* fast paths for std::fill, std::count, std::find */
+        void fill(const TriS& value) {
+            TS_packed_reset_tri_totality(value.value(), m_size,
+                                         trues(), falses());
+        }
+        size_t count(const TriS& value) const {
+            return TS_packed_count(value.value(), m_size, trues(), falses());
+        }
+        iterator find(const TriS& value) {
+            return begin() + TS_packed_find(value.value(), m_size,
+                                            trues(), falses());
+        }
+        const_iterator find(const TriS& value) const {
+            return begin() + TS_packed_find(value.value(), m_size,
+                                            trues(), falses());
+        }
+
+        TRISTATE connect_and() const {
+            return TS_packed_connect_and(m_size, trues(), falses());
+        }
+        TRISTATE connect_or() const {
+            return TS_packed_connect_or(m_size, trues(), falses());
+        }
+        TRISTATE get_tri_totality() const {
+            TRISTATE value;
+            TS_packed_get_tri_totality(&value, m_size, trues(), falses());
+            return value;
+        }
+
+        TS_PACKED_DISTANCE distance(const TriVector& other) const {
+            assert(m_size == other.m_size);
+            TS_PACKED_DISTANCE value;
+            TS_packed_distance(&value, m_size, trues(), falses(),
+                               other.trues(), other.falses());
+            return value;
+        }
+        double similarity(const TriVector& other) const {
+            assert(m_size == other.m_size);
+            return TS_packed_similarity(m_size, trues(), falses(),
+                                        other.trues(), other.falses());
+        }
+
+        void each_not() {
+            TS_packed_each_not(m_size, trues(), falses());
+        }
+        void tri_each_and(TRISTATE value) {
+            TS_packed_tri_each_and(value, m_size, trues(), falses());
+        }
+        void tri_each_or(TRISTATE value) {
+            TS_packed_tri_each_or(value, m_size, trues(), falses());
+        }
+
+        inline friend TriVector
+        operator&&(const TriVector& value1, const TriVector& value2) {
+            assert(value1.m_size == value2.m_size);
+            TriVector ret(value1);
+            TS_packed_and(ret.m_size, ret.trues(), ret.falses(),
+                          value2.trues(), value2.falses());
+            return ret;
+        }
+        inline friend TriVector
+        operator||(const TriVector& value1, const TriVector& value2) {
+            assert(value1.m_size == value2.m_size);
+            TriVector ret(value1);
+            TS_packed_or(ret.m_size, ret.trues(), ret.falses(),
+                         value2.trues(), value2.falses());
+            return ret;
+        }
+        inline friend TriVector
+        operator!(const TriVector& value) {
+            TriVector ret(value);
+            ret.each_not();
+            return ret;
+        }
+
+        inline friend bool
+        operator==(const TriVector& value1, const TriVector& value2) {
+            return value1.m_size == value2.m_size &&
+                   TS_packed_equal(value1.m_size,
+                                   value1.trues(), value1.falses(),
+                                   value2.trues(), value2.falses());
+        }
+        inline friend bool
+        operator!=(const TriVector& value1, const TriVector& value2) {
+            return !(value1 == value2);
+        }
+
+    protected:
+        size_t      m_size;
+        word_vector m_trues;
+        word_vector m_falses;
+
+        static TS_WORD *data(word_vector& words) {
+            return (words.empty() ? NULL : &words[0]);
+        }
+        static const TS_WORD *data(const word_vector& words) {
+            return (words.empty() ? NULL : &words[0]);
+        }
+        static reference
+        make_ref(TS_WORD *trues, TS_WORD *falses, size_t index) {
+            return reference(trues, falses, index);
+        }
+        static TriS
+        make_ref(const TS_WORD *trues, const TS_WORD *falses, size_t index) {
+            return TS_packed_get(index, trues, falses);
+        }
+
+        /* clears the bits at and after size in the last word kept */
+        void clear_tail(size_t size) {
+            if (size % TS_WORD_BITS)
+            {
+                const TS_WORD mask = TS_TAIL_MASK(size);
+                m_trues[size / TS_WORD_BITS] &= mask;
+                m_falses[size / TS_WORD_BITS] &= mask;
+            }
+        }
+    }; // class TriVector
+#endif  /* def __cplusplus */
+
+/****************************************************************************/
+/* TriArena class and TriBufferPool class --- temporary arrays */
+
+#ifdef __cplusplus
+    #include <new>          // for operator new, std::bad_alloc
+
+    template <typename T>
+    struct TriAlignOf
+    {
+        struct pair { char c; T t; };
+        enum { value = sizeof(pair) - sizeof(T) };
+    };
+
+    /* the bytes of num elements; throws std::bad_alloc on overflow */
+    inline size_t TS_array_bytes(size_t num, size_t elem_size)
+    {
+        if (elem_size && num > (size_t)-1 / elem_size)
+            throw std::bad_alloc();
+        return num * elem_size;
+    }
+
+    /* TriArena hands out memory by bumping a pointer through large blocks.
+     * Nothing is freed one by one; rewind() or reset() gives everything
+     * after a mark back at once, and the blocks are kept for reuse. */
+    class TriArena
+    {
+    public:
+        struct marker
+        {
+            size_t block;
+            size_t offset;
+            size_t used;
+        };
+
+        /* rewinds the arena when it goes out of scope */
+        class scope
+        {
+        public:
+            explicit scope(TriArena& arena)
+                : m_arena(arena), m_mark(arena.mark()) { }
+            ~scope() {
+                m_arena.rewind(m_mark);
+            }
+
+        protected:
+            TriArena&   m_arena;
+            marker      m_mark;
+
+            scope(const scope&);
+            scope& operator=(const scope&);
+        }; // class scope
+
+        explicit TriArena(size_t block_size = 64 * 1024)
+            : m_block_size(block_size), m_current(0), m_offset(0),
+              m_used(0), m_high_water(0), m_allocations(0)
+        {
+            assert(block_size > 0);
+        }
+        ~TriArena() {
+            for (size_t i = 0; i < m_blocks.size(); ++i)
+                ::operator delete(m_blocks[i].data);
+        }
+
+        /* throws std::bad_alloc for more than half the address space */
+        void *allocate(size_t size, size_t align = 16) {
+            assert(align > 0 && (align & (align - 1)) == 0);
+            if (size > (size_t)-1 / 2)
+                throw std::bad_alloc();
+            size_t pad = padding(align);
+            if (m_current >= m_blocks.size() ||
+                m_offset + pad + size > m_blocks[m_current].size)
+            {
+                next_block(size + align);
+                pad = padding(align);
+            }
+            void *ptr = m_blocks[m_current].data + m_offset + pad;
+            m_offset += pad + size;
+            m_used += pad + size;
+            if (m_high_water < m_used)
+                m_high_water = m_used;
+            ++m_allocations;
+            return ptr;
+        }
+        template <typename T>
+        T *allocate_array(size_t num) {
+            return static_cast<T *>(allocate(TS_array_bytes(num, sizeof(T)),
+                                             TriAlignOf<T>::value));
+        }
+
+        TRISTATE *alloc_tri(size_t num) {
+            return allocate_array<TRISTATE>(num);
+        }
+        TRISTATE *alloc_tri(size_t num, TRISTATE value) {
+            TRISTATE *tris = alloc_tri(num);
+            TS_reset_tri_totality_tri(value, num, tris);
+            return tris;
+        }
+        TRISTATE8 *alloc_tri8(size_t num) {
+            return allocate_array<TRISTATE8>(num);
+        }
+        bool *alloc_bool(size_t num) {
+            return allocate_array<bool>(num);
+        }
+        /* a zero-filled bitset of num bits */
+        TS_WORD *alloc_bits(size_t num) {
+            TS_WORD *bits = allocate_array<TS_WORD>(TS_WORDS(num));
+            for (size_t i = 0; i < TS_WORDS(num); ++i)
+                bits[i] = 0;
+            return bits;
+        }
+
+        /* conversions into arena memory */
+        TRISTATE *copy_tri(size_t num, const TRISTATE *tris) {
+            TRISTATE *ret = alloc_tri(num);
+            std::copy(tris, tris + num, ret);
+            return ret;
+        }
+        TRISTATE *bool_to_tri(size_t num, const bool *bools) {
+            TRISTATE *tris = alloc_tri(num);
+            TS_bool_to_tri(num, bools, tris);
+            return tris;
+        }
+        TRISTATE *tri8_to_tri(size_t num, const TRISTATE8 *tri8s) {
+            TRISTATE *tris = alloc_tri(num);
+            TS_tri8_to_tri(num, tri8s, tris);
+            return tris;
+        }
+        bool *tri_to_bool_def(size_t num, const TRISTATE *tris,
+                              bool default_value)
+        {
+            bool *bools = alloc_bool(num);
+            TS_tri_to_bool_def(num, tris, bools, default_value);
+            return bools;
+        }
+
+        marker mark() const {
+            marker ret;
+            ret.block = m_current;
+            ret.offset = m_offset;
+            ret.used = m_used;
+            return ret;
+        }
+        void rewind(const marker& mark) {
+            assert(mark.used <= m_used);
+            m_current = mark.block;
+            m_offset = mark.offset;
+            m_used = mark.used;
+        }
+        void reset() {
+            m_current = 0;
+            m_offset = 0;
+            m_used = 0;
+        }
+        /* frees the blocks */
+        void release() {
+            for (size_t i = 0; i < m_blocks.size(); ++i)
+                ::operator delete(m_blocks[i].data);
+            m_blocks.clear();
+            reset();
+        }
+
+        /* metrics */
+        size_t bytes_used() const       { return m_used; }
+        size_t high_water() const       { return m_high_water; }
+        size_t allocations() const      { return m_allocations; }
+        size_t block_count() const      { return m_blocks.size(); }
+        size_t bytes_reserved() const {
+            size_t total = 0;
+            for (size_t i = 0; i < m_blocks.size(); ++i)
+                total += m_blocks[i].size;
+            return total;
+        }
+        void reset_metrics() {
+            m_high_water = m_used;
+            m_allocations = 0;
+        }
+
+    protected:
+        struct block
+        {
+            char *data;
+            size_t size;
+        };
+        std::vector<block>  m_blocks;
+        size_t              m_block_size;
+        size_t              m_current;
+        size_t              m_offset;
+        size_t              m_used;
+        size_t              m_high_water;
+        size_t              m_allocations;
+
+        size_t padding(size_t align) const {
+            if (m_current >= m_blocks.size())
+                return 0;
+            const size_t addr = (size_t)(m_blocks[m_current].data + m_offset);
+            return (align - addr % align) % align;
+        }
+        /* moves to the next block that can hold size bytes */
+        void next_block(size_t size) {
+            if (m_current < m_blocks.size())
+            {
+                m_used += m_blocks[m_current].size - m_offset;
+                ++m_current;
+            }
+            m_offset = 0;
+            if (m_current < m_blocks.size() &&
+                m_blocks[m_current].size >= size)
+            {
+                return;
+            }
+            block new_block;
+            new_block.size = (size < m_block_size ? m_block_size : size);
+            new_block.data =
+                static_cast<char *>(::operator new(new_block.size));
+            m_blocks.insert(m_blocks.begin() + m_current, new_block);
+        }
+
+    private:
+        TriArena(const TriArena&);
+        TriArena& operator=(const TriArena&);
+    }; // class TriArena
+
+    /* an STL allocator on a TriArena (deallocate does nothing) */
+    template <typename T>
+    class TriArenaAllocator
+    {
+    public:
+        typedef T                   value_type;
+        typedef T *                 pointer;
+        typedef const T *           const_pointer;
+        typedef T&                  reference;
+        typedef const T&            const_reference;
+        typedef size_t              size_type;
+        typedef std::ptrdiff_t      difference_type;
+
+        template <typename T_OTHER>
+        struct rebind
+        {
+            typedef TriArenaAllocator<T_OTHER> other;
+        };
+
+        explicit TriArenaAllocator(TriArena& arena)
+            : m_arena(&arena) { }
+        template <typename T_OTHER>
+        TriArenaAllocator(const TriArenaAllocator<T_OTHER>& other)
+            : m_arena(other.arena()) { }
+
+        TriArena *arena() const {
+            return m_arena;
+        }
+
+        pointer allocate(size_type num, const void * = NULL) {
+            return m_arena->allocate_array<T>(num);
+        }
+        void deallocate(pointer, size_type) {
+        }
+
+        pointer address(reference value) const {
+            return &value;
+        }
+        const_pointer address(const_reference value) const {
+            return &value;
+        }
+        size_type max_size() const {
+            return size_type(-1) / sizeof(T);
+        }
+        void construct(pointer ptr, const T& value) {
+            new(static_cast<void *>(ptr)) T(value);
+        }
+        void destroy(pointer ptr) {
+            ptr->~T();
+        }
+
+        template <typename T_OTHER>
+        bool operator==(const TriArenaAllocator<T_OTHER>& other) const {
+            return m_arena == other.arena();
+        }
+        template <typename T_OTHER>
+        bool operator!=(const TriArenaAllocator<T_OTHER>& other) const {
+            return m_arena != other.arena();
+        }
+
+    protected:
+        TriArena *m_arena;
+    }; // class TriArenaAllocator
+
+    /* TriBufferPool keeps released buffers in power-of-two size classes
+     * and hands them out again, so that buffers which outlive a TriArena
+     * scope still avoid the global heap once the pool is warm. */
+    class TriBufferPool
+    {
+    public:
+        TriBufferPool()
+            : m_outstanding(0), m_high_water(0), m_cached(0),
+              m_hits(0), m_misses(0) { }
+        ~TriBufferPool() {
+            trim();
+        }
+
+        /* throws std::bad_alloc if size is over the largest class */
+        void *acquire(size_t size) {
+            if (size > class_size(num_classes - 1))
+                throw std::bad_alloc();
+            size_t index = 0;
+            while (class_size(index) < size)
+                ++index;
+            if (index >= m_free.size())
+                m_free.resize(index + 1);
+
+            char *ptr;
+            if (m_free[index].empty())
+            {
+                ptr = static_cast<char *>(
+                    ::operator new(header_size + class_size(index)));
+                *reinterpret_cast<size_t *>(ptr) = index;
+                ++m_misses;
+            }
+            else
+            {
+                ptr = m_free[index].back();
+                m_free[index].pop_back();
+                m_cached -= class_size(index);
+                ++m_hits;
+            }
+            m_outstanding += class_size(index);
+            if (m_high_water < m_outstanding)
+                m_high_water = m_outstanding;
+            return ptr + header_size;
+        }
+        void release(void *buffer) {
+            if (buffer == NULL)
+                return;
+            char *ptr = static_cast<char *>(buffer) - header_size;
+            const size_t index = *reinterpret_cast<size_t *>(ptr);
+            assert(index < m_free.size());
+            m_free[index].push_back(ptr);
+            m_outstanding -= class_size(index);
+            m_cached += class_size(index);
+        }
+
+        TRISTATE *acquire_tri(size_t num) {
+            return static_cast<TRISTATE *>(
+                acquire(TS_array_bytes(num, sizeof(TRISTATE))));
+        }
+        TRISTATE8 *acquire_tri8(size_t num) {
+            return static_cast<TRISTATE8 *>(
+                acquire(TS_array_bytes(num, sizeof(TRISTATE8))));
+        }
+        bool *acquire_bool(size_t num) {
+            return static_cast<bool *>(
+                acquire(TS_array_bytes(num, sizeof(bool))));
+        }
+        TRISTATE *bool_to_tri(size_t num, const bool *bools) {
+            TRISTATE *tris = acquire_tri(num);
+            TS_bool_to_tri(num, bools, tris);
+            return tris;
+        }
+
+        /* frees the cached buffers */
+        void trim() {
+            for (size_t i = 0; i < m_free.size(); ++i)
+            {
+                for (size_t k = 0; k < m_free[i].size(); ++k)
+                    ::operator delete(m_free[i][k]);
+                m_free[i].clear();
+            }
+            m_cached = 0;
+        }
+
+        /* metrics */
+        size_t bytes_outstanding() const    { return m_outstanding; }
+        size_t high_water() const           { return m_high_water; }
+        size_t bytes_cached() const         { return m_cached; }
+        size_t hits() const                 { return m_hits; }
+        size_t misses() const               { return m_misses; }
+        void reset_metrics() {
+            m_high_water = m_outstanding;
+            m_hits = m_misses = 0;
+        }
+
+    protected:
+        enum { header_size = 16, min_class_size = 64 };
+        /* the largest class, min_class_size << (num_classes - 1), is
+         * the highest power of two a size_t holds */
+        enum { num_classes = sizeof(size_t) * 8 - 6 };
+        std::vector<std::vector<char *> >   m_free;
+        size_t  m_outstanding;
+        size_t  m_high_water;
+        size_t  m_cached;
+        size_t  m_hits;
+        size_t  m_misses;
+
+        static size_t class_size(size_t index) {
+            assert(index < num_classes);
+            return (size_t)min_class_size << index;
+        }
+
+    private:
+        TriBufferPool(const TriBufferPool&);
+        TriBufferPool& operator=(const TriBufferPool&);
+    }; // class TriBufferPool
+#endif  /* def __cplusplus */
+
+/****************************************************************************/
+/* TriExec class --- parallel execution (TRISTATE_PARALLEL) */
+
+#if defined(__cplusplus) && defined(TRISTATE_PARALLEL)
+    #include <thread>       // for std::thread
+    #include <functional>   // for std::function
+    #include <mutex>        // for std::mutex
+    #include <condition_variable>   // for std::condition_variable
+    #include <atomic>       // for std::atomic
+    #include <deque>        // for std::deque
+    #include <exception>    // for std::exception_ptr
+
+    /* TriExecBackend runs task(0) to task(count - 1), possibly in
+     * parallel, and returns when all of them have returned.  If tasks
+     * throw, the first exception is rethrown then. */
+    class TriExecBackend
+    {
+    public:
+        virtual ~TriExecBackend() { }
+        virtual unsigned threads() const = 0;
+        virtual void run(size_t count,
+                         const std::function<void(size_t)>& task) = 0;
+    }; // class TriExecBackend
+
+    /* TriThreadPool keeps its threads between runs.  Every thread has a
+     * queue of tasks; it takes from the front of its own and steals from
+     * the back of the others when that is empty.  The thread calling run
+     * counts as one of threads() and works until its tasks are taken, so
+     * a task may run a pool itself.
+     *
+     * The threads may be split into groups (see TriNumaPool): the task i
+     * of count then goes to group i * groups() / count, and a thread
+     * steals from its own group before the others. */
+    class TriThreadPool : public TriExecBackend
+    {
+    public:
+        explicit TriThreadPool(unsigned threads = 0)
+            : m_threads(threads ? threads
+                                : std::thread::hardware_concurrency()),
+              m_stop(false), m_queued(0)
+        {
+            if (m_threads == 0)
+                m_threads = 1;
+            start(std::vector<unsigned>(1, m_threads));
+        }
+        ~TriThreadPool()
+        {
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_stop = true;
+            }
+            m_wake.notify_all();
+            for (size_t i = 0; i < m_workers.size(); ++i)
+                m_workers[i].join();
+        }
+
+        /* the pool of TriExec objects made without a backend */
+        static TriThreadPool& shared() {
+            static TriThreadPool pool;
+            return pool;
+        }
+
+        unsigned threads() const {
+            return m_threads;
+        }
+        unsigned groups() const {
+            return (unsigned)m_first.size() - 1;
+        }
+
+        void run(size_t count, const std::function<void(size_t)>& task) {
+            if (count == 0)
+                return;
+            job current(task, count);
+            if (count > 1)
+            {
+                m_queued += count - 1;
+                for (size_t i = 1; i < count; ++i)
+                {
+                    const size_t group = i * groups() / count;
+                    const unsigned first = m_first[group];
+                    const unsigned size = m_first[group + 1] - first;
+                    queue& q = *m_queues[first + i % size];
+                    std::lock_guard<std::mutex> lock(q.mutex);
+                    q.items.push_back(item(&current, i));
+                }
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_wake.notify_all();
+            }
+            execute(item(&current, 0));
+            item next;
+            while (current.pending.load() != 0 && take(0, next))
+                execute(next);
+            {
+                std::unique_lock<std::mutex> lock(m_mutex);
+                while (current.pending.load() != 0)
+                    m_done.wait(lock);
+            }
+            if (current.error)
+                std::rethrow_exception(current.error);
+        }
+
+    protected:
+        struct job
+        {
+            const std::function<void(size_t)> *task;
+            std::atomic<size_t> pending;
+            std::mutex          error_mutex;
+            std::exception_ptr  error;      // the first one thrown
+            job(const std::function<void(size_t)>& task_, size_t count)
+                : task(&task_), pending(count) { }
+        };
+        struct item
+        {
+            job *   owner;
+            size_t  index;
+            item(job *owner_ = NULL, size_t index_ = 0)
+                : owner(owner_), index(index_) { }
+        };
+        struct queue
+        {
+            std::mutex          mutex;
+            std::deque<item>    items;
+        };
+
+        unsigned                            m_threads;
+        std::vector<unsigned>               m_first;    // of each group
+        std::vector<unsigned>               m_group;    // of each thread
+        std::function<void(unsigned)>       m_on_start;
+        std::vector<std::unique_ptr<queue> > m_queues;
+        std::vector<std::thread>            m_workers;
+        std::mutex                          m_mutex;
+        std::condition_variable             m_wake;
+        std::condition_variable             m_done;
+        bool                                m_stop;
+        std::atomic<size_t>                 m_queued;
+
+        /* sizes[g] threads in the group g; every worker of the group g
+         * calls on_start(g) first.  The calling thread is in group 0. */
+        TriThreadPool(const std::vector<unsigned>& sizes,
+                      const std::function<void(unsigned)>& on_start)
+            : m_threads(0), m_on_start(on_start), m_stop(false),
+              m_queued(0)
+        {
+            for (size_t g = 0; g < sizes.size(); ++g)
+                m_threads += sizes[g];
+            assert(m_threads > 0 && sizes[0] > 0);
+            start(sizes);
+        }
+
+        void start(const std::vector<unsigned>& sizes) {
+            m_first.push_back(0);
+            for (size_t g = 0; g < sizes.size(); ++g)
+            {
+                m_group.insert(m_group.end(), sizes[g], (unsigned)g);
+                m_first.push_back(m_first.back() + sizes[g]);
+            }
+            for (unsigned i = 0; i < m_threads; ++i)
+                m_queues.push_back(std::unique_ptr<queue>(new queue));
+            for (unsigned i = 1; i < m_threads; ++i)
+            {
+                m_workers.push_back(std::thread(&TriThreadPool::work, this,
+                                                i));
+            }
+        }
+
+        bool take(unsigned self, item& next) {
+            for (int pass = 0; pass < 2; ++pass)
+            {
+                for (unsigned k = 0; k < m_threads; ++k)
+                {
+                    const unsigned other = (self + k) % m_threads;
+                    if ((m_group[other] == m_group[self]) != (pass == 0))
+                        continue;
+                    queue& q = *m_queues[other];
+                    std::lock_guard<std::mutex> lock(q.mutex);
+                    if (q.items.empty())
+                        continue;
+                    if (other == self)
+                    {
+                        next = q.items.front();
+                        q.items.pop_front();
+                    }
+                    else
+                    {
+                        next = q.items.back();
+                        q.items.pop_back();
+                    }
+                    --m_queued;
+                    return true;
+                }
+            }
+            return false;
+        }
+        void execute(const item& next) {
+            job *owner = next.owner;
+            try
+            {
+                (*owner->task)(next.index);
+            }
+            catch (...)
+            {
+                std::lock_guard<std::mutex> lock(owner->error_mutex);
+                if (!owner->error)
+                    owner->error = std::current_exception();
+            }
+            if (owner->pending.fetch_sub(1) == 1)
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_done.notify_all();
+            }
+        }
+        void work(unsigned self) {
+            if (m_on_start)
+                m_on_start(m_group[self]);
+            for (;;)
+            {
+                item next;
+                if (take(self, next))
+                {
+                    execute(next);
+                    continue;
+                }
+                std::unique_lock<std::mutex> lock(m_mutex);
+                while (!m_stop && m_queued.load() == 0)
+                    m_wake.wait(lock);
+                if (m_stop && m_queued.load() == 0)
+                    return;
+            }
+        }
+
+    private:
+        TriThreadPool(const TriThreadPool&);
+        TriThreadPool& operator=(const TriThreadPool&);
+    }; // class TriThreadPool
+
+    /* TriExecutorAdapter runs the tasks on an executor of the caller:
+     * submit(std::function<void()>) is called for every task but the
+     * first, which runs on the calling thread.  The executor must not
+     * need the calling thread to get the tasks done. */
+    template <typename T_SUBMIT>
+    class TriExecutorAdapter : public TriExecBackend
+    {
+    public:
+        TriExecutorAdapter(T_SUBMIT submit, unsigned threads)
+            : m_submit(submit), m_threads(threads ? threads : 1) { }
+
+        unsigned threads() const {
+            return m_threads;
+        }
+
+        void run(size_t count, const std::function<void(size_t)>& task) {
+            if (count == 0)
+                return;
+            struct state
+            {
+                std::mutex              mutex;
+                std::condition_variable done;
+                size_t                  pending;
+                std::exception_ptr      error;
+
+                void run(const std::function<void(size_t)>& task,
+                         size_t index)
+                {
+                    std::exception_ptr thrown;
+                    try
+                    {
+                        task(index);
+                    }
+                    catch (...)
+                    {
+                        thrown = std::current_exception();
+                    }
+                    std::lock_guard<std::mutex> lock(mutex);
+                    if (thrown && !error)
+                        error = thrown;
+                    if (--pending == 0)
+                        done.notify_all();
+                }
+            } shared;
+            shared.pending = count;
+            size_t i = 1;
+            try
+            {
+                for (; i < count; ++i)
+                {
+                    m_submit(std::function<void()>([&shared, &task, i]() {
+                        shared.run(task, i);
+                    }));
+                }
+            }
+            catch (...)
+            {
+                /* the tasks not submitted are not waited for */
+                std::lock_guard<std::mutex> lock(shared.mutex);
+                shared.pending -= count - i;
+                shared.error = std::current_exception();
+            }
+            shared.run(task, 0);
+            std::unique_lock<std::mutex> lock(shared.mutex);
+            while (shared.pending != 0)
+                shared.done.wait(lock);
+            if (shared.error)
+                std::rethrow_exception(shared.error);
+        }
+
+    protected:
+        T_SUBMIT    m_submit;
+        unsigned    m_threads;
+    }; // class TriExecutorAdapter<T_SUBMIT>
+
+    template <typename T_SUBMIT>
+    inline TriExecutorAdapter<T_SUBMIT>
+    TS_make_executor_adapter(T_SUBMIT submit, unsigned threads)
+    {
+        return TriExecutorAdapter<T_SUBMIT>(submit, threads);
+    }
+
+    /* TriExec splits [0, num) into chunks of at least grain() elements,
+     * at most one per thread, and runs a function on each chunk on its
+     * backend (TriThreadPool::shared() unless given).  The split depends
+     * only on num, so that several passes over the same array see the
+     * same chunks.  Arrays shorter than twice the grain are one chunk,
+     * which runs on the calling thread without touching the backend. */
+    class TriExec
+    {
+    public:
+        explicit TriExec(unsigned threads = 0, size_t grain = 32 * 1024)
+            : m_threads(threads ? threads
+                                : std::thread::hardware_concurrency()),
+              m_grain(grain ? grain : 1), m_backend(NULL)
+        {
+            if (m_threads == 0)
+                m_threads = 1;
+        }
+        explicit TriExec(TriExecBackend& backend, size_t grain = 32 * 1024)
+            : m_threads(backend.threads()), m_grain(grain ? grain : 1),
+              m_backend(&backend) { }
+
+        unsigned threads() const {
+            return m_threads;
+        }
+        size_t grain() const {
+            return m_grain;
+        }
+        TriExecBackend& backend() const {
+            return (m_backend ? *m_backend : TriThreadPool::shared());
+        }
+
+        size_t chunks(size_t num) const {
+            size_t count = num / m_grain;
+            if (count > m_threads)
+                count = m_threads;
+            return (count ? count : 1);
+        }
+        size_t chunk_begin(size_t num, size_t index) const {
+            return num / chunks(num) * index +
+                   (index < num % chunks(num) ? index : num % chunks(num));
+        }
+
+        /* calls fn(first, last) for ranges of segments, in parallel.
+         * The ranges are balanced by elements, not by segments. */
+        template <typename T_FN>
+        void for_segments(size_t num_segments, const size_t *offsets,
+                          T_FN fn) const
+        {
+            const size_t base = offsets[0];
+            const size_t num = offsets[num_segments] - base;
+            const size_t *end = offsets + num_segments;
+            for_chunks(num, [=](size_t, size_t begin, size_t last) {
+                const size_t first_segment = (begin == 0 ? 0 :
+                    std::lower_bound(offsets, end, base + begin) - offsets);
+                const size_t last_segment = (last == num ? num_segments :
+                    std::lower_bound(offsets, end, base + last) - offsets);
+                if (first_segment < last_segment)
+                    fn(first_segment, last_segment);
+            });
+        }
+
+        /* calls fn(index, begin, end) for each chunk, in parallel */
+        template <typename T_FN>
+        void for_chunks(size_t num, T_FN fn) const {
+            const size_t count = chunks(num);
+            if (count == 1)
+            {
+                fn(size_t(0), size_t(0), num);
+                return;
+            }
+            backend().run(count, [&](size_t index) {
+                fn(index, chunk_begin(num, index),
+                   chunk_begin(num, index + 1));
+            });
+        }
+
+        /* the same for packed arrays of num values: the chunks are split
+         * by words (grain() words at least), so that no word is shared */
+        template <typename T_FN>
+        void for_word_chunks(size_t num, T_FN fn) const {
+            const size_t num_words = TS_WORDS(num);
+            for_chunks(num_words,
+                [&](size_t index, size_t begin, size_t end) {
+                    fn(index, begin * TS_WORD_BITS,
+                       (end == num_words ? num : end * TS_WORD_BITS));
+                });
+        }
+
+    protected:
+        unsigned            m_threads;
+        size_t              m_grain;
+        TriExecBackend *    m_backend;
+    }; // class TriExec
+
+    /* batch functions on an executor: the element-wise ones run on each
+     * chunk, the reductions reduce each chunk and then the chunks */
+    inline void
+    TS_bool_to_tri(const TriExec& exec, size_t num, const bool *bools,
+                   TRISTATE *tris)
+    {
+        exec.for_chunks(num, [=](size_t, size_t begin, size_t end) {
+            TS_bool_to_tri(end - begin, bools + begin, tris + begin);
+        });
+    }
+    inline void
+    TS_tri_to_bool(const TriExec& exec, size_t num, const TRISTATE *tris,
+                   bool *bools)
+    {
+        exec.for_chunks(num, [=](size_t, size_t begin, size_t end) {
+            TS_tri_to_bool(end - begin, tris + begin, bools + begin);
+        });
+    }
+    inline void
+    TS_tri_to_bool_def(const TriExec& exec, size_t num, const TRISTATE *tris,
+                       bool *bools, bool default_value)
+    {
+        exec.for_chunks(num, [=](size_t, size_t begin, size_t end) {
+            TS_tri_to_bool_def(end - begin, tris + begin, bools + begin,
+                               default_value);
+        });
+    }
+
+    inline void
+    TS_set_totality_tri(const TriExec& exec, bool value, size_t num,
+                        TRISTATE *values)
+    {
+        exec.for_chunks(num, [=](size_t, size_t begin, size_t end) {
+            TS_set_totality_tri(value, end - begin, values + begin);
+        });
+    }
+    inline void
+    TS_set_tri_totality_tri(const TriExec& exec, TRISTATE value, size_t num,
+                            TRISTATE *values)
+    {
+        exec.for_chunks(num, [=](size_t, size_t begin, size_t end) {
+            TS_set_tri_totality_tri(value, end - begin, values + begin);
+        });
+    }
+    inline void
+    TS_reset_tri_totality_tri(const TriExec& exec, TRISTATE value,
+                              size_t num, TRISTATE *values)
+    {
+        exec.for_chunks(num, [=](size_t, size_t begin, size_t end) {
+            TS_reset_tri_totality_tri(value, end - begin, values + begin);
+        });
+    }
+
+    inline void
+    TS_each_and(const TriExec& exec, bool value, size_t num, bool *values)
+    {
+        exec.for_chunks(num, [=](size_t, size_t begin, size_t end) {
+            TS_each_and(value, end - begin, values + begin);
+        });
+    }
+    inline void
+    TS_each_or(const TriExec& exec, bool value, size_t num, bool *values)
+    {
+        exec.for_chunks(num, [=](size_t, size_t begin, size_t end) {
+            TS_each_or(value, end - begin, values + begin);
+        });
+    }
+    inline void
+    TS_each_not(const TriExec& exec, size_t num, bool *values)
+    {
+        exec.for_chunks(num, [=](size_t, size_t begin, size_t end) {
+            TS_each_not(end - begin, values + begin);
+        });
+    }
+
+    inline void
+    TS_each_and_tri(const TriExec& exec, bool value, size_t num,
+                    TRISTATE *values)
+    {
+        exec.for_chunks(num, [=](size_t, size_t begin, size_t end) {
+            TS_each_and_tri(value, end - begin, values + begin);
+        });
+    }
+    inline void
+    TS_each_or_tri(const TriExec& exec, bool value, size_t num,
+                   TRISTATE *values)
+    {
+        exec.for_chunks(num, [=](size_t, size_t begin, size_t end) {
+            TS_each_or_tri(value, end - begin, values + begin);
+        });
+    }
+    inline void
+    TS_each_not_tri(const TriExec& exec, size_t num, TRISTATE *values)
+    {
+        exec.for_chunks(num, [=](size_t, size_t begin, size_t end) {
+            TS_each_not_tri(end - begin, values + begin);
+        });
+    }
+    inline void
+    TS_tri_each_and_tri(const TriExec& exec, TRISTATE value, size_t num,
+                        TRISTATE *values)
+    {
+        exec.for_chunks(num, [=](size_t, size_t begin, size_t end) {
+            TS_tri_each_and_tri(value, end - begin, values + begin);
+        });
+    }
+    inline void
+    TS_tri_each_or_tri(const TriExec& exec, TRISTATE value, size_t num,
+                       TRISTATE *values)
+    {
+        exec.for_chunks(num, [=](size_t, size_t begin, size_t end) {
+            TS_tri_each_or_tri(value, end - begin, values + begin);
+        });
+    }
+
+    inline void
+    TS_tri_to_tri8(const TriExec& exec, size_t num, const TRISTATE *tris,
+                   TRISTATE8 *tri8s)
+    {
+        exec.for_chunks(num, [=](size_t, size_t begin, size_t end) {
+            TS_tri_to_tri8(end - begin, tris + begin, tri8s + begin);
+        });
+    }
+    inline void
+    TS_tri8_to_tri(const TriExec& exec, size_t num, const TRISTATE8 *tri8s,
+                   TRISTATE *tris)
+    {
+        exec.for_chunks(num, [=](size_t, size_t begin, size_t end) {
+            TS_tri8_to_tri(end - begin, tri8s + begin, tris + begin);
+        });
+    }
+    inline void
+    TS_each_not_tri8(const TriExec& exec, size_t num, TRISTATE8 *values)
+    {
+        exec.for_chunks(num, [=](size_t, size_t begin, size_t end) {
+            TS_each_not_tri8(end - begin, values + begin);
+        });
+    }
+    inline void
+    TS_tri_each_and_tri8(const TriExec& exec, TRISTATE value, size_t num,
+                         TRISTATE8 *values)
+    {
+        exec.for_chunks(num, [=](size_t, size_t begin, size_t end) {
+            TS_tri_each_and_tri8(value, end - begin, values + begin);
+        });
+    }
+    inline void
+    TS_tri_each_or_tri8(const TriExec& exec, TRISTATE value, size_t num,
+                        TRISTATE8 *values)
+    {
+        exec.for_chunks(num, [=](size_t, size_t begin, size_t end) {
+            TS_tri_each_or_tri8(value, end - begin, values + begin);
+        });
+    }
+
+    inline void
+    TS_tri_to_packed(const TriExec& exec, size_t num, const TRISTATE *tris,
+                     TS_WORD *trues, TS_WORD *falses)
+    {
+        exec.for_word_chunks(num, [=](size_t, size_t begin, size_t end) {
+            const size_t k = begin / TS_WORD_BITS;
+            TS_tri_to_packed(end - begin, tris + begin, trues + k,
+                             falses + k);
+        });
+    }
+    inline void
+    TS_packed_to_tri(const TriExec& exec, size_t num, const TS_WORD *trues,
+                     const TS_WORD *falses, TRISTATE *tris)
+    {
+        exec.for_word_chunks(num, [=](size_t, size_t begin, size_t end) {
+            const size_t k = begin / TS_WORD_BITS;
+            TS_packed_to_tri(end - begin, trues + k, falses + k,
+                             tris + begin);
+        });
+    }
+    inline void
+    TS_packed_each_not(const TriExec& exec, size_t num,
+                       TS_WORD *trues, TS_WORD *falses)
+    {
+        exec.for_word_chunks(num, [=](size_t, size_t begin, size_t end) {
+            const size_t k = begin / TS_WORD_BITS;
+            TS_packed_each_not(end - begin, trues + k, falses + k);
+        });
+    }
+    inline void
+    TS_packed_tri_each_and(const TriExec& exec, TRISTATE value, size_t num,
+                           TS_WORD *trues, TS_WORD *falses)
+    {
+        exec.for_word_chunks(num, [=](size_t, size_t begin, size_t end) {
+            const size_t k = begin / TS_WORD_BITS;
+            TS_packed_tri_each_and(value, end - begin, trues + k, falses + k);
+        });
+    }
+    inline void
+    TS_packed_tri_each_or(const TriExec& exec, TRISTATE value, size_t num,
+                          TS_WORD *trues, TS_WORD *falses)
+    {
+        exec.for_word_chunks(num, [=](size_t, size_t begin, size_t end) {
+            const size_t k = begin / TS_WORD_BITS;
+            TS_packed_tri_each_or(value, end - begin, trues + k, falses + k);
+        });
+    }
+    inline void
+    TS_packed_and(const TriExec& exec, size_t num,
+                  TS_WORD *trues, TS_WORD *falses,
+                  const TS_WORD *trues2, const TS_WORD *falses2)
+    {
+        exec.for_word_chunks(num, [=](size_t, size_t begin, size_t end) {
+            const size_t k = begin / TS_WORD_BITS;
+            TS_packed_and(end - begin, trues + k, falses + k, trues2 + k,
+                          falses2 + k);
+        });
+    }
+    inline void
+    TS_packed_or(const TriExec& exec, size_t num,
+                 TS_WORD *trues, TS_WORD *falses,
+                 const TS_WORD *trues2, const TS_WORD *falses2)
+    {
+        exec.for_word_chunks(num, [=](size_t, size_t begin, size_t end) {
+            const size_t k = begin / TS_WORD_BITS;
+            TS_packed_or(end - begin, trues + k, falses + k, trues2 + k,
+                         falses2 + k);
+        });
+    }
+
+    /* the Kleene AND/OR of fn(begin, end) over the chunks (of words if
+     * packed) */
+    template <typename T_FN>
+    inline TRISTATE
+    TS_connect_chunks(const TriExec& exec, bool is_or, bool packed,
+                      size_t num, T_FN fn)
+    {
+        std::vector<TRISTATE> results(exec.chunks(packed ? TS_WORDS(num)
+                                                         : num));
+        const auto reduce = [&](size_t index, size_t begin, size_t end) {
+            results[index] = fn(begin, end);
+        };
+        if (packed)
+            exec.for_word_chunks(num, reduce);
+        else
+            exec.for_chunks(num, reduce);
+        return (is_or ? TS_connect_or_tri(results.size(), &results[0])
+                      : TS_connect_and_tri(results.size(), &results[0]));
+    }
+
+    inline TRISTATE
+    TS_connect_and_tri(const TriExec& exec, size_t num,
+                       const TRISTATE *values)
+    {
+        return TS_connect_chunks(exec, false, false, num,
+            [=](size_t begin, size_t end) {
+                return TS_connect_and_tri(end - begin, values + begin);
+            });
+    }
+    inline TRISTATE
+    TS_connect_or_tri(const TriExec& exec, size_t num,
+                      const TRISTATE *values)
+    {
+        return TS_connect_chunks(exec, true, false, num,
+            [=](size_t begin, size_t end) {
+                return TS_connect_or_tri(end - begin, values + begin);
+            });
+    }
+    inline TRISTATE
+    TS_connect_and_tri8(const TriExec& exec, size_t num,
+                        const TRISTATE8 *values)
+    {
+        return TS_connect_chunks(exec, false, false, num,
+            [=](size_t begin, size_t end) {
+                return TS_connect_and_tri8(end - begin, values + begin);
+            });
+    }
+    inline TRISTATE
+    TS_connect_or_tri8(const TriExec& exec, size_t num,
+                       const TRISTATE8 *values)
+    {
+        return TS_connect_chunks(exec, true, false, num,
+            [=](size_t begin, size_t end) {
+                return TS_connect_or_tri8(end - begin, values + begin);
+            });
+    }
+    inline TRISTATE
+    TS_packed_connect_and(const TriExec& exec, size_t num,
+                          const TS_WORD *trues, const TS_WORD *falses)
+    {
+        return TS_connect_chunks(exec, false, true, num,
+            [=](size_t begin, size_t end) {
+                const size_t k = begin / TS_WORD_BITS;
+                return TS_packed_connect_and(end - begin, trues + k,
+                                             falses + k);
+            });
+    }
+    inline TRISTATE
+    TS_packed_connect_or(const TriExec& exec, size_t num,
+                         const TS_WORD *trues, const TS_WORD *falses)
+    {
+        return TS_connect_chunks(exec, true, true, num,
+            [=](size_t begin, size_t end) {
+                const size_t k = begin / TS_WORD_BITS;
+                return TS_packed_connect_or(end - begin, trues + k,
+                                            falses + k);
+            });
+    }
+
+    /* counts, from which the totality follows */
+    inline TriTally
+    TS_tally_tri(const TriExec& exec, size_t num, const TRISTATE *values)
+    {
+        std::vector<TriTally> tallies(exec.chunks(num));
+        exec.for_chunks(num, [&](size_t index, size_t begin, size_t end) {
+            tallies[index].add(end - begin, values + begin);
+        });
+        TriTally tally;
+        for (size_t i = 0; i < tallies.size(); ++i)
+            tally.add(tallies[i]);
+        return tally;
+    }
+    inline TriTally
+    TS_packed_tally(const TriExec& exec, size_t num,
+                    const TS_WORD *trues, const TS_WORD *falses)
+    {
+        std::vector<TriTally> tallies(exec.chunks(TS_WORDS(num)));
+        exec.for_word_chunks(num,
+            [&](size_t index, size_t begin, size_t end) {
+                const size_t k = begin / TS_WORD_BITS;
+                TriTally& part = tallies[index];
+                part.trues = TS_bits_count(end - begin, trues + k);
+                part.falses = TS_bits_count(end - begin, falses + k);
+                part.unknowns = end - begin - part.trues - part.falses;
+            });
+        TriTally tally;
+        for (size_t i = 0; i < tallies.size(); ++i)
+            tally.add(tallies[i]);
+        return tally;
+    }
+
+    inline void
+    TS_count_tri(const TriExec& exec, size_t *trues, size_t *falses,
+                 size_t *unknowns, size_t num, const TRISTATE *values)
+    {
+        assert(trues != NULL && falses != NULL && unknowns != NULL);
+        const TriTally tally = TS_tally_tri(exec, num, values);
+        *trues = tally.trues;
+        *falses = tally.falses;
+        *unknowns = tally.unknowns;
+    }
+    inline void
+    TS_get_tri_totality_tri(const TriExec& exec, TRISTATE *value, size_t num,
+                            const TRISTATE *values)
+    {
+        assert(value != NULL);
+        *value = TS_tally_tri(exec, num, values).get_tri_totality();
+    }
+    inline size_t
+    TS_packed_count(const TriExec& exec, TRISTATE value, size_t num,
+                    const TS_WORD *trues, const TS_WORD *falses)
+    {
+#ifdef TRISTATE_STRICT
+        assert(TS_is_valid_tri(value));
+#endif
+        const TriTally tally = TS_packed_tally(exec, num, trues, falses);
+        return (value > 0 ? tally.trues
+                          : (value < 0 ? tally.falses : tally.unknowns));
+    }
+    inline void
+    TS_packed_get_tri_totality(const TriExec& exec, TRISTATE *value,
+                               size_t num, const TS_WORD *trues,
+                               const TS_WORD *falses)
+    {
+        assert(value != NULL);
+        *value = TS_packed_tally(exec, num, trues, falses).get_tri_totality();
+    }
+
+    /* block-wise scan: reduce each chunk, carry the reductions across
+     * the chunks, then scan each chunk and combine it with its carry */
+    inline void
+    TS_scan_tri(const TriExec& exec, bool is_or, bool inclusive,
+                size_t num, const TRISTATE *values, TRISTATE *results)
+    {
+        assert(values != NULL || num == 0);
+        assert(results != NULL || num == 0);
+        std::vector<TRISTATE> carries(exec.chunks(num));
+        exec.for_chunks(num, [&](size_t index, size_t begin, size_t end) {
+            carries[index] = (is_or ? TS_connect_or_tri(end - begin,
+                                                        values + begin)
+                                    : TS_connect_and_tri(end - begin,
+                                                         values + begin));
+        });
+        TRISTATE carry = (is_or ? TS_FALSE : TS_TRUE);
+        for (size_t i = 0; i < carries.size(); ++i)
+        {
+            const TRISTATE reduced = carries[i];
+            carries[i] = carry;
+            carry = (is_or ? TS_tri_or(carry, reduced)
+                           : TS_tri_and(carry, reduced));
+        }
+        exec.for_chunks(num, [&](size_t index, size_t begin, size_t end) {
+            const size_t count = end - begin;
+            if (is_or)
+            {
+                if (inclusive)
+                    TS_inclusive_scan_or_tri(count, values + begin,
+                                             results + begin);
+                else
+                    TS_exclusive_scan_or_tri(count, values + begin,
+                                             results + begin);
+                TS_tri_each_or_tri_unchecked(carries[index], count,
+                                             results + begin);
+            }
+            else
+            {
+                if (inclusive)
+                    TS_inclusive_scan_and_tri(count, values + begin,
+                                              results + begin);
+                else
+                    TS_exclusive_scan_and_tri(count, values + begin,
+                                              results + begin);
+                TS_tri_each_and_tri_unchecked(carries[index], count,
+                                              results + begin);
+            }
+        });
+    }
+
+    inline void
+    TS_inclusive_scan_and_tri(const TriExec& exec, size_t num,
+                              const TRISTATE *values, TRISTATE *results)
+    {
+        TS_scan_tri(exec, false, true, num, values, results);
+    }
+
+    inline void
+    TS_inclusive_scan_or_tri(const TriExec& exec, size_t num,
+                             const TRISTATE *values, TRISTATE *results)
+    {
+        TS_scan_tri(exec, true, true, num, values, results);
+    }
+
+    inline void
+    TS_exclusive_scan_and_tri(const TriExec& exec, size_t num,
+                              const TRISTATE *values, TRISTATE *results)
+    {
+        TS_scan_tri(exec, false, false, num, values, results);
+    }
+
+    inline void
+    TS_exclusive_scan_or_tri(const TriExec& exec, size_t num,
+                             const TRISTATE *values, TRISTATE *results)
+    {
+        TS_scan_tri(exec, true, false, num, values, results);
+    }
+
+    inline void
+    TS_segmented_connect_and_tri(const TriExec& exec, size_t num_segments,
+                                 const size_t *offsets,
+                                 const TRISTATE *values, TRISTATE *results)
+    {
+        exec.for_segments(num_segments, offsets,
+            [=](size_t first, size_t last) {
+                TS_segmented_connect_and_tri(last - first, offsets + first,
+                                             values, results + first);
+            });
+    }
+
+    inline void
+    TS_segmented_connect_or_tri(const TriExec& exec, size_t num_segments,
+                                const size_t *offsets,
+                                const TRISTATE *values, TRISTATE *results)
+    {
+        exec.for_segments(num_segments, offsets,
+            [=](size_t first, size_t last) {
+                TS_segmented_connect_or_tri(last - first, offsets + first,
+                                            values, results + first);
+            });
+    }
+
+    inline void
+    TS_segmented_get_tri_totality_tri(const TriExec& exec,
+                                      size_t num_segments,
+                                      const size_t *offsets,
+                                      const TRISTATE *values,
+                                      TRISTATE *results)
+    {
+        exec.for_segments(num_segments, offsets,
+            [=](size_t first, size_t last) {
+                TS_segmented_get_tri_totality_tri(last - first,
+                                                  offsets + first, values,
+                                                  results + first);
+            });
+    }
+
+    /* each chunk keeps its own top k, merged in chunk order so that ties
+     * go to the lower index as in the serial search */
+    inline size_t
+    TS_packed_top_k(const TriExec& exec, size_t k, size_t num,
+                    const TS_WORD *trues, const TS_WORD *falses,
+                    size_t count, const TS_WORD *all_trues,
+                    const TS_WORD *all_falses,
+                    size_t *indices, double *similarities)
+    {
+        const size_t words = TS_WORDS(num);
+        const size_t chunks = exec.chunks(count);
+        if (k > count)
+            k = count;
+        if (chunks == 1 || k == 0)
+        {
+            return TS_packed_top_k(k, num, trues, falses, count, all_trues,
+                                   all_falses, indices, similarities);
+        }
+        /* no chunk finds more than its length */
+        const size_t per_chunk = std::min(k, count / chunks + 1);
+        std::vector<size_t> chunk_indices(chunks * per_chunk), found(chunks);
+        std::vector<double> chunk_similarities(chunks * per_chunk);
+        exec.for_chunks(count, [&](size_t index, size_t begin, size_t end) {
+            size_t *out = &chunk_indices[index * per_chunk];
+            found[index] =
+                TS_packed_top_k(per_chunk, num, trues, falses, end - begin,
+                                all_trues + begin * words,
+                                all_falses + begin * words, out,
+                                &chunk_similarities[index * per_chunk]);
+            for (size_t i = 0; i < found[index]; ++i)
+                out[i] += begin;
+        });
+
+        size_t total = 0;
+        for (size_t index = 0; index < chunks; ++index)
+        {
+            for (size_t i = 0; i < found[index]; ++i)
+            {
+                const double value =
+                    chunk_similarities[index * per_chunk + i];
+                if (total == k && !(value > similarities[k - 1]))
+                    break;
+                size_t j = (total < k ? total++ : k - 1);
+                for (; j > 0 && similarities[j - 1] < value; --j)
+                {
+                    indices[j] = indices[j - 1];
+                    similarities[j] = similarities[j - 1];
+                }
+                indices[j] = chunk_indices[index * per_chunk + i];
+                similarities[j] = value;
+            }
+        }
+        return total;
+    }
+#endif  /* def __cplusplus && def TRISTATE_PARALLEL */
+
+/****************************************************************************/
+/* NUMA placement (TRISTATE_NUMA; Linux, elsewhere one node) */
+
+#if defined(__cplusplus) && defined(TRISTATE_NUMA)
+    #ifdef __linux__
+        #include <sys/mman.h>       // for mmap, munmap
+        #include <sys/syscall.h>    // for SYS_mbind
+        #include <unistd.h>         // for syscall, sysconf
+        #include <sched.h>          // for sched_setaffinity
+    #endif
+    #include <cstdlib>              // for std::malloc, std::free
+
+    /* the topology is read from sysfs and the pages are placed by the
+     * mbind system call, so neither libnuma nor its headers are needed */
+    typedef enum TS_NUMA_POLICY
+    {
+        TS_NUMA_FIRST_TOUCH,    /* the node of the thread touching first */
+        TS_NUMA_BIND,           /* the given nodes */
+        TS_NUMA_INTERLEAVE      /* page by page over the given nodes */
+    } TS_NUMA_POLICY;
+
+    /* parses a sysfs list such as "0-3,8,10-11" */
+    inline bool
+    TS_numa_parse_list(const char *text, std::vector<int>& items)
+    {
+        items.clear();
+        while (*text && *text != '\n')
+        {
+            char *end;
+            const long first = std::strtol(text, &end, 10);
+            long last = first;
+            if (end == text || first < 0)
+                return false;
+            if (*end == '-')
+            {
+                text = end + 1;
+                last = std::strtol(text, &end, 10);
+                if (end == text || last < first)
+                    return false;
+            }
+            for (long i = first; i <= last; ++i)
+                items.push_back((int)i);
+            text = (*end == ',' ? end + 1 : end);
+        }
+        return !items.empty();
+    }
+
+    inline bool
+    TS_numa_read_list(const char *path, std::vector<int>& items)
+    {
+        items.clear();
+        FILE *fp = std::fopen(path, "r");
+        if (!fp)
+            return false;
+        char buf[1024];
+        const bool ok = (std::fgets(buf, sizeof(buf), fp) != NULL &&
+                         TS_numa_parse_list(buf, items));
+        std::fclose(fp);
+        return ok;
+    }
+
+    /* the online nodes, or { 0 } without NUMA */
+    inline std::vector<int> TS_numa_nodes()
+    {
+        std::vector<int> nodes;
+        if (!TS_numa_read_list("/sys/devices/system/node/online", nodes))
+            nodes.assign(1, 0);
+        return nodes;
+    }
+
+    /* the CPUs of a node, or all of them without NUMA */
+    inline std::vector<int> TS_numa_cpus(int node)
+    {
+        std::vector<int> cpus;
+        char path[64];
+        std::sprintf(path, "/sys/devices/system/node/node%d/cpulist", node);
+        if (!TS_numa_read_list(path, cpus))
+        {
+            const unsigned count = std::thread::hardware_concurrency();
+            for (unsigned i = 0; i < (count ? count : 1); ++i)
+                cpus.push_back((int)i);
+        }
+        return cpus;
+    }
+
+    inline size_t TS_numa_page_size()
+    {
+#ifdef __linux__
+        const long size = sysconf(_SC_PAGESIZE);
+        return (size > 0 ? (size_t)size : 4096);
+#else
+        return 4096;
+#endif
+    }
+
+    /* page-aligned memory, placed by first touch until TS_numa_place.
+     * Returns NULL on failure. */
+    inline void *TS_numa_alloc(size_t size)
+    {
+#ifdef __linux__
+        void *ptr = mmap(NULL, (size ? size : 1), PROT_READ | PROT_WRITE,
+                         MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        return (ptr == MAP_FAILED ? NULL : ptr);
+#else
+        return std::malloc(size ? size : 1);
+#endif
+    }
+
+    inline void TS_numa_free(void *ptr, size_t size)
+    {
+#ifdef __linux__
+        if (ptr)
+            munmap(ptr, (size ? size : 1));
+#else
+        (void)size;
+        std::free(ptr);
+#endif
+    }
+
+    /* places the pages of [ptr, ptr + size), ptr page-aligned, moving the
+     * pages already touched.  Returns false where the kernel refuses (no
+     * NUMA, a container without the permission) or off Linux; the memory
+     * stays usable either way. */
+    inline bool
+    TS_numa_place(void *ptr, size_t size, TS_NUMA_POLICY policy,
+                  const std::vector<int>& nodes)
+    {
+        assert(ptr != NULL || size == 0);
+        assert(policy == TS_NUMA_FIRST_TOUCH || !nodes.empty());
+        if (size == 0)
+            return true;
+#if defined(__linux__) && defined(SYS_mbind)
+        const int mpol_default = 0, mpol_bind = 2, mpol_interleave = 3;
+        const unsigned mpol_mf_move = 2;
+        const size_t mask_bits = 1024, long_bits = 8 * sizeof(unsigned long);
+        unsigned long mask[mask_bits / long_bits] = { 0 };
+        for (size_t i = 0; i < nodes.size(); ++i)
+        {
+            assert(0 <= nodes[i] && (size_t)nodes[i] < mask_bits);
+            mask[nodes[i] / long_bits] |= 1UL << (nodes[i] % long_bits);
+        }
+        int mode = mpol_default;
+        if (policy == TS_NUMA_BIND)
+            mode = mpol_bind;
+        else if (policy == TS_NUMA_INTERLEAVE)
+            mode = mpol_interleave;
+        return syscall(SYS_mbind, ptr, (unsigned long)size, mode,
+                       (mode == mpol_default ? NULL : mask),
+                       (unsigned long)(mode == mpol_default ? 0
+                                                            : mask_bits + 1),
+                       mpol_mf_move) == 0;
+#else
+        (void)ptr;
+        (void)policy;
+        return false;
+#endif
+    }
+
+    /* binds the calling thread to the CPUs of a node */
+    inline bool TS_numa_bind_thread(int node)
+    {
+#ifdef __linux__
+        const std::vector<int> cpus = TS_numa_cpus(node);
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        for (size_t i = 0; i < cpus.size(); ++i)
+        {
+            if (cpus[i] < CPU_SETSIZE)
+                CPU_SET(cpus[i], &set);
+        }
+        return sched_setaffinity(0, sizeof(set), &set) == 0;
+#else
+        (void)node;
+        return false;
+#endif
+    }
+
+    /* TriNumaPool has a group of threads on every node, bound to its
+     * CPUs.  A TriExec on it runs the chunk i of count on the node
+     * node_of(i, count), which place() gives the pages of that chunk, so
+     * each thread mostly reads local memory.  The calling thread runs
+     * chunks of the first node; bind it there for a full local pass. */
+    class TriNumaPool : public TriThreadPool
+    {
+    public:
+        /* 0 threads per node means one per CPU */
+        explicit TriNumaPool(unsigned threads_per_node = 0)
+            : TriNumaPool(TS_numa_nodes(), threads_per_node) { }
+        TriNumaPool(const std::vector<int>& nodes, unsigned threads_per_node)
+            : TriThreadPool(group_sizes(nodes, threads_per_node),
+                            binder(nodes)),
+              m_nodes(nodes) { }
+
+        const std::vector<int>& nodes() const {
+            return m_nodes;
+        }
+        int node_of(size_t index, size_t count) const {
+            assert(index < count);
+            return m_nodes[index * m_nodes.size() / count];
+        }
+
+        /* binds the pages of an array of num elements of elem_size bytes
+         * to the nodes of its chunks under exec.  data must be page
+         * aligned (TS_numa_alloc); a page shared by two chunks goes to
+         * the later one.  For packed arrays pass the words. */
+        bool place(const TriExec& exec, void *data, size_t num,
+                   size_t elem_size) const
+        {
+            const size_t page = TS_numa_page_size();
+            const size_t count = exec.chunks(num);
+            char *bytes = static_cast<char *>(data);
+            assert(reinterpret_cast<uintptr_t>(bytes) % page == 0);
+            bool placed = true;
+            size_t begin = 0;
+            for (size_t i = 0; i < count; ++i)
+            {
+                size_t end = exec.chunk_begin(num, i + 1) * elem_size;
+                end = (i + 1 == count ? (end + page - 1) / page * page
+                                      : end / page * page);
+                if (end <= begin)
+                    continue;
+                placed &= TS_numa_place(bytes + begin, end - begin,
+                                        TS_NUMA_BIND,
+                                        std::vector<int>(1, node_of(i,
+                                                                    count)));
+                begin = end;
+            }
+            return placed;
+        }
+
+    protected:
+        std::vector<int> m_nodes;
+
+        static std::vector<unsigned>
+        group_sizes(const std::vector<int>& nodes, unsigned threads_per_node)
+        {
+            assert(!nodes.empty());
+            std::vector<unsigned> sizes;
+            for (size_t i = 0; i < nodes.size(); ++i)
+            {
+                unsigned size = threads_per_node;
+                if (size == 0)
+                    size = (unsigned)TS_numa_cpus(nodes[i]).size();
+                sizes.push_back(size ? size : 1);
+            }
+            return sizes;
+        }
+        static std::function<void(unsigned)>
+        binder(const std::vector<int>& nodes)
+        {
+            return [nodes](unsigned group) {
+                TS_numa_bind_thread(nodes[group]);
+            };
+        }
+    }; // class TriNumaPool
+#endif  /* def __cplusplus && def TRISTATE_NUMA */
+
+/****************************************************************************/
+/* TriCowArray class --- copy-on-write snapshots (TRISTATE_PARALLEL) */
+
+#if defined(__cplusplus) && defined(TRISTATE_PARALLEL)
+    /* TriCowArray is a TRISTATE array split into chunks of chunk_size()
+     * values.  A version is a table of shared chunks; a writer copies the
+     * table and only the chunks it changes, then publishes the new
+     * version, so a change costs one chunk and readers keep what they
+     * see.  Readers never block: a reader (one per thread) announces the
+     * epoch it starts in and loads the current version, and a retired
+     * version is freed once no reader announces an epoch before it.
+     * Writers are serialized among themselves. */
+    class TriCowArray
+    {
+    protected:
+        typedef std::vector<TRISTATE> chunk_type;
+        struct version
+        {
+            size_t                                      num;
+            size_t                                      chunk_size;
+            std::vector<std::shared_ptr<chunk_type> >   chunks;
+        };
+        struct reader_slot
+        {
+            std::atomic<uint64_t>   epoch;      // 0 if not reading
+            std::atomic<bool>       used;
+            char                    pad[64 - sizeof(uint64_t) - 1];
+        };
+        struct retired_version
+        {
+            version *   old;
+            uint64_t    epoch;
+        };
+
+    public:
+        class reader;
+        class snapshot;
+        class batch;
+
+        TriCowArray(size_t num, TriS value = TriS::U,
+                    size_t chunk_size = 4096, size_t max_readers = 64)
+            : m_num(num), m_chunk_size(chunk_size ? chunk_size : 1),
+              m_slots(new reader_slot[max_readers ? max_readers : 1]),
+              m_max_readers(max_readers ? max_readers : 1), m_epoch(1)
+        {
+            for (size_t i = 0; i < m_max_readers; ++i)
+            {
+                m_slots[i].epoch = 0;
+                m_slots[i].used = false;
+            }
+            version *first = new version;
+            first->num = num;
+            first->chunk_size = m_chunk_size;
+            for (size_t begin = 0; begin < num; begin += m_chunk_size)
+            {
+                const size_t count = std::min(m_chunk_size, num - begin);
+                first->chunks.push_back(std::make_shared<chunk_type>(
+                    count, value.value()));
+            }
+            m_current = first;
+        }
+        ~TriCowArray()
+        {
+#ifndef NDEBUG
+            for (size_t i = 0; i < m_max_readers; ++i)
+                assert(!m_slots[i].used);
+#endif
+            for (size_t i = 0; i < m_retired.size(); ++i)
+                delete m_retired[i].old;
+            delete m_current.load();
+        }
+
+        size_t size() const {
+            return m_num;
+        }
+        size_t chunk_size() const {
+            return m_chunk_size;
+        }
+        /* the versions waiting for their readers */
+        size_t retired() const {
+            std::lock_guard<std::mutex> lock(m_write_mutex);
+            return m_retired.size();
+        }
+
+        /* single changes, each a version of its own */
+        void set(size_t index, TriS value);
+        void tri_each_and(TriS value);
+        void tri_each_or(TriS value);
+        void each_not();
+
+    protected:
+        const size_t                    m_num;
+        size_t                          m_chunk_size;
+        std::unique_ptr<reader_slot[]>  m_slots;
+        size_t                          m_max_readers;
+        std::atomic<uint64_t>           m_epoch;
+        std::atomic<version *>          m_current;
+        mutable std::mutex              m_write_mutex;
+        std::vector<retired_version>    m_retired;
+
+        /* with m_write_mutex held */
+        void publish(version *next) {
+            version *old = m_current.exchange(next);
+            retired_version entry = { old, m_epoch.fetch_add(1) + 1 };
+            m_retired.push_back(entry);
+            reclaim();
+        }
+        void reclaim() {
+            uint64_t oldest = ~(uint64_t)0;
+            for (size_t i = 0; i < m_max_readers; ++i)
+            {
+                const uint64_t epoch = m_slots[i].epoch.load();
+                if (epoch && epoch < oldest)
+                    oldest = epoch;
+            }
+            size_t kept = 0;
+            for (size_t i = 0; i < m_retired.size(); ++i)
+            {
+                if (m_retired[i].epoch <= oldest)
+                    delete m_retired[i].old;
+                else
+                    m_retired[kept++] = m_retired[i];
+            }
+            m_retired.resize(kept);
+        }
+
+    private:
+        TriCowArray(const TriCowArray&);
+        TriCowArray& operator=(const TriCowArray&);
+    }; // class TriCowArray
+
+    /* a reader takes one of max_readers slots for its lifetime */
+    class TriCowArray::reader
+    {
+    public:
+        explicit reader(TriCowArray& array) : m_array(array), m_slot(NULL) {
+            for (size_t i = 0; i < array.m_max_readers && !m_slot; ++i)
+            {
+                bool expected = false;
+                if (array.m_slots[i].used.compare_exchange_strong(expected,
+                                                                  true))
+                {
+                    m_slot = &array.m_slots[i];
+                }
+            }
+            assert(m_slot != NULL);     // too many readers
+        }
+        ~reader() {
+            assert(m_slot->epoch == 0);
+            m_slot->used = false;
+        }
+
+    protected:
+        friend class TriCowArray::snapshot;
+        TriCowArray&    m_array;
+        reader_slot *   m_slot;
+
+    private:
+        reader(const reader&);
+        reader& operator=(const reader&);
+    }; // class TriCowArray::reader
+
+    /* a snapshot is the version current when it was taken, unchanged
+     * until it is destroyed; one at a time per reader */
+    class TriCowArray::snapshot
+    {
+    public:
+        explicit snapshot(reader& by) : m_slot(by.m_slot) {
+            assert(m_slot->epoch == 0);
+            m_slot->epoch = by.m_array.m_epoch.load();
+            m_version = by.m_array.m_current.load();
+        }
+        ~snapshot() {
+            m_slot->epoch = 0;
+        }
+
+        size_t size() const {
+            return m_version->num;
+        }
+        size_t num_chunks() const {
+            return m_version->chunks.size();
+        }
+        const TRISTATE *chunk(size_t k, size_t& count) const {
+            const chunk_type& values = *m_version->chunks[k];
+            count = values.size();
+            return &values[0];
+        }
+        TriS operator[](size_t index) const {
+            assert(index < size());
+            const size_t chunk_size = m_version->chunk_size;
+            return (*m_version->chunks[index / chunk_size])[index %
+                                                            chunk_size];
+        }
+
+        TRISTATE connect_and() const {
+            TRISTATE value = TS_TRUE;
+            for (size_t k = 0; k < num_chunks() && value != TS_FALSE; ++k)
+            {
+                const chunk_type& values = *m_version->chunks[k];
+                value = TS_tri_and(value, TS_connect_and_tri(values.size(),
+                                                             &values[0]));
+            }
+            return value;
+        }
+        TRISTATE connect_or() const {
+            TRISTATE value = TS_FALSE;
+            for (size_t k = 0; k < num_chunks() && value != TS_TRUE; ++k)
+            {
+                const chunk_type& values = *m_version->chunks[k];
+                value = TS_tri_or(value, TS_connect_or_tri(values.size(),
+                                                           &values[0]));
+            }
+            return value;
+        }
+        TriTally tally() const {
+            TriTally counts;
+            for (size_t k = 0; k < num_chunks(); ++k)
+            {
+                const chunk_type& values = *m_version->chunks[k];
+                counts.add(values.size(), &values[0]);
+            }
+            return counts;
+        }
+        TRISTATE get_tri_totality() const {
+            return tally().get_tri_totality();
+        }
+        void to_tri(TRISTATE *tris) const {
+            for (size_t k = 0; k < num_chunks(); ++k)
+            {
+                const chunk_type& values = *m_version->chunks[k];
+                std::copy(values.begin(), values.end(), tris);
+                tris += values.size();
+            }
+        }
+
+    protected:
+        reader_slot *       m_slot;
+        const version *     m_version;
+
+    private:
+        snapshot(const snapshot&);
+        snapshot& operator=(const snapshot&);
+    }; // class TriCowArray::snapshot
+
+    /* a batch collects changes into one version, published by commit().
+     * It holds off the other writers until it is destroyed. */
+    class TriCowArray::batch
+    {
+    public:
+        explicit batch(TriCowArray& array)
+            : m_array(array), m_lock(array.m_write_mutex),
+              m_next(new version(*array.m_current.load())),
+              m_owned(m_next->chunks.size(), false) { }
+        ~batch() {
+            delete m_next;
+        }
+
+        size_t size() const {
+            return m_next->num;
+        }
+        TriS operator[](size_t index) const {
+            assert(index < size());
+            const size_t chunk_size = m_array.m_chunk_size;
+            return (*m_next->chunks[index / chunk_size])[index % chunk_size];
+        }
+
+        /* chunk k, copied on its first write */
+        TRISTATE *chunk(size_t k, size_t& count) {
+            assert(m_next && k < m_owned.size());
+            if (!m_owned[k])
+            {
+                m_next->chunks[k] = std::make_shared<chunk_type>(
+                    *m_next->chunks[k]);
+                m_owned[k] = true;
+            }
+            count = m_next->chunks[k]->size();
+            return &(*m_next->chunks[k])[0];
+        }
+
+        void set(size_t index, TriS value) {
+#ifdef TRISTATE_STRICT
+            assert(value.is_valid());
+#endif
+            assert(index < size());
+            if ((*this)[index].value() == value.value())
+                return;
+            size_t count;
+            chunk(index / m_array.m_chunk_size, count)
+                [index % m_array.m_chunk_size] = value.value();
+        }
+        /* the chunks which would not change are not copied */
+        void tri_each_and(TriS value) {
+            for (size_t k = 0; k < m_owned.size(); ++k)
+            {
+                const chunk_type& values = *m_next->chunks[k];
+                if (TS_connect_or_tri(values.size(), &values[0]) <=
+                    value.value())
+                {
+                    continue;
+                }
+                size_t count;
+                TRISTATE *data = chunk(k, count);
+                TS_tri_each_and_tri(value.value(), count, data);
+            }
+        }
+        void tri_each_or(TriS value) {
+            for (size_t k = 0; k < m_owned.size(); ++k)
+            {
+                const chunk_type& values = *m_next->chunks[k];
+                if (TS_connect_and_tri(values.size(), &values[0]) >=
+                    value.value())
+                {
+                    continue;
+                }
+                size_t count;
+                TRISTATE *data = chunk(k, count);
+                TS_tri_each_or_tri(value.value(), count, data);
+            }
+        }
+        void each_not() {
+            for (size_t k = 0; k < m_owned.size(); ++k)
+            {
+                size_t count;
+                TRISTATE *data = chunk(k, count);
+                TS_each_not_tri(count, data);
+            }
+        }
+
+        void commit() {
+            assert(m_next != NULL);
+            m_array.publish(m_next);
+            m_next = NULL;
+        }
+
+    protected:
+        TriCowArray&                    m_array;
+        std::lock_guard<std::mutex>     m_lock;
+        version *                       m_next;
+        std::vector<bool>               m_owned;
+
+    private:
+        batch(const batch&);
+        batch& operator=(const batch&);
+    }; // class TriCowArray::batch
+
+    inline void TriCowArray::set(size_t index, TriS value)
+    {
+        batch changes(*this);
+        changes.set(index, value);
+        changes.commit();
+    }
+    inline void TriCowArray::tri_each_and(TriS value)
+    {
+        batch changes(*this);
+        changes.tri_each_and(value);
+        changes.commit();
+    }
+    inline void TriCowArray::tri_each_or(TriS value)
+    {
+        batch changes(*this);
+        changes.tri_each_or(value);
+        changes.commit();
+    }
+    inline void TriCowArray::each_not()
+    {
+        batch changes(*this);
+        changes.each_not();
+        changes.commit();
+    }
+#endif  /* def __cplusplus && def TRISTATE_PARALLEL */
+
+/****************************************************************************/
+/* TriGroupBy class --- hash aggregation of tri-state values by key */
+
+#ifdef __cplusplus
+    /* TriHash hashes integers (mixed as in splitmix64) and strings
+     * (FNV-1a). */
+    struct TriHash
+    {
+        uint64_t operator()(uint64_t key) const {
+            key ^= key >> 30;
+            key *= 0xBF58476D1CE4E5B9ULL;
+            key ^= key >> 27;
+            key *= 0x94D049BB133111EBULL;
+            key ^= key >> 31;
+            return key;
+        }
+        uint64_t operator()(const std::string& key) const {
+            uint64_t hash = 0xCBF29CE484222325ULL;
+            for (size_t i = 0; i < key.size(); ++i)
+            {
+                hash ^= (unsigned char)key[i];
+                hash *= 0x100000001B3ULL;
+            }
+            return (*this)(hash);
+        }
+    }; // struct TriHash
+
+    /* TriGroupBy keeps a TriTally for each key in an open-addressing
+     * table.  Large inputs are first partitioned by the high bits of the
+     * hash, and each partition is aggregated into its own small table. */
+    template <typename T_KEY, typename T_HASH = TriHash>
+    class TriGroupBy
+    {
+    public:
+        struct group : TriTally
+        {
+            T_KEY   key;
+        };
+        typedef std::vector<group> group_list;
+
+        enum { partition_bits = 6, partition_min = 1 << 20 };
+
+        explicit TriGroupBy(const T_HASH& hash = T_HASH()) : m_hash(hash) { }
+
+        size_t size() const {
+            return m_groups.size();
+        }
+        bool empty() const {
+            return m_groups.empty();
+        }
+        /* the groups in the order their keys first appeared */
+        const group_list& groups() const {
+            return m_groups;
+        }
+        const group *find(const T_KEY& key) const {
+            if (m_slots.empty())
+                return NULL;
+            const uint64_t hash = m_hash(key);
+            const size_t mask = m_slots.size() - 1;
+            for (size_t i = (size_t)hash & mask; m_slots[i];
+                 i = (i + 1) & mask)
+            {
+                const size_t index = m_slots[i] - 1;
+                if (m_hashes[index] == hash && m_groups[index].key == key)
+                    return &m_groups[index];
+            }
+            return NULL;
+        }
+
+        void clear() {
+            m_groups.clear();
+            m_hashes.clear();
+            m_slots.clear();
+        }
+        void reserve(size_t num_groups) {
+            m_groups.reserve(num_groups);
+            m_hashes.reserve(num_groups);
+            if (m_slots.size() < 2 * num_groups)
+                rehash(2 * num_groups);
+        }
+
+        void add(const T_KEY& key, TRISTATE value) {
+#ifdef TRISTATE_STRICT
+            assert(TS_is_valid_tri(value));
+#endif
+            m_groups[insert(key, m_hash(key))].add(value);
+        }
+        void add(size_t num, const T_KEY *keys, const TRISTATE *values) {
+            assert(keys != NULL || num == 0);
+            assert(values != NULL || num == 0);
+#ifdef TRISTATE_STRICT
+            assert(TS_find_invalid_tri(num, values) == num);
+#endif
+            if (num < partition_min)
+            {
+                for (size_t i = 0; i < num; ++i)
+                {
+                    const size_t index = insert(keys[i], m_hash(keys[i]));
+                    m_groups[index].add(values[i]);
+                }
+                return;
+            }
+            std::vector<uint64_t> hashes(num);
+            for (size_t i = 0; i < num; ++i)
+                hashes[i] = m_hash(keys[i]);
+            std::vector<size_t> offsets, order, firsts, local_firsts;
+            partition(num, &hashes[0], offsets, order);
+            const size_t old_size = m_groups.size();
+            for (size_t p = 0; p + 1 < offsets.size(); ++p)
+            {
+                TriGroupBy local(m_hash);
+                local_firsts.clear();
+                local.add_indexed(offsets[p + 1] - offsets[p],
+                                  &order[offsets[p]], keys, values,
+                                  &hashes[0], local_firsts);
+                merge_partition(local, local_firsts, old_size, firsts);
+            }
+            sort_new_groups(old_size, firsts);
+        }
+#ifdef TRISTATE_PARALLEL
+        /* hashes and aggregates the partitions in parallel */
+        void add(const TriExec& exec, size_t num, const T_KEY *keys,
+                 const TRISTATE *values)
+        {
+            assert(keys != NULL || num == 0);
+            assert(values != NULL || num == 0);
+#ifdef TRISTATE_STRICT
+            assert(TS_find_invalid_tri(num, values) == num);
+#endif
+            std::vector<uint64_t> hashes(num);
+            exec.for_chunks(num, [&](size_t, size_t begin, size_t end) {
+                for (size_t i = begin; i < end; ++i)
+                    hashes[i] = m_hash(keys[i]);
+            });
+            std::vector<size_t> offsets, order;
+            partition(num, hashes.data(), offsets, order);
+            std::vector<TriGroupBy> locals(offsets.size() - 1,
+                                           TriGroupBy(m_hash));
+            std::vector<std::vector<size_t> > local_firsts(locals.size());
+            TriExec(exec.threads(), 1).for_chunks(locals.size(),
+                [&](size_t, size_t begin, size_t end) {
+                    for (size_t p = begin; p < end; ++p)
+                    {
+                        locals[p].add_indexed(offsets[p + 1] - offsets[p],
+                                              order.data() + offsets[p], keys,
+                                              values, hashes.data(),
+                                              local_firsts[p]);
+                    }
+                });
+            const size_t old_size = m_groups.size();
+            std::vector<size_t> firsts;
+            for (size_t p = 0; p < locals.size(); ++p)
+                merge_partition(locals[p], local_firsts[p], old_size, firsts);
+            sort_new_groups(old_size, firsts);
+        }
+#endif  /* def TRISTATE_PARALLEL */
+
+        /* adds the counts of other, which must use the same hash */
+        void merge(const TriGroupBy& other) {
+            if (m_groups.empty())
+                reserve(other.size());
+            for (size_t i = 0; i < other.m_groups.size(); ++i)
+            {
+                const group& from = other.m_groups[i];
+                m_groups[insert(from.key, other.m_hashes[i])].add(from);
+            }
+        }
+
+    protected:
+        group_list              m_groups;
+        std::vector<uint64_t>   m_hashes;   // the hash of each group's key
+        std::vector<size_t>     m_slots;    // group index + 1, or 0 if empty
+        T_HASH                  m_hash;
+
+        size_t insert(const T_KEY& key, uint64_t hash) {
+            if (2 * (m_groups.size() + 1) > m_slots.size())
+                rehash(2 * (m_groups.size() + 1));
+            const size_t mask = m_slots.size() - 1;
+            size_t i = (size_t)hash & mask;
+            for (; m_slots[i]; i = (i + 1) & mask)
+            {
+                const size_t index = m_slots[i] - 1;
+                if (m_hashes[index] == hash && m_groups[index].key == key)
+                    return index;
+            }
+            group g;
+            g.key = key;
+            m_groups.push_back(g);
+            m_hashes.push_back(hash);
+            m_slots[i] = m_groups.size();
+            return m_groups.size() - 1;
+        }
+
+        void rehash(size_t min_slots) {
+            size_t size = 16;
+            while (size < min_slots)
+                size *= 2;
+            m_slots.assign(size, 0);
+            const size_t mask = size - 1;
+            for (size_t index = 0; index < m_hashes.size(); ++index)
+            {
+                size_t i = (size_t)m_hashes[index] & mask;
+                while (m_slots[i])
+                    i = (i + 1) & mask;
+                m_slots[i] = index + 1;
+            }
+        }
+
+        /* firsts receives the index of each new group's first key */
+        void add_indexed(size_t num, const size_t *indexes, const T_KEY *keys,
+                         const TRISTATE *values, const uint64_t *hashes,
+                         std::vector<size_t>& firsts)
+        {
+            for (size_t k = 0; k < num; ++k)
+            {
+                const size_t i = indexes[k];
+                const size_t before = m_groups.size();
+                m_groups[insert(keys[i], hashes[i])].add(values[i]);
+                if (m_groups.size() != before)
+                    firsts.push_back(i);
+            }
+        }
+
+        /* a partition's keys are in no other partition, so each group
+         * added since old_size comes from exactly one local group */
+        void merge_partition(const TriGroupBy& local,
+                             const std::vector<size_t>& local_firsts,
+                             size_t old_size, std::vector<size_t>& firsts)
+        {
+            for (size_t i = 0; i < local.m_groups.size(); ++i)
+            {
+                const group& from = local.m_groups[i];
+                const size_t index = insert(from.key, local.m_hashes[i]);
+                m_groups[index].add(from);
+                if (index >= old_size && index - old_size == firsts.size())
+                    firsts.push_back(local_firsts[i]);
+            }
+        }
+
+        /* puts the groups added since old_size back in the order their
+         * keys first appeared */
+        void sort_new_groups(size_t old_size,
+                             const std::vector<size_t>& firsts)
+        {
+            const size_t count = firsts.size();
+            assert(old_size + count == m_groups.size());
+            std::vector<std::pair<size_t, size_t> > ranks(count);
+            for (size_t i = 0; i < count; ++i)
+                ranks[i] = std::make_pair(firsts[i], old_size + i);
+            std::sort(ranks.begin(), ranks.end());
+            group_list groups(m_groups.begin(), m_groups.begin() + old_size);
+            std::vector<uint64_t> hashes(m_hashes.begin(),
+                                         m_hashes.begin() + old_size);
+            groups.reserve(m_groups.size());
+            hashes.reserve(m_groups.size());
+            for (size_t i = 0; i < count; ++i)
+            {
+                groups.push_back(m_groups[ranks[i].second]);
+                hashes.push_back(m_hashes[ranks[i].second]);
+            }
+            m_groups.swap(groups);
+            m_hashes.swap(hashes);
+            rehash(m_slots.size());
+        }
+
+        /* radix partition by the high bits of the hashes */
+        static void partition(size_t num, const uint64_t *hashes,
+                              std::vector<size_t>& offsets,
+                              std::vector<size_t>& order)
+        {
+            const size_t parts = (size_t)1 << partition_bits;
+            const int shift = 64 - partition_bits;
+            offsets.assign(parts + 1, 0);
+            for (size_t i = 0; i < num; ++i)
+                ++offsets[(size_t)(hashes[i] >> shift) + 1];
+            for (size_t p = 0; p < parts; ++p)
+                offsets[p + 1] += offsets[p];
+            std::vector<size_t> next(offsets.begin(), offsets.end() - 1);
+            order.resize(num);
+            for (size_t i = 0; i < num; ++i)
+                order[next[(size_t)(hashes[i] >> shift)]++] = i;
+        }
+    }; // class TriGroupBy
+#endif  /* def __cplusplus */
+
+/****************************************************************************/
+/* TriWindow classes --- sliding-window aggregation of tri-state values */
+
+#ifdef __cplusplus
+    #include <deque>        // for std::deque
+
+    /* TriWindow keeps the last capacity() values in a ring buffer and
+     * their TriTally, so push and query are O(1). */
+    class TriWindow
+    {
+    public:
+        explicit TriWindow(size_t capacity) :
+            m_values(capacity), m_head(0), m_size(0)
+        {
+            assert(capacity > 0);
+        }
+
+        size_t capacity() const {
+            return m_values.size();
+        }
+        size_t size() const {
+            return m_size;
+        }
+        bool empty() const {
+            return m_size == 0;
+        }
+        bool full() const {
+            return m_size == m_values.size();
+        }
+        const TriTally& tally() const {
+            return m_tally;
+        }
+
+        /* index 0 is the oldest value */
+        TriS operator[](size_t index) const {
+            assert(index < m_size);
+            return TriS((TRISTATE)m_values[wrap(m_head + index)]);
+        }
+        TriS oldest() const {
+            return (*this)[0];
+        }
+        TriS newest() const {
+            return (*this)[m_size - 1];
+        }
+
+        TRISTATE connect_and() const {
+            return m_tally.connect_and();
+        }
+        TRISTATE connect_or() const {
+            return m_tally.connect_or();
+        }
+        TRISTATE get_tri_totality() const {
+            return m_tally.get_tri_totality();
+        }
+
+        /* adds a value, evicting the oldest one when full */
+        void push(TRISTATE value) {
+#ifdef TRISTATE_STRICT
+            assert(TS_is_valid_tri(value));
+#endif
+            push_unchecked(value);
+        }
+        /* a burst longer than the window only keeps its tail */
+        void push(size_t num, const TRISTATE *values) {
+            assert(values != NULL || num == 0);
+#ifdef TRISTATE_STRICT
+            assert(TS_find_invalid_tri(num, values) == num);
+#endif
+            if (num >= m_values.size())
+            {
+                values += num - m_values.size();
+                num = m_values.size();
+                clear();
+            }
+            for (size_t i = 0; i < num; ++i)
+                push_unchecked(values[i]);
+        }
+        void pop() {
+            assert(m_size > 0);
+            m_tally.remove((TRISTATE)m_values[m_head]);
+            m_head = wrap(m_head + 1);
+            --m_size;
+        }
+        void clear() {
+            m_head = m_size = 0;
+            m_tally = TriTally();
+        }
+
+    protected:
+        std::vector<TRISTATE8>  m_values;
+        size_t                  m_head;
+        size_t                  m_size;
+        TriTally                m_tally;
+
+        size_t wrap(size_t index) const {
+            return (index < m_values.size() ? index
+                                            : index - m_values.size());
+        }
+        /* the tally counts what the buffer keeps, so that eviction
+         * takes back what was added */
+        void push_unchecked(TRISTATE value) {
+            const TRISTATE8 narrow = TS_TO_TRI8(value);
+            if (m_size == m_values.size())
+            {
+                m_tally.remove((TRISTATE)m_values[m_head]);
+                m_values[m_head] = narrow;
+                m_head = wrap(m_head + 1);
+            }
+            else
+            {
+                m_values[wrap(m_head + m_size)] = narrow;
+                ++m_size;
+            }
+            m_tally.add((TRISTATE)narrow);
+        }
+    }; // class TriWindow
+
+    /* TriTimeWindow keeps the values stamped within span() of the
+     * latest time, i.e. those with now - time < span.  Times must not
+     * decrease.  Every value is pushed and evicted once, so updates are
+     * O(1) amortized. */
+    template <typename T_TIME = uint64_t>
+    class TriTimeWindow
+    {
+    public:
+        typedef std::pair<T_TIME, TRISTATE8> entry;
+
+        explicit TriTimeWindow(T_TIME span) : m_span(span) { }
+
+        T_TIME span() const {
+            return m_span;
+        }
+        size_t size() const {
+            return m_entries.size();
+        }
+        bool empty() const {
+            return m_entries.empty();
+        }
+        const TriTally& tally() const {
+            return m_tally;
+        }
+        const std::deque<entry>& entries() const {
+            return m_entries;
+        }
+
+        TRISTATE connect_and() const {
+            return m_tally.connect_and();
+        }
+        TRISTATE connect_or() const {
+            return m_tally.connect_or();
+        }
+        TRISTATE get_tri_totality() const {
+            return m_tally.get_tri_totality();
+        }
+
+        void push(T_TIME time, TRISTATE value) {
+#ifdef TRISTATE_STRICT
+            assert(TS_is_valid_tri(value));
+#endif
+            append(time, value);
+            expire(time);
+        }
+        /* evicts once after the whole burst */
+        void push(size_t num, const T_TIME *times, const TRISTATE *values) {
+            assert(times != NULL || num == 0);
+            assert(values != NULL || num == 0);
+#ifdef TRISTATE_STRICT
+            assert(TS_find_invalid_tri(num, values) == num);
+#endif
+            if (num == 0)
+                return;
+            for (size_t i = 0; i < num; ++i)
+                append(times[i], values[i]);
+            expire(times[num - 1]);
+        }
+        /* evicts the values that are span() or more older than now */
+        void expire(T_TIME now) {
+            while (!m_entries.empty() &&
+                   !(now - m_entries.front().first < m_span))
+            {
+                m_tally.remove((TRISTATE)m_entries.front().second);
+                m_entries.pop_front();
+            }
+        }
+        void clear() {
+            m_entries.clear();
+            m_tally = TriTally();
+        }
+
+    protected:
+        T_TIME              m_span;
+        std::deque<entry>   m_entries;
+        TriTally            m_tally;
+
+        void append(T_TIME time, TRISTATE value) {
+            assert(m_entries.empty() || !(time < m_entries.back().first));
+            const TRISTATE8 narrow = TS_TO_TRI8(value);
+            m_entries.push_back(entry(time, narrow));
+            m_tally.add((TRISTATE)narrow);
+        }
+    }; // class TriTimeWindow
+#endif  /* def __cplusplus */
+
+/****************************************************************************/
+/* TriRuleTable class --- ternary (TCAM-style) matching of bit keys */
+
+#ifdef __cplusplus
+    /* TriRuleTable matches bitset keys of width() bits against patterns
+     * in which TS_UNKNOWN means "don't care".  Each rule is kept as
+     * packed trues/falses planes, so it is checked a word at a time.
+     * compile() orders the rules by priority (greater first, then in the
+     * order added) and, for large tables, builds a decision tree over the
+     * key bits whose leaves hold the few rules left to check. */
+    class TriRuleTable
+    {
+    public:
+        static const size_t npos = (size_t)-1;
+        static const size_t index_min = 256;
+        static const size_t leaf_max = 16;
+        static const size_t depth_max = 24;
+
+        explicit TriRuleTable(size_t width)
+            : m_width(width), m_words(TS_WORDS(width)), m_compiled(true)
+        {
+            assert(width > 0);
+        }
+
+        size_t width() const {
+            return m_width;
+        }
+        size_t size() const {
+            return m_ids.size();
+        }
+        bool empty() const {
+            return m_ids.empty();
+        }
+        bool compiled() const {
+            return m_compiled;
+        }
+        bool indexed() const {
+            return !m_nodes.empty();
+        }
+
+        /* adds a rule of width() values and returns its id, which counts
+         * the rules added since clear() */
+        size_t add(const TRISTATE *pattern, int priority = 0) {
+            assert(pattern != NULL);
+#ifdef TRISTATE_STRICT
+            assert(TS_find_invalid_tri(m_width, pattern) == m_width);
+#endif
+            const size_t row = append(priority);
+            TS_tri_to_packed(m_width, pattern, &m_trues[row], &m_falses[row]);
+            return m_ids.back();
+        }
+        size_t add_packed(const TS_WORD *trues, const TS_WORD *falses,
+                          int priority = 0)
+        {
+            assert(trues != NULL && falses != NULL);
+            const size_t row = append(priority);
+            for (size_t i = 0; i < m_words; ++i)
+            {
+                const TS_WORD mask = (i + 1 < m_words ? ~(TS_WORD)0
+                                                      : TS_TAIL_MASK(m_width));
+                assert((trues[i] & falses[i] & mask) == 0);
+                m_trues[row + i] = trues[i] & mask;
+                m_falses[row + i] = falses[i] & mask;
+            }
+            return m_ids.back();
+        }
+        void clear() {
+            m_trues.clear();
+            m_falses.clear();
+            m_ids.clear();
+            m_priorities.clear();
+            m_nodes.clear();
+            m_leaves.clear();
+            m_compiled = true;
+        }
+
+        void compile() {
+            compile(size() >= index_min);
+        }
+        void compile(bool index) {
+            const size_t num = size();
+            std::vector<size_t> order(num);
+            for (size_t i = 0; i < num; ++i)
+                order[i] = i;
+            std::stable_sort(order.begin(), order.end(),
+                             by_priority(m_priorities));
+            std::vector<TS_WORD> trues(m_trues.size());
+            std::vector<TS_WORD> falses(m_falses.size());
+            std::vector<size_t> ids(num);
+            std::vector<int> priorities(num);
+            for (size_t i = 0; i < num; ++i)
+            {
+                std::copy(&m_trues[order[i] * m_words],
+                          &m_trues[order[i] * m_words] + m_words,
+                          &trues[i * m_words]);
+                std::copy(&m_falses[order[i] * m_words],
+                          &m_falses[order[i] * m_words] + m_words,
+                          &falses[i * m_words]);
+                ids[i] = m_ids[order[i]];
+                priorities[i] = m_priorities[order[i]];
+            }
+            m_trues.swap(trues);
+            m_falses.swap(falses);
+            m_ids.swap(ids);
+            m_priorities.swap(priorities);
+
+            m_nodes.clear();
+            m_leaves.clear();
+            if (index && num)
+            {
+                for (size_t i = 0; i < num; ++i)
+                    order[i] = i;
+                build(order, 0);
+            }
+            m_compiled = true;
+        }
+
+        /* the id of the first rule matching key, or npos */
+        size_t match_first(const TS_WORD *key) const {
+            assert(m_compiled && key != NULL);
+            if (indexed())
+            {
+                const node& leaf = find_leaf(key);
+                for (size_t i = leaf.first; i < leaf.last; ++i)
+                {
+                    if (matches(m_leaves[i], key))
+                        return m_ids[m_leaves[i]];
+                }
+                return npos;
+            }
+            for (size_t base = 0; base < size(); base += TS_WORD_BITS)
+            {
+                const TS_WORD hits = match_block(base, key);
+                if (hits)
+                    return m_ids[base + TS_ctz(hits)];
+            }
+            return npos;
+        }
+        /* keys are num_keys bitsets of TS_WORDS(width()) words each */
+        void match_first(size_t num_keys, const TS_WORD *keys,
+                         size_t *results) const
+        {
+            assert(keys != NULL || num_keys == 0);
+            assert(results != NULL || num_keys == 0);
+            for (size_t i = 0; i < num_keys; ++i)
+                results[i] = match_first(keys + i * m_words);
+        }
+        /* the ids of all rules matching key, in priority order */
+        size_t match_all(const TS_WORD *key, std::vector<size_t>& ids) const
+        {
+            assert(m_compiled && key != NULL);
+            ids.clear();
+            if (indexed())
+            {
+                const node& leaf = find_leaf(key);
+                for (size_t i = leaf.first; i < leaf.last; ++i)
+                {
+                    if (matches(m_leaves[i], key))
+                        ids.push_back(m_ids[m_leaves[i]]);
+                }
+                return ids.size();
+            }
+            for (size_t base = 0; base < size(); base += TS_WORD_BITS)
+            {
+                for (TS_WORD hits = match_block(base, key); hits;
+                     hits &= hits - 1)
+                {
+                    ids.push_back(m_ids[base + TS_ctz(hits)]);
+                }
+            }
+            return ids.size();
+        }
+
+    protected:
+        /* a leaf has bit == npos and holds m_leaves[first, last) */
+        struct node
+        {
+            size_t  bit;
+            size_t  children[2];
+            size_t  first;
+            size_t  last;
+        };
+        struct by_priority
+        {
+            const std::vector<int>& m_priorities;
+            explicit by_priority(const std::vector<int>& priorities)
+                : m_priorities(priorities) { }
+            bool operator()(size_t index1, size_t index2) const {
+                return m_priorities[index1] > m_priorities[index2];
+            }
+        };
+
+        size_t                  m_width;
+        size_t                  m_words;
+        bool                    m_compiled;
+        std::vector<TS_WORD>    m_trues;
+        std::vector<TS_WORD>    m_falses;
+        std::vector<size_t>     m_ids;
+        std::vector<int>        m_priorities;
+        std::vector<node>       m_nodes;
+        std::vector<size_t>     m_leaves;
+
+        size_t append(int priority) {
+            const size_t row = m_trues.size();
+            m_trues.resize(row + m_words);
+            m_falses.resize(row + m_words);
+            m_ids.push_back(m_ids.size());
+            m_priorities.push_back(priority);
+            m_nodes.clear();
+            m_leaves.clear();
+            m_compiled = false;
+            return row;
+        }
+
+        bool matches(size_t rule, const TS_WORD *key) const {
+            const TS_WORD *trues = &m_trues[rule * m_words];
+            const TS_WORD *falses = &m_falses[rule * m_words];
+            TS_WORD miss = 0;
+            for (size_t i = 0; i < m_words; ++i)
+                miss |= (key[i] & falses[i]) | (~key[i] & trues[i]);
+            return miss == 0;
+        }
+        /* a bit for each matching rule of the 64 from base; narrow keys
+         * take the branch-free single-word loop */
+        TS_WORD match_block(size_t base, const TS_WORD *key) const {
+            size_t end = base + TS_WORD_BITS;
+            if (end > size())
+                end = size();
+            TS_WORD hits = 0;
+            if (m_words == 1)
+            {
+                const TS_WORD *trues = &m_trues[0], *falses = &m_falses[0];
+                const TS_WORD k = key[0];
+                for (size_t i = base; i < end; ++i)
+                {
+                    const TS_WORD miss = (k & falses[i]) | (~k & trues[i]);
+                    hits |= (TS_WORD)(miss == 0) << (i - base);
+                }
+            }
+            else
+            {
+                for (size_t i = base; i < end; ++i)
+                    hits |= (TS_WORD)matches(i, key) << (i - base);
+            }
+            return hits;
+        }
+
+        const node& find_leaf(const TS_WORD *key) const {
+            const node *n = &m_nodes[0];
+            while (n->bit != npos)
+                n = &m_nodes[n->children[TS_bits_get(n->bit, key)]];
+            return *n;
+        }
+        /* splits rules on the key bit that the most of them care about in
+         * both directions; the rules that do not care go to both sides,
+         * so a bit is only taken if it leaves each side 3/4 or less */
+        size_t build(const std::vector<size_t>& rules, size_t depth) {
+            const size_t index = m_nodes.size();
+            m_nodes.push_back(node());
+            m_nodes[index].bit = npos;
+
+            size_t best = npos, best_score = 0;
+            if (rules.size() > leaf_max && depth < depth_max)
+            {
+                for (size_t bit = 0; bit < m_width; ++bit)
+                {
+                    size_t ones = 0, zeros = 0;
+                    for (size_t i = 0; i < rules.size(); ++i)
+                    {
+                        const size_t row = rules[i] * m_words;
+                        ones += TS_bits_get(bit, &m_trues[row]);
+                        zeros += TS_bits_get(bit, &m_falses[row]);
+                    }
+                    const size_t score = (ones < zeros ? ones : zeros);
+                    if (score > best_score && 4 * score >= rules.size())
+                    {
+                        best = bit;
+                        best_score = score;
+                    }
+                }
+            }
+            if (best == npos)
+            {
+                m_nodes[index].first = m_leaves.size();
+                m_leaves.insert(m_leaves.end(), rules.begin(), rules.end());
+                m_nodes[index].last = m_leaves.size();
+                return index;
+            }
+
+            std::vector<size_t> sides[2];
+            for (size_t i = 0; i < rules.size(); ++i)
+            {
+                const size_t row = rules[i] * m_words;
+                if (!TS_bits_get(best, &m_trues[row]))
+                    sides[0].push_back(rules[i]);
+                if (!TS_bits_get(best, &m_falses[row]))
+                    sides[1].push_back(rules[i]);
+            }
+            m_nodes[index].bit = best;
+            for (int side = 0; side < 2; ++side)
+            {
+                const size_t child = build(sides[side], depth + 1);
+                m_nodes[index].children[side] = child;
+            }
+            return index;
+        }
+    }; // class TriRuleTable
+#endif  /* def __cplusplus */
+
+/****************************************************************************/
+/* three-way partition and counting sort by tri-state key */
+
+#ifdef __cplusplus
+    /* key(*it) gives a TriS (or a TRISTATE, bool, ...) for each element,
+     * and the elements are ordered F < U < T as TriS orders them.  The
+     * partitions return the first U and the first T. */
+
+    /* unstable, in place, one pass (the Dutch national flag) */
+    template <typename T_ITER, typename T_KEY_FN>
+    std::pair<T_ITER, T_ITER>
+    TS_partition3(T_ITER first, T_ITER last, T_KEY_FN key)
+    {
+        T_ITER unknowns = first, next = first, trues = last;
+        while (next != trues)
+        {
+            const TRISTATE value = TriS(key(*next)).value();
+            if (value < 0)
+            {
+                std::iter_swap(unknowns, next);
+                ++unknowns;
+                ++next;
+            }
+            else if (value > 0)
+            {
+                --trues;
+                std::iter_swap(next, trues);
+            }
+            else
+            {
+                ++next;
+            }
+        }
+        return std::make_pair(unknowns, trues);
+    }
+
+    /* stable: the keys are taken once, then the elements are moved out
+     * to a buffer and scattered back through three sequential cursors */
+    template <typename T_ITER, typename T_KEY_FN>
+    std::pair<T_ITER, T_ITER>
+    TS_stable_partition3(T_ITER first, T_ITER last, T_KEY_FN key)
+    {
+        typedef typename std::iterator_traits<T_ITER>::value_type value_type;
+        std::vector<value_type> buffer(first, last);
+        std::vector<TRISTATE> keys(buffer.size());
+        for (size_t i = 0; i < buffer.size(); ++i)
+            keys[i] = TriS(key(buffer[i])).value();
+        std::vector<size_t> order(buffer.size());
+        size_t bounds[2] = { 0, 0 };
+        if (!buffer.empty())
+            TS_stable_order_tri(keys.size(), &keys[0], &order[0], bounds);
+        T_ITER it = first;
+        for (size_t i = 0; i < order.size(); ++i, ++it)
+            *it = buffer[order[i]];
+        T_ITER unknowns = first, trues = first;
+        std::advance(unknowns, bounds[0]);
+        std::advance(trues, bounds[1]);
+        return std::make_pair(unknowns, trues);
+    }
+
+    /* stable counting sort of keys with a payload of the same length.
+     * keys_out may be NULL to move only the payload. */
+    template <typename T>
+    void TS_counting_sort_tri(size_t num, const TRISTATE *keys,
+                              const T *payload, TRISTATE *keys_out,
+                              T *payload_out, size_t *bounds = NULL)
+    {
+        assert(keys != NULL || num == 0);
+        assert(payload != NULL || num == 0);
+        assert(payload_out != NULL || num == 0);
+#ifdef TRISTATE_STRICT
+        assert(TS_find_invalid_tri(num, keys) == num);
+#endif
+        size_t trues, falses, unknowns;
+        TS_count_tri(&trues, &falses, &unknowns, num, keys);
+        size_t next[3] = { 0, falses, falses + unknowns };
+        for (size_t i = 0; i < num; ++i)
+            payload_out[next[TS_TRI_INDEX(keys[i])]++] = payload[i];
+        if (keys_out)
+        {
+            TS_reset_tri_totality_tri(TS_FALSE, falses, keys_out);
+            TS_reset_tri_totality_tri(TS_UNKNOWN, unknowns,
+                                      keys_out + falses);
+            TS_reset_tri_totality_tri(TS_TRUE, trues,
+                                      keys_out + falses + unknowns);
+        }
+        if (bounds)
+        {
+            bounds[0] = falses;
+            bounds[1] = falses + unknowns;
+        }
+    }
+
+#ifdef TRISTATE_PARALLEL
+    /* the parallel versions count each chunk, give every (state, chunk)
+     * its place in state-major order and scatter the chunks at once,
+     * which keeps them stable */
+    inline void
+    TS_tri_chunk_cursors(const TriExec& exec, size_t num,
+                         const TRISTATE *keys, std::vector<size_t>& cursors,
+                         size_t *bounds)
+    {
+#ifdef TRISTATE_STRICT
+        assert(TS_find_invalid_tri(num, keys) == num);
+#endif
+        const size_t chunks = exec.chunks(num);
+        cursors.assign(chunks * 3, 0);
+        exec.for_chunks(num, [&](size_t index, size_t begin, size_t end) {
+            size_t *counts = &cursors[index * 3];
+            TS_count_tri(&counts[2], &counts[0], &counts[1], end - begin,
+                         keys + begin);
+        });
+        size_t total = 0;
+        for (size_t state = 0; state < 3; ++state)
+        {
+            for (size_t index = 0; index < chunks; ++index)
+            {
+                const size_t count = cursors[index * 3 + state];
+                cursors[index * 3 + state] = total;
+                total += count;
+            }
+            if (bounds && state < 2)
+                bounds[state] = total;
+        }
+    }
+
+    inline void
+    TS_stable_order_tri(const TriExec& exec, size_t num,
+                        const TRISTATE *keys, size_t *order,
+                        size_t *bounds = NULL)
+    {
+        std::vector<size_t> cursors;
+        TS_tri_chunk_cursors(exec, num, keys, cursors, bounds);
+        exec.for_chunks(num, [&](size_t index, size_t begin, size_t end) {
+            size_t *next = &cursors[index * 3];
+            for (size_t i = begin; i < end; ++i)
+                order[next[TS_TRI_INDEX(keys[i])]++] = i;
+        });
+    }
+
+    template <typename T>
+    void TS_counting_sort_tri(const TriExec& exec, size_t num,
+                              const TRISTATE *keys, const T *payload,
+                              TRISTATE *keys_out, T *payload_out,
+                              size_t *bounds = NULL)
+    {
+        size_t local_bounds[2];
+        std::vector<size_t> cursors;
+        TS_tri_chunk_cursors(exec, num, keys, cursors, local_bounds);
+        exec.for_chunks(num, [&](size_t index, size_t begin, size_t end) {
+            size_t *next = &cursors[index * 3];
+            for (size_t i = begin; i < end; ++i)
+                payload_out[next[TS_TRI_INDEX(keys[i])]++] = payload[i];
+        });
+        if (keys_out)
+        {
+            TS_reset_tri_totality_tri(exec, TS_FALSE, local_bounds[0],
+                                      keys_out);
+            TS_reset_tri_totality_tri(exec, TS_UNKNOWN,
+                                      local_bounds[1] - local_bounds[0],
+                                      keys_out + local_bounds[0]);
+            TS_reset_tri_totality_tri(exec, TS_TRUE, num - local_bounds[1],
+                                      keys_out + local_bounds[1]);
+        }
+        if (bounds)
+        {
+            bounds[0] = local_bounds[0];
+            bounds[1] = local_bounds[1];
+        }
+    }
+#endif  /* def TRISTATE_PARALLEL */
+#endif  /* def __cplusplus */
+
+/****************************************************************************/
+/* TriInteger class --- balanced-ternary integer */
+
+#ifdef __cplusplus
+    /* TriInteger is an integer of balanced-ternary digits (trits): TS_FALSE
+     * is -1, TS_UNKNOWN is 0 and TS_TRUE is +1.  The trits are a packed
+     * array, least significant first, with no leading zero trit.
+     * Negation swaps the planes (TS_packed_each_not), and addition adds
+     * all the trits of two words at once, then adds the carries back,
+     * shifted by one trit, until none is left. */
+    class TriInteger
+    {
+    public:
+        TriInteger() : m_size(0) { }
+        TriInteger(int64_t value) : m_size(0) {
+            assign(value);
+        }
+        /* num trits, least significant first */
+        TriInteger(size_t num, const TRISTATE *trits) : m_size(num) {
+            m_trues.resize(TS_WORDS(num));
+            m_falses.resize(TS_WORDS(num));
+            if (num)
+                TS_tri_to_packed(num, trits, &m_trues[0], &m_falses[0]);
+            normalize();
+        }
+
+        void assign(int64_t value) {
+            /* the magnitude does not overflow, even for INT64_MIN */
+            uint64_t magnitude = (value < 0 ? 0 - (uint64_t)value
+                                            : (uint64_t)value);
+            m_trues.assign(TS_WORDS(41), 0);
+            m_falses.assign(TS_WORDS(41), 0);
+            m_size = 0;
+            for (; magnitude; ++m_size)
+            {
+                const unsigned rest = (unsigned)(magnitude % 3);
+                if (rest == 1)
+                    TS_bits_set(true, m_size, &m_trues[0]);
+                else if (rest == 2)
+                    TS_bits_set(true, m_size, &m_falses[0]);
+                magnitude = magnitude / 3 + (rest == 2);
+            }
+            if (value < 0)
+                m_trues.swap(m_falses);
+            normalize();
+        }
+
+        /* the number of trits, 0 for zero */
+        size_t size() const {
+            return m_size;
+        }
+        TRISTATE trit(size_t index) const {
+            if (index >= m_size)
+                return TS_UNKNOWN;
+            return TS_packed_get(index, &m_trues[0], &m_falses[0]);
+        }
+        void to_tri(TRISTATE *trits) const {
+            if (m_size)
+                TS_packed_to_tri(m_size, &m_trues[0], &m_falses[0], trits);
+        }
+
+        bool is_zero() const {
+            return m_size == 0;
+        }
+        /* -1, 0 or 1: the sign of the most significant trit */
+        int sign() const {
+            return (m_size ? (int)trit(m_size - 1) : 0);
+        }
+
+        /* false if the value does not fit */
+        bool to_int64(int64_t& value) const {
+            const bool negative = (sign() < 0);
+            const std::vector<TS_WORD>& trues = (negative ? m_falses
+                                                          : m_trues);
+            const std::vector<TS_WORD>& falses = (negative ? m_trues
+                                                           : m_falses);
+            /* every leading part of a positive number is positive */
+            uint64_t magnitude = 0;
+            for (size_t i = m_size; i-- > 0; )
+            {
+                if (magnitude > (~(uint64_t)0 - 1) / 3)
+                    return false;
+                magnitude *= 3;
+                if (TS_bits_get(i, &trues[0]))
+                    ++magnitude;
+                else if (TS_bits_get(i, &falses[0]))
+                    --magnitude;
+            }
+            const uint64_t limit = (~(uint64_t)0 >> 1) + negative;
+            if (magnitude > limit)
+                return false;
+            value = (negative ? (int64_t)(0 - magnitude) : (int64_t)magnitude);
+            return true;
+        }
+        /* the trits from the most significant, as '+', '0' and '-' */
+        std::string str() const {
+            if (!m_size)
+                return "0";
+            std::string ret;
+            for (size_t i = m_size; i-- > 0; )
+            {
+                const TRISTATE value = trit(i);
+                ret += (value > 0 ? '+' : (value < 0 ? '-' : '0'));
+            }
+            return ret;
+        }
+
+        /* -1, 0 or 1 as *this is less than, equal to or greater than
+         * other; the highest trit that differs decides */
+        int compare(const TriInteger& other) const {
+            if (m_size != other.m_size)
+            {
+                const TriInteger& longer = (m_size > other.m_size ? *this
+                                                                  : other);
+                const int value = longer.sign();
+                return (m_size > other.m_size ? value : -value);
+            }
+            for (size_t w = TS_WORDS(m_size); w-- > 0; )
+            {
+                const TS_WORD diff = (m_trues[w] ^ other.m_trues[w]) |
+                                     (m_falses[w] ^ other.m_falses[w]);
+                if (diff)
+                {
+                    const int bit = TS_WORD_BITS - 1 - clz(diff);
+                    const int trit1 = (int)((m_trues[w] >> bit) & 1) -
+                                      (int)((m_falses[w] >> bit) & 1);
+                    const int trit2 = (int)((other.m_trues[w] >> bit) & 1) -
+                                      (int)((other.m_falses[w] >> bit) & 1);
+                    return (trit1 > trit2 ? 1 : -1);
+                }
+            }
+            return 0;
+        }
+
+        TriInteger& negate() {
+            m_trues.swap(m_falses);
+            return *this;
+        }
+        TriInteger& operator+=(const TriInteger& other) {
+            add(other, false);
+            return *this;
+        }
+        TriInteger& operator-=(const TriInteger& other) {
+            add(other, true);
+            return *this;
+        }
+        /* adds a shifted copy of *this for each nonzero trit of other */
+        TriInteger& operator*=(const TriInteger& other) {
+            const TriInteger multiplicand(*this), multiplier(other);
+            *this = TriInteger();
+            for (size_t w = 0; w < TS_WORDS(multiplier.m_size); ++w)
+            {
+                TS_WORD nonzero = multiplier.m_trues[w] |
+                                  multiplier.m_falses[w];
+                for (; nonzero; nonzero &= nonzero - 1)
+                {
+                    const int bit = TS_ctz(nonzero);
+                    const bool subtract =
+                        ((multiplier.m_falses[w] >> bit) & 1) != 0;
+                    add_shifted(multiplicand, w * TS_WORD_BITS + bit,
+                                subtract);
+                }
+            }
+            return *this;
+        }
+
+        inline friend TriInteger operator-(const TriInteger& value) {
+            TriInteger ret(value);
+            return ret.negate();
+        }
+        inline friend TriInteger
+        operator+(const TriInteger& value1, const TriInteger& value2) {
+            TriInteger ret(value1);
+            return ret += value2;
+        }
+        inline friend TriInteger
+        operator-(const TriInteger& value1, const TriInteger& value2) {
+            TriInteger ret(value1);
+            return ret -= value2;
+        }
+        inline friend TriInteger
+        operator*(const TriInteger& value1, const TriInteger& value2) {
+            TriInteger ret(value1);
+            return ret *= value2;
+        }
+        inline friend bool
+        operator==(const TriInteger& value1, const TriInteger& value2) {
+            return value1.compare(value2) == 0;
+        }
+        inline friend bool
+        operator!=(const TriInteger& value1, const TriInteger& value2) {
+            return value1.compare(value2) != 0;
+        }
+        inline friend bool
+        operator<(const TriInteger& value1, const TriInteger& value2) {
+            return value1.compare(value2) < 0;
+        }
+        inline friend bool
+        operator>(const TriInteger& value1, const TriInteger& value2) {
+            return value1.compare(value2) > 0;
+        }
+        inline friend bool
+        operator<=(const TriInteger& value1, const TriInteger& value2) {
+            return value1.compare(value2) <= 0;
+        }
+        inline friend bool
+        operator>=(const TriInteger& value1, const TriInteger& value2) {
+            return value1.compare(value2) >= 0;
+        }
+
+    protected:
+        size_t                  m_size;
+        std::vector<TS_WORD>    m_trues;    /* +1 trits */
+        std::vector<TS_WORD>    m_falses;   /* -1 trits */
+
+        static int clz(TS_WORD word) {
+            int count = 0;
+            for (TS_WORD top = (TS_WORD)1 << (TS_WORD_BITS - 1);
+                 !(word & top); top >>= 1)
+            {
+                ++count;
+            }
+            return count;
+        }
+
+        void normalize() {
+            size_t words = TS_WORDS(m_size);
+            if (words > m_trues.size())
+                words = m_trues.size();
+            while (words > 0 && !(m_trues[words - 1] | m_falses[words - 1]))
+                --words;
+            m_size = 0;
+            if (words > 0)
+            {
+                const TS_WORD top = m_trues[words - 1] | m_falses[words - 1];
+                m_size = words * TS_WORD_BITS - clz(top);
+            }
+            m_trues.resize(words);
+            m_falses.resize(words);
+        }
+
+        void add(const TriInteger& other, bool subtract) {
+            add_shifted(other, 0, subtract);
+        }
+        /* *this += other * 3^shift (or -= if subtract) */
+        void add_shifted(const TriInteger& other, size_t shift,
+                         bool subtract)
+        {
+            if (other.m_size == 0)
+                return;
+            const size_t size = (m_size > other.m_size + shift
+                                 ? m_size : other.m_size + shift);
+            const size_t words = TS_WORDS(size + 1);
+            const size_t word_shift = shift / TS_WORD_BITS;
+            const int bit_shift = (int)(shift % TS_WORD_BITS);
+
+            /* b is other, shifted */
+            std::vector<TS_WORD> bp(words), bn(words);
+            const std::vector<TS_WORD>& op = (subtract ? other.m_falses
+                                                       : other.m_trues);
+            const std::vector<TS_WORD>& on = (subtract ? other.m_trues
+                                                       : other.m_falses);
+            for (size_t w = 0; w < op.size(); ++w)
+            {
+                bp[w + word_shift] |= op[w] << bit_shift;
+                bn[w + word_shift] |= on[w] << bit_shift;
+                if (bit_shift && w + word_shift + 1 < words)
+                {
+                    bp[w + word_shift + 1] |=
+                        op[w] >> (TS_WORD_BITS - bit_shift);
+                    bn[w + word_shift + 1] |=
+                        on[w] >> (TS_WORD_BITS - bit_shift);
+                }
+            }
+            m_trues.resize(words);
+            m_falses.resize(words);
+
+            /* a + b = d + 3c per trit: (+1) + (+1) = (-1) + 3, and
+             * (-1) + (-1) = (+1) - 3; the carries c become the next b */
+            TS_WORD any;
+            do
+            {
+                TS_WORD carry_p = 0, carry_n = 0;
+                any = 0;
+                for (size_t w = 0; w < words; ++w)
+                {
+                    const TS_WORD ap = m_trues[w], an = m_falses[w];
+                    const TS_WORD cp = ap & bp[w], cn = an & bn[w];
+                    m_trues[w] = ((ap ^ bp[w]) & ~(an | bn[w])) | cn;
+                    m_falses[w] = ((an ^ bn[w]) & ~(ap | bp[w])) | cp;
+                    bp[w] = (cp << 1) | carry_p;
+                    bn[w] = (cn << 1) | carry_n;
+                    carry_p = cp >> (TS_WORD_BITS - 1);
+                    carry_n = cn >> (TS_WORD_BITS - 1);
+                    any |= cp | cn;
+                }
+                assert(!carry_p && !carry_n);
+            } while (any);
+            m_size = words * TS_WORD_BITS;
+            normalize();
+        }
+    }; // class TriInteger
+#endif  /* def __cplusplus */
+
+/****************************************************************************/
+/* TriArrowView class --- Arrow nullable booleans as tri-state values */
+
+#ifdef __cplusplus
+    /* TriArrowView adopts the validity and value bitmaps of an Arrow
+     * boolean array without copying (see TS_arrow_load).  A view made
+     * from const bitmaps cannot be written. */
+    class TriArrowView
+    {
+    public:
+        TriArrowView(size_t num, size_t offset,
+                     uint8_t *validity, uint8_t *values)
+            : m_num(num), m_offset(offset), m_validity(validity),
+              m_values(values), m_writable(true) { }
+        TriArrowView(size_t num, size_t offset,
+                     const uint8_t *validity, const uint8_t *values)
+            : m_num(num), m_offset(offset),
+              m_validity(const_cast<uint8_t *>(validity)),
+              m_values(const_cast<uint8_t *>(values)), m_writable(false) { }
+
+        size_t size() const {
+            return m_num;
+        }
+        size_t offset() const {
+            return m_offset;
+        }
+        const uint8_t *validity() const {
+            return m_validity;
+        }
+        const uint8_t *values() const {
+            return m_values;
+        }
+        size_t null_count() const {
+            return count(TriS::U);
+        }
+
+        TriS operator[](size_t index) const {
+            assert(index < m_num);
+            return TS_arrow_get(index, m_offset, m_validity, m_values);
+        }
+        void set(size_t index, TriS value) {
+            assert(index < m_num && m_writable);
+            TS_arrow_set(value.value(), index, m_offset, m_validity,
+                         m_values);
+        }
+
+        size_t count(TriS value) const {
+            return TS_arrow_count(value.value(), m_num, m_offset,
+                                  m_validity, m_values);
+        }
+        TRISTATE connect_and() const {
+            return TS_arrow_connect_and(m_num, m_offset, m_validity,
+                                        m_values);
+        }
+        TRISTATE connect_or() const {
+            return TS_arrow_connect_or(m_num, m_offset, m_validity,
+                                       m_values);
+        }
+        TRISTATE get_tri_totality() const {
+            TRISTATE value;
+            TS_arrow_get_tri_totality(&value, m_num, m_offset, m_validity,
+                                      m_values);
+            return value;
+        }
+
+        void each_not() {
+            assert(m_writable);
+            TS_arrow_each_not(m_num, m_offset, m_values);
+        }
+        void tri_each_and(TriS value) {
+            assert(m_writable);
+            TS_arrow_tri_each_and(value.value(), m_num, m_offset,
+                                  m_validity, m_values);
+        }
+        void tri_each_or(TriS value) {
+            assert(m_writable);
+            TS_arrow_tri_each_or(value.value(), m_num, m_offset,
+                                 m_validity, m_values);
+        }
+
+        /* conversions on request */
+        void to_tri(TRISTATE *tris) const {
+            TS_arrow_to_tri(m_num, m_offset, m_validity, m_values, tris);
+        }
+        void assign(const TRISTATE *tris) {
+            assert(m_writable);
+            TS_tri_to_arrow(m_num, tris, m_offset, m_validity, m_values);
+        }
+        template <typename T_ALLOC>
+        void to_vector(TriVector<T_ALLOC>& vec) const {
+            vec.resize(m_num);
+            if (m_num)
+            {
+                TS_arrow_to_packed(m_num, m_offset, m_validity, m_values,
+                                   vec.trues(), vec.falses());
+            }
+        }
+        template <typename T_ALLOC>
+        void assign(const TriVector<T_ALLOC>& vec) {
+            assert(m_writable && vec.size() == m_num);
+            if (m_num)
+            {
+                TS_packed_to_arrow(m_num, vec.trues(), vec.falses(),
+                                   m_offset, m_validity, m_values);
+            }
+        }
+
+    protected:
+        size_t      m_num;
+        size_t      m_offset;
+        uint8_t *   m_validity;
+        uint8_t *   m_values;
+        bool        m_writable;
+    }; // class TriArrowView
+#endif  /* def __cplusplus */
+
+/****************************************************************************/
+/* nullable comparisons --- tri-state results from nullable numbers */
+
+#ifdef __cplusplus
+    /* A comparison yields TS_UNKNOWN where either side is NULL, as in SQL.
+     * A column is NULL where its Arrow validity bitmap (if any) has a zero
+     * bit or where its value equals the sentinel (if any); a NaN sentinel
+     * makes NaN NULL.  The kernels work 64 values at a time: one pass
+     * sets the comparison bits of a block, the validity is loaded as a
+     * word, and the block is written as TRISTATE or packed values. */
+    template <typename T>
+    class TriNullable
+    {
+    public:
+        TriNullable(const T *data, const uint8_t *validity = NULL,
+                    size_t offset = 0)
+            : m_data(data), m_validity(validity), m_offset(offset),
+              m_has_sentinel(false), m_sentinel(), m_nan_sentinel(false) { }
+        TriNullable(const T *data, T sentinel)
+            : m_data(data), m_validity(NULL), m_offset(0),
+              m_has_sentinel(true), m_sentinel(sentinel),
+              m_nan_sentinel(!(sentinel == sentinel)) { }
+        TriNullable(const T *data, const uint8_t *validity, size_t offset,
+                    T sentinel)
+            : m_data(data), m_validity(validity), m_offset(offset),
+              m_has_sentinel(true), m_sentinel(sentinel),
+              m_nan_sentinel(!(sentinel == sentinel)) { }
+
+        const T& operator[](size_t index) const {
+            return m_data[index];
+        }
+        bool is_null(size_t index) const {
+            return !((known(index, 1) & 1));
+        }
+
+        /* the bits of the non-NULL values in [pos, pos + count) */
+        TS_WORD known(size_t pos, size_t count) const {
+            assert(m_data != NULL || count == 0);
+            TS_WORD bits = (m_validity ? TS_arrow_load(m_validity,
+                                                       m_offset + pos, count)
+                                       : TS_TAIL_MASK(count));
+            if (m_has_sentinel)
+            {
+                const T *block = m_data + pos;
+                TS_WORD nulls = 0;
+                for (size_t i = 0; i < count; ++i)
+                {
+                    const T& x = block[i];
+                    const bool null = (x == m_sentinel) |
+                                      (m_nan_sentinel & (x != x));
+                    nulls |= (TS_WORD)null << i;
+                }
+                bits &= ~nulls;
+            }
+            return bits;
+        }
+
+    protected:
+        const T *       m_data;
+        const uint8_t * m_validity;
+        size_t          m_offset;
+        bool            m_has_sentinel;
+        T               m_sentinel;
+        bool            m_nan_sentinel;
+    }; // class TriNullable<T>
+
+    /* one value compared against every row; a NULL one makes every
+     * result TS_UNKNOWN */
+    template <typename T>
+    class TriNullableScalar
+    {
+    public:
+        TriNullableScalar() : m_value(), m_valid(false) { }
+        TriNullableScalar(T value) : m_value(value), m_valid(true) { }
+
+        const T& operator[](size_t) const {
+            return m_value;
+        }
+        bool is_null(size_t) const {
+            return !m_valid;
+        }
+        TS_WORD known(size_t, size_t count) const {
+            return (m_valid ? TS_TAIL_MASK(count) : 0);
+        }
+
+    protected:
+        T       m_value;
+        bool    m_valid;
+    }; // class TriNullableScalar<T>
+
+    struct TS_cmp_eq {
+        template <typename T1, typename T2>
+        bool operator()(const T1& x, const T2& y) const { return x == y; }
+    };
+    struct TS_cmp_ne {
+        template <typename T1, typename T2>
+        bool operator()(const T1& x, const T2& y) const { return x != y; }
+    };
+    struct TS_cmp_lt {
+        template <typename T1, typename T2>
+        bool operator()(const T1& x, const T2& y) const { return x < y; }
+    };
+    struct TS_cmp_le {
+        template <typename T1, typename T2>
+        bool operator()(const T1& x, const T2& y) const { return x <= y; }
+    };
+    struct TS_cmp_gt {
+        template <typename T1, typename T2>
+        bool operator()(const T1& x, const T2& y) const { return x > y; }
+    };
+    struct TS_cmp_ge {
+        template <typename T1, typename T2>
+        bool operator()(const T1& x, const T2& y) const { return x >= y; }
+    };
+
+    /* the sinks take the trues and falses of each block */
+    struct TS_cmp_sink_tri {
+        TRISTATE *results;
+        void operator()(size_t base, size_t count,
+                        TS_WORD trues, TS_WORD falses) const {
+            TRISTATE *block = results + base;
+            for (size_t i = 0; i < count; ++i)
+            {
+                block[i] = (TRISTATE)((int)((trues >> i) & 1) -
+                                      (int)((falses >> i) & 1));
+            }
+        }
+    };
+    struct TS_cmp_sink_tri_and {
+        TRISTATE *verdicts;
+        void operator()(size_t base, size_t count,
+                        TS_WORD trues, TS_WORD falses) const {
+            TRISTATE *block = verdicts + base;
+            for (size_t i = 0; i < count; ++i)
+            {
+                const int value = (int)((trues >> i) & 1) -
+                                  (int)((falses >> i) & 1);
+                block[i] = (TRISTATE)(value < block[i] ? value : block[i]);
+            }
+        }
+    };
+    struct TS_cmp_sink_packed {
+        TS_WORD *trues, *falses;
+        void operator()(size_t base, size_t count,
+                        TS_WORD block_trues, TS_WORD block_falses) const {
+            const size_t k = base / TS_WORD_BITS;
+            const TS_WORD keep = ~TS_TAIL_MASK(count);
+            trues[k] = (trues[k] & keep) | block_trues;
+            falses[k] = (falses[k] & keep) | block_falses;
+        }
+    };
+    struct TS_cmp_sink_packed_and {
+        TS_WORD *trues, *falses;
+        void operator()(size_t base, size_t count,
+                        TS_WORD block_trues, TS_WORD block_falses) const {
+            const size_t k = base / TS_WORD_BITS;
+            trues[k] &= block_trues | ~TS_TAIL_MASK(count);
+            falses[k] |= block_falses;
+        }
+    };
+
+    template <typename T_OP, typename T_LEFT, typename T_RIGHT>
+    inline void
+    TS_compare_block(TS_WORD& trues, TS_WORD& falses, T_OP op,
+                     const T_LEFT& a, const T_RIGHT& b,
+                     size_t base, size_t count)
+    {
+        TS_WORD bits = 0;
+        for (size_t i = 0; i < count; ++i)
+            bits |= (TS_WORD)op(a[base + i], b[base + i]) << i;
+        const TS_WORD known = a.known(base, count) & b.known(base, count);
+        trues = known & bits;
+        falses = known & ~bits;
+    }
+
+    template <typename T_OP, typename T_LEFT, typename T_RIGHT,
+              typename T_SINK>
+    void TS_compare_run(T_OP op, size_t num, const T_LEFT& a,
+                        const T_RIGHT& b, T_SINK sink)
+    {
+        for (size_t base = 0; base < num; base += TS_WORD_BITS)
+        {
+            const size_t count = (num - base < TS_WORD_BITS ? num - base
+                                                            : TS_WORD_BITS);
+            TS_WORD trues, falses;
+            TS_compare_block(trues, falses, op, a, b, base, count);
+            sink(base, count, trues, falses);
+        }
+    }
+
+    template <typename T_LEFT, typename T_RIGHT, typename T_SINK>
+    void TS_compare_dispatch(TS_CMP op, size_t num, const T_LEFT& a,
+                             const T_RIGHT& b, T_SINK sink)
+    {
+        switch (op)
+        {
+        case TS_CMP_EQ: TS_compare_run(TS_cmp_eq(), num, a, b, sink); break;
+        case TS_CMP_NE: TS_compare_run(TS_cmp_ne(), num, a, b, sink); break;
+        case TS_CMP_LT: TS_compare_run(TS_cmp_lt(), num, a, b, sink); break;
+        case TS_CMP_LE: TS_compare_run(TS_cmp_le(), num, a, b, sink); break;
+        case TS_CMP_GT: TS_compare_run(TS_cmp_gt(), num, a, b, sink); break;
+        case TS_CMP_GE: TS_compare_run(TS_cmp_ge(), num, a, b, sink); break;
+        default:
+            assert(0);
+        }
+    }
+
+    /* value BETWEEN low AND high, that is, the Kleene AND of
+     * low <= value and value <= high */
+    template <typename T_VALUE, typename T_LOW, typename T_HIGH,
+              typename T_SINK>
+    void TS_between_run(size_t num, const T_VALUE& value, const T_LOW& low,
+                        const T_HIGH& high, T_SINK sink)
+    {
+        for (size_t base = 0; base < num; base += TS_WORD_BITS)
+        {
+            const size_t count = (num - base < TS_WORD_BITS ? num - base
+                                                            : TS_WORD_BITS);
+            TS_WORD trues1, falses1, trues2, falses2;
+            TS_compare_block(trues1, falses1, TS_cmp_le(), low, value,
+                             base, count);
+            TS_compare_block(trues2, falses2, TS_cmp_le(), value, high,
+                             base, count);
+            sink(base, count, trues1 & trues2, falses1 | falses2);
+        }
+    }
+
+    /* results[i] = a[i] op b[i] */
+    template <typename T_LEFT, typename T_RIGHT>
+    inline void
+    TS_compare_tri(TS_CMP op, size_t num, const T_LEFT& a, const T_RIGHT& b,
+                   TRISTATE *results)
+    {
+        assert(results != NULL || num == 0);
+        TS_cmp_sink_tri sink = { results };
+        TS_compare_dispatch(op, num, a, b, sink);
+    }
+    /* verdicts[i] = TS_tri_and(verdicts[i], a[i] op b[i]) */
+    template <typename T_LEFT, typename T_RIGHT>
+    inline void
+    TS_compare_tri_and(TS_CMP op, size_t num, const T_LEFT& a,
+                       const T_RIGHT& b, TRISTATE *verdicts)
+    {
+        assert(verdicts != NULL || num == 0);
+        TS_cmp_sink_tri_and sink = { verdicts };
+        TS_compare_dispatch(op, num, a, b, sink);
+    }
+    template <typename T_LEFT, typename T_RIGHT>
+    inline void
+    TS_compare_packed(TS_CMP op, size_t num, const T_LEFT& a,
+                      const T_RIGHT& b, TS_WORD *trues, TS_WORD *falses)
+    {
+        assert((trues != NULL && falses != NULL) || num == 0);
+        TS_cmp_sink_packed sink = { trues, falses };
+        TS_compare_dispatch(op, num, a, b, sink);
+    }
+    template <typename T_LEFT, typename T_RIGHT>
+    inline void
+    TS_compare_packed_and(TS_CMP op, size_t num, const T_LEFT& a,
+                          const T_RIGHT& b, TS_WORD *trues, TS_WORD *falses)
+    {
+        assert((trues != NULL && falses != NULL) || num == 0);
+        TS_cmp_sink_packed_and sink = { trues, falses };
+        TS_compare_dispatch(op, num, a, b, sink);
+    }
+
+    template <typename T_VALUE, typename T_LOW, typename T_HIGH>
+    inline void
+    TS_between_tri(size_t num, const T_VALUE& value, const T_LOW& low,
+                   const T_HIGH& high, TRISTATE *results)
+    {
+        assert(results != NULL || num == 0);
+        TS_cmp_sink_tri sink = { results };
+        TS_between_run(num, value, low, high, sink);
+    }
+    template <typename T_VALUE, typename T_LOW, typename T_HIGH>
+    inline void
+    TS_between_tri_and(size_t num, const T_VALUE& value, const T_LOW& low,
+                       const T_HIGH& high, TRISTATE *verdicts)
+    {
+        assert(verdicts != NULL || num == 0);
+        TS_cmp_sink_tri_and sink = { verdicts };
+        TS_between_run(num, value, low, high, sink);
+    }
+    template <typename T_VALUE, typename T_LOW, typename T_HIGH>
+    inline void
+    TS_between_packed(size_t num, const T_VALUE& value, const T_LOW& low,
+                      const T_HIGH& high, TS_WORD *trues, TS_WORD *falses)
+    {
+        assert((trues != NULL && falses != NULL) || num == 0);
+        TS_cmp_sink_packed sink = { trues, falses };
+        TS_between_run(num, value, low, high, sink);
+    }
+    template <typename T_VALUE, typename T_LOW, typename T_HIGH>
+    inline void
+    TS_between_packed_and(size_t num, const T_VALUE& value, const T_LOW& low,
+                          const T_HIGH& high, TS_WORD *trues,
+                          TS_WORD *falses)
+    {
+        assert((trues != NULL && falses != NULL) || num == 0);
+        TS_cmp_sink_packed_and sink = { trues, falses };
+        TS_between_run(num, value, low, high, sink);
+    }
+#endif  /* def __cplusplus */
+
+/****************************************************************************/
+/* TriMemo class --- concurrent memoization (TRISTATE_PARALLEL) */
+
+#if defined(__cplusplus) && defined(TRISTATE_PARALLEL)
+    /* TriMemo caches a boolean per index in two bits of an atomic word:
+     * not computed (TS_UNKNOWN), false, true, or in progress.  The first
+     * thread to ask for an index marks it in progress and computes it;
+     * the others wait for that result, so fn runs once per index.  If fn
+     * throws, the index goes back to not computed. */
+    class TriMemo
+    {
+    public:
+        enum { not_computed = 0, computed_false = 1, computed_true = 2,
+               in_progress = 3 };
+
+        explicit TriMemo(size_t num)
+            : m_num(num), m_words(new std::atomic<uint64_t>[words(num)]),
+              m_waiters(0)
+        {
+            clear();
+        }
+
+        size_t size() const {
+            return m_num;
+        }
+
+        int state(size_t index) const {
+            assert(index < m_num);
+            return (int)(m_words[index / 32].load() >> shift(index)) & 3;
+        }
+        /* the value, or TS_UNKNOWN while not computed or in progress */
+        TriS get(size_t index) const {
+            const int value = state(index);
+            if (value == computed_true)
+                return TriS::T;
+            if (value == computed_false)
+                return TriS::F;
+            return TriS::U;
+        }
+
+        /* the cached fn(index), computing it if no thread has */
+        template <typename T_FN>
+        bool get_or_compute(size_t index, T_FN fn) {
+            assert(index < m_num);
+            std::atomic<uint64_t>& word = m_words[index / 32];
+            const int bits = shift(index);
+            uint64_t current = word.load();
+            for (;;)
+            {
+                const int value = (int)(current >> bits) & 3;
+                if (value == computed_true || value == computed_false)
+                    return value == computed_true;
+                if (value == in_progress)
+                {
+                    wait(index);
+                    current = word.load();
+                    continue;
+                }
+                if (word.compare_exchange_weak(current, current |
+                        ((uint64_t)in_progress << bits)))
+                {
+                    break;
+                }
+            }
+            bool result;
+            try
+            {
+                result = fn(index);
+            }
+            catch (...)
+            {
+                word.fetch_and(~((uint64_t)in_progress << bits));
+                wake();
+                throw;
+            }
+            /* in_progress has both bits; clear the other one */
+            const uint64_t other = (result ? computed_false : computed_true);
+            word.fetch_and(~(other << bits));
+            wake();
+            return result;
+        }
+
+        /* stores a value if none is stored or in progress */
+        bool try_set(size_t index, bool value) {
+            assert(index < m_num);
+            std::atomic<uint64_t>& word = m_words[index / 32];
+            const int bits = shift(index);
+            const uint64_t mask = (uint64_t)3 << bits;
+            uint64_t current = word.load();
+            while ((current & mask) == 0)
+            {
+                const uint64_t next = (value ? computed_true
+                                             : computed_false);
+                if (word.compare_exchange_weak(current,
+                                               current | (next << bits)))
+                {
+                    return true;
+                }
+            }
+            return false;
+        }
+        /* forgets a computed value; one in progress is kept */
+        bool reset(size_t index) {
+            assert(index < m_num);
+            std::atomic<uint64_t>& word = m_words[index / 32];
+            const int bits = shift(index);
+            const uint64_t mask = (uint64_t)3 << bits;
+            uint64_t current = word.load();
+            for (;;)
+            {
+                const uint64_t value = (current & mask) >> bits;
+                if (value == not_computed || value == in_progress)
+                    return false;
+                if (word.compare_exchange_weak(current, current & ~mask))
+                    return true;
+            }
+        }
+        /* not while other threads use the memo */
+        void clear() {
+            for (size_t i = 0; i < words(m_num); ++i)
+                m_words[i] = 0;
+        }
+
+        size_t count_computed() const {
+            const uint64_t low = 0x5555555555555555ULL;
+            size_t count = 0;
+            for (size_t i = 0; i < words(m_num); ++i)
+            {
+                const uint64_t word = m_words[i].load();
+                count += TS_popcount((word ^ (word >> 1)) & low);
+            }
+            return count;
+        }
+        /* TS_UNKNOWN where not computed */
+        void to_tri(TRISTATE *tris) const {
+            for (size_t i = 0; i < m_num; ++i)
+                tris[i] = get(i).value();
+        }
+
+    protected:
+        size_t                                      m_num;
+        std::unique_ptr<std::atomic<uint64_t>[]>    m_words;
+        mutable std::atomic<size_t>                 m_waiters;
+        mutable std::mutex                          m_mutex;
+        mutable std::condition_variable             m_done;
+
+        static size_t words(size_t num) {
+            return (num + 31) / 32 + (num == 0);
+        }
+        static int shift(size_t index) {
+            return (int)(index % 32) * 2;
+        }
+
+        /* waiters sleep on one condition, woken when any index finishes.
+         * A finisher sees the waiter count or the waiter sees the result,
+         * since both sides are sequentially consistent. */
+        void wait(size_t index) const {
+            ++m_waiters;
+            {
+                std::unique_lock<std::mutex> lock(m_mutex);
+                while (state(index) == in_progress)
+                    m_done.wait(lock);
+            }
+            --m_waiters;
+        }
+        void wake() {
+            if (m_waiters.load())
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_done.notify_all();
+            }
+        }
+
+    private:
+        TriMemo(const TriMemo&);
+        TriMemo& operator=(const TriMemo&);
+    }; // class TriMemo
+
+    /* TriHashMemo keys a TriMemo by value: an open-addressing table of
+     * at least twice capacity slots, so capacity keys leave it at most
+     * half full.  A key slot is claimed by compare-and-swap and read
+     * once published, so lookups do not lock.
+     * T_KEY must be default-constructible and comparable. */
+    template <typename T_KEY, typename T_HASH = TriHash>
+    class TriHashMemo
+    {
+    public:
+        explicit TriHashMemo(size_t capacity, const T_HASH& hash = T_HASH())
+            : m_mask(table_size(capacity) - 1), m_hash(hash),
+              m_keys(new T_KEY[m_mask + 1]),
+              m_key_states(new std::atomic<unsigned char>[m_mask + 1]),
+              m_values(m_mask + 1), m_count(0)
+        {
+            for (size_t i = 0; i <= m_mask; ++i)
+                m_key_states[i] = key_empty;
+        }
+
+        /* the number of keys */
+        size_t size() const {
+            return m_count.load();
+        }
+
+        TriS get(const T_KEY& key) const {
+            size_t slot;
+            if (!find(key, slot))
+                return TriS::U;
+            return m_values.get(slot);
+        }
+
+        /* the cached fn(key).  Once every slot holds a key, a new key
+         * is not cached but computed on every call. */
+        template <typename T_FN>
+        bool get_or_compute(const T_KEY& key, T_FN fn) {
+            size_t slot;
+            if (!insert(key, slot))
+                return fn(key);
+            return m_values.get_or_compute(slot, [&](size_t) {
+                return fn(key);
+            });
+        }
+
+    protected:
+        enum { key_empty, key_writing, key_ready };
+
+        size_t                                          m_mask;
+        T_HASH                                          m_hash;
+        std::unique_ptr<T_KEY[]>                        m_keys;
+        std::unique_ptr<std::atomic<unsigned char>[]>   m_key_states;
+        TriMemo                                         m_values;
+        std::atomic<size_t>                             m_count;
+
+        static size_t table_size(size_t capacity) {
+            size_t size = 2;
+            while (size < 2 * capacity)
+                size *= 2;
+            return size;
+        }
+
+        /* the state of a slot once no one is writing its key */
+        unsigned char settled(size_t slot) const {
+            unsigned char state = m_key_states[slot].load();
+            while (state == key_writing)
+            {
+                std::this_thread::yield();
+                state = m_key_states[slot].load();
+            }
+            return state;
+        }
+
+        bool find(const T_KEY& key, size_t& slot) const {
+            size_t i = (size_t)m_hash(key) & m_mask;
+            for (size_t probe = 0; probe <= m_mask; ++probe)
+            {
+                if (settled(i) == key_empty)
+                    return false;
+                if (m_keys[i] == key)
+                {
+                    slot = i;
+                    return true;
+                }
+                i = (i + 1) & m_mask;
+            }
+            return false;
+        }
+        bool insert(const T_KEY& key, size_t& slot) {
+            size_t i = (size_t)m_hash(key) & m_mask;
+            for (size_t probe = 0; probe <= m_mask; ++probe)
+            {
+                unsigned char state = key_empty;
+                if (m_key_states[i].compare_exchange_strong(state,
+                                                            key_writing))
+                {
+                    m_keys[i] = key;
+                    m_key_states[i] = key_ready;
+                    ++m_count;
+                    slot = i;
+                    return true;
+                }
+                if (settled(i) == key_ready && m_keys[i] == key)
+                {
+                    slot = i;
+                    return true;
+                }
+                i = (i + 1) & m_mask;
+            }
+            return false;
+        }
+
+    private:
+        TriHashMemo(const TriHashMemo&);
+        TriHashMemo& operator=(const TriHashMemo&);
+    }; // class TriHashMemo<T_KEY, T_HASH>
+#endif  /* def __cplusplus && def TRISTATE_PARALLEL */
 
 /****************************************************************************/
 /* inline functions */
@@ -32,6 +32,78 @@ TS_is_valid_tri(TRISTATE value)
     }
 }
 
+/* The TS_find_invalid_... functions OR a branch-free test over blocks of
+ * 64 elements, so that the compiler can vectorize them, and look for
+ * the exact index only in a block which has an invalid element. */
+
+TRISTATE_INLINE size_t
+TS_find_invalid_bool(size_t num, const bool *values)
+{
+    assert(values != NULL || num == 0);
+    if (sizeof(bool) != 1)
+    {
+        for (size_t i = 0; i < num; ++i)
+        {
+            if (!TS_is_valid_bool(values[i]))
+                return i;
+        }
+        return num;
+    }
+    const unsigned char *bytes = (const unsigned char *)values;
+    for (size_t i = 0; i < num; i += 64)
+    {
+        unsigned char bad = 0;
+        if (num - i >= 64)
+        {
+            for (size_t k = 0; k < 64; ++k)
+                bad |= bytes[i + k] & 0xFE;
+        }
+        else
+        {
+            for (size_t k = i; k < num; ++k)
+                bad |= bytes[k] & 0xFE;
+        }
+        if (bad)
+        {
+            while (bytes[i] <= 1)
+                ++i;
+            return i;
+        }
+    }
+    return num;
+}
+
+TRISTATE_INLINE size_t
+TS_find_invalid_tri(size_t num, const TRISTATE *values)
+{
+    assert(values != NULL || num == 0);
+    for (size_t i = 0; i < num; i += 64)
+    {
+        unsigned int bad = 0;
+        if (num - i >= 64)
+        {
+            for (size_t k = 0; k < 64; ++k)
+            {
+                /* u is 0, 1 or 2 for a valid value */
+                const unsigned int u = (unsigned int)((int)values[i + k] + 1);
+                bad |= (u | (u + 1)) & ~3U;
+            }
+        }
+        else
+        {
+            for (size_t k = i; k < num; ++k)
+                bad |= !TS_is_valid_tri(values[k]);
+        }
+        if (bad)
+        {
+            while (TS_is_valid_tri(values[i]))
+                ++i;
+            return i;
+        }
+    }
+    return num;
+}
+
 TRISTATE_INLINE TRISTATE
 TS_from_bool(bool value)
 {
@@ -46,6 +118,9 @@ TS_to_bool(TRISTATE value, bool *flag)
 {
 #ifdef TRISTATE_STRICT
     assert(TS_is_valid_tri(value));
+#endif
+#ifdef TRISTATE_INSTRUMENT
+    TS_instr_to_bool(value);
 #endif
     if (value < 0)
     {
@@ -115,15 +190,12 @@ TS_bool_to_tri(size_t num, const bool *bools, TRISTATE *tris)
 {
     assert(bools != NULL || num == 0);
     assert(tris != NULL || num == 0);
-    while (num-- > 0)
-    {
-#ifdef TRISTATE_STRICT
-        assert(TS_is_valid_bool(*bools));
-#endif
-        *tris = TS_from_bool(*bools);
 #ifdef TRISTATE_STRICT
-        assert(TS_is_valid_tri(*tris));
+    assert(TS_find_invalid_bool(num, bools) == num);
 #endif
+    while (num-- > 0)
+    {
+        *tris = (*bools ? TS_TRUE : TS_FALSE);
         ++bools;
         ++tris;
     }
@@ -131,18 +203,24 @@ TS_bool_to_tri(size_t num, const bool *bools, TRISTATE *tris)
 
 TRISTATE_INLINE void
 TS_tri_to_bool(size_t num, const TRISTATE *tris, bool *bools)
+{
+#ifdef TRISTATE_STRICT
+    assert(TS_find_invalid_tri(num, tris) == num);
+#endif
+    TS_tri_to_bool_unchecked(num, tris, bools);
+}
+
+TRISTATE_INLINE void
+TS_tri_to_bool_unchecked(size_t num, const TRISTATE *tris, bool *bools)
 {
     assert(tris != NULL || num == 0);
     assert(bools != NULL || num == 0);
     while (num-- > 0)
     {
-#ifdef TRISTATE_STRICT
-        assert(TS_is_valid_tri(*tris));
-#endif
-        TS_to_bool(*tris, bools);
-#ifdef TRISTATE_STRICT
-        assert(TS_is_valid_bool(*bools));
+#ifdef TRISTATE_INSTRUMENT
+        TS_instr_to_bool(*tris);
 #endif
+        *bools = ((*tris > 0) | ((*tris == 0) & *bools)) != 0;
         ++tris;
         ++bools;
     }
@@ -151,18 +229,23 @@ TS_tri_to_bool(size_t num, const TRISTATE *tris, bool *bools)
 TRISTATE_INLINE void
 TS_tri_to_bool_def(size_t num, const TRISTATE *tris, bool *bools,
                    bool default_value)
+{
+#ifdef TRISTATE_STRICT
+    assert(TS_find_invalid_tri(num, tris) == num);
+    assert(TS_is_valid_bool(default_value));
+#endif
+    TS_tri_to_bool_def_unchecked(num, tris, bools, default_value);
+}
+
+TRISTATE_INLINE void
+TS_tri_to_bool_def_unchecked(size_t num, const TRISTATE *tris, bool *bools,
+                             bool default_value)
 {
     assert(tris != NULL || num == 0);
     assert(bools != NULL || num == 0);
     while (num-- > 0)
     {
-#ifdef TRISTATE_STRICT
-        assert(TS_is_valid_tri(*tris));
-#endif
-        TS_to_bool_def(*tris, bools, default_value);
-#ifdef TRISTATE_STRICT
-        assert(TS_is_valid_bool(*bools));
-#endif
+        *bools = (*tris ? *tris > 0 : default_value);
         ++tris;
         ++bools;
     }
@@ -357,13 +440,13 @@ TS_get_tri_totality(TRISTATE *value, size_t num, const bool *values)
 {
     assert(value != NULL);
     assert(values != NULL || num == 0);
+#ifdef TRISTATE_STRICT
+    assert(TS_find_invalid_bool(num, values) == num);
+#endif
     bool are_false = true;
     bool are_true = true;
     while (num-- > 0)
     {
-#ifdef TRISTATE_STRICT
-        assert(TS_is_valid_bool(*values));
-#endif
         if (*values)
             are_false = false;
         else
@@ -405,6 +488,16 @@ TS_set_tri_totality(TRISTATE value, size_t num, bool *values)
 
 TRISTATE_INLINE void
 TS_get_totality_tri(bool *value, size_t num, const TRISTATE *values)
+{
+#ifdef TRISTATE_STRICT
+    assert(TS_find_invalid_tri(num, values) == num);
+#endif
+    TS_get_totality_tri_unchecked(value, num, values);
+}
+
+TRISTATE_INLINE void
+TS_get_totality_tri_unchecked(bool *value, size_t num,
+                              const TRISTATE *values)
 {
     assert(value != NULL);
     assert(values != NULL || num == 0);
@@ -412,13 +505,8 @@ TS_get_totality_tri(bool *value, size_t num, const TRISTATE *values)
     bool are_true = true;
     while (num-- > 0)
     {
-#ifdef TRISTATE_STRICT
-        assert(TS_is_valid_tri(*values));
-#endif
-        if (*values < 0)
-            are_true = false;
-        else if (*values > 0)
-            are_false = false;
+        are_true &= (*values >= 0);
+        are_false &= (*values <= 0);
         ++values;
     }
     if (are_false == are_true)
@@ -446,6 +534,16 @@ TS_set_totality_tri(bool value, size_t num, TRISTATE *values)
 
 TRISTATE_INLINE void
 TS_get_tri_totality_tri(TRISTATE *value, size_t num, const TRISTATE *values)
+{
+#ifdef TRISTATE_STRICT
+    assert(TS_find_invalid_tri(num, values) == num);
+#endif
+    TS_get_tri_totality_tri_unchecked(value, num, values);
+}
+
+TRISTATE_INLINE void
+TS_get_tri_totality_tri_unchecked(TRISTATE *value, size_t num,
+                                  const TRISTATE *values)
 {
     assert(value != NULL);
     assert(values != NULL || num == 0);
@@ -453,13 +551,8 @@ TS_get_tri_totality_tri(TRISTATE *value, size_t num, const TRISTATE *values)
     bool are_true = true;
     while (num-- > 0)
     {
-#ifdef TRISTATE_STRICT
-        assert(TS_is_valid_tri(*values));
-#endif
-        if (*values < 0)
-            are_true = false;
-        else if (*values > 0)
-            are_false = false;
+        are_true &= (*values >= 0);
+        are_false &= (*values <= 0);
         ++values;
     }
     if (are_false == are_true)
@@ -475,6 +568,26 @@ TS_get_tri_totality_tri(TRISTATE *value, size_t num, const TRISTATE *values)
 #endif
 }
 
+TRISTATE_INLINE void
+TS_count_tri(size_t *trues, size_t *falses, size_t *unknowns,
+             size_t num, const TRISTATE *values)
+{
+    assert(trues != NULL && falses != NULL && unknowns != NULL);
+    assert(values != NULL || num == 0);
+#ifdef TRISTATE_STRICT
+    assert(TS_find_invalid_tri(num, values) == num);
+#endif
+    size_t t = 0, f = 0;
+    for (size_t i = 0; i < num; ++i)
+    {
+        t += (values[i] > 0);
+        f += (values[i] < 0);
+    }
+    *trues = t;
+    *falses = f;
+    *unknowns = num - t - f;
+}
+
 TRISTATE_INLINE void
 TS_set_tri_totality_tri(TRISTATE value, size_t num, TRISTATE *values)
 {
@@ -529,15 +642,12 @@ TRISTATE_INLINE void
 TS_each_not(size_t num, bool *values)
 {
     assert(values != NULL || num == 0);
-    while (num-- > 0)
-    {
 #ifdef TRISTATE_STRICT
-        assert(TS_is_valid_bool(*values));
+    assert(TS_find_invalid_bool(num, values) == num);
 #endif
+    while (num-- > 0)
+    {
         *values = !*values;
-#ifdef TRISTATE_STRICT
-        assert(TS_is_valid_bool(*values));
-#endif
         ++values;
     }
 }
@@ -573,10 +683,17 @@ TS_each_or_tri(bool value, size_t num, TRISTATE *values)
 TRISTATE_INLINE void
 TS_tri_each_and_tri(TRISTATE value, size_t num, TRISTATE *values)
 {
-    assert(values != NULL || num == 0);
 #ifdef TRISTATE_STRICT
     assert(TS_is_valid_tri(value));
+    assert(TS_find_invalid_tri(num, values) == num);
 #endif
+    TS_tri_each_and_tri_unchecked(value, num, values);
+}
+
+TRISTATE_INLINE void
+TS_tri_each_and_tri_unchecked(TRISTATE value, size_t num, TRISTATE *values)
+{
+    assert(values != NULL || num == 0);
     if (value > 0)
         return;
 
@@ -588,13 +705,7 @@ TS_tri_each_and_tri(TRISTATE value, size_t num, TRISTATE *values)
 
     while (num-- > 0)
     {
-#ifdef TRISTATE_STRICT
-        assert(TS_is_valid_tri(*values));
-#endif
-        *values = TS_tri_and(*values, value);
-#ifdef TRISTATE_STRICT
-        assert(TS_is_valid_tri(*values));
-#endif
+        *values = (*values < 0 ? *values : TS_UNKNOWN);
         ++values;
     }
 }
@@ -602,10 +713,17 @@ TS_tri_each_and_tri(TRISTATE value, size_t num, TRISTATE *values)
 TRISTATE_INLINE void
 TS_tri_each_or_tri(TRISTATE value, size_t num, TRISTATE *values)
 {
-    assert(values != NULL || num == 0);
 #ifdef TRISTATE_STRICT
     assert(TS_is_valid_tri(value));
+    assert(TS_find_invalid_tri(num, values) == num);
 #endif
+    TS_tri_each_or_tri_unchecked(value, num, values);
+}
+
+TRISTATE_INLINE void
+TS_tri_each_or_tri_unchecked(TRISTATE value, size_t num, TRISTATE *values)
+{
+    assert(values != NULL || num == 0);
     if (value > 0)
     {
         TS_set_totality_tri(true, num, values);
@@ -617,43 +735,213 @@ TS_tri_each_or_tri(TRISTATE value, size_t num, TRISTATE *values)
 
     while (num-- > 0)
     {
+        *values = (*values > 0 ? *values : TS_UNKNOWN);
+        ++values;
+    }
+}
+
+TRISTATE_INLINE void
+TS_each_not_tri(size_t num, TRISTATE *values)
+{
+#ifdef TRISTATE_STRICT
+    assert(TS_find_invalid_tri(num, values) == num);
+#endif
+    TS_each_not_tri_unchecked(num, values);
+}
+
+TRISTATE_INLINE void
+TS_each_not_tri_unchecked(size_t num, TRISTATE *values)
+{
+    assert(values != NULL || num == 0);
+    while (num-- > 0)
+    {
+        *values = (TRISTATE)-*values;
+        ++values;
+    }
+}
+
+/* The masked functions select between the old and the new value of each
+ * element without branches, a word of the mask at a time, and skip the
+ * words with no bit set.  AND is min and OR is max. */
+TRISTATE_INLINE void
+TS_tri_each_and_tri_masked(TRISTATE value, size_t num, TRISTATE *values,
+                           const TS_WORD *mask)
+{
+    assert(values != NULL || num == 0);
+    assert(mask != NULL || num == 0);
 #ifdef TRISTATE_STRICT
-        assert(TS_is_valid_tri(*values));
+    assert(TS_is_valid_tri(value));
+    assert(TS_find_invalid_tri(num, values) == num);
 #endif
-        *values = TS_tri_or(*values, value);
+    if (value > 0)
+        return;
+    for (size_t base = 0; base < num; base += TS_WORD_BITS)
+    {
+        const TS_WORD bits = mask[base / TS_WORD_BITS];
+        if (!bits)
+            continue;
+        const size_t count = (num - base < TS_WORD_BITS ? num - base
+                                                        : TS_WORD_BITS);
+        TRISTATE *block = values + base;
+        for (size_t i = 0; i < count; ++i)
+        {
+            const TRISTATE old = block[i];
+            block[i] = (((bits >> i) & 1) && old > value ? value : old);
+        }
+    }
+}
+
+TRISTATE_INLINE void
+TS_tri_each_or_tri_masked(TRISTATE value, size_t num, TRISTATE *values,
+                          const TS_WORD *mask)
+{
+    assert(values != NULL || num == 0);
+    assert(mask != NULL || num == 0);
 #ifdef TRISTATE_STRICT
-        assert(TS_is_valid_tri(*values));
+    assert(TS_is_valid_tri(value));
+    assert(TS_find_invalid_tri(num, values) == num);
 #endif
-        ++values;
+    if (value < 0)
+        return;
+    for (size_t base = 0; base < num; base += TS_WORD_BITS)
+    {
+        const TS_WORD bits = mask[base / TS_WORD_BITS];
+        if (!bits)
+            continue;
+        const size_t count = (num - base < TS_WORD_BITS ? num - base
+                                                        : TS_WORD_BITS);
+        TRISTATE *block = values + base;
+        for (size_t i = 0; i < count; ++i)
+        {
+            const TRISTATE old = block[i];
+            block[i] = (((bits >> i) & 1) && old < value ? value : old);
+        }
     }
 }
 
 TRISTATE_INLINE void
-TS_each_not_tri(size_t num, TRISTATE *values)
+TS_each_not_tri_masked(size_t num, TRISTATE *values, const TS_WORD *mask)
 {
     assert(values != NULL || num == 0);
-    while (num-- > 0)
+    assert(mask != NULL || num == 0);
+#ifdef TRISTATE_STRICT
+    assert(TS_find_invalid_tri(num, values) == num);
+#endif
+    for (size_t base = 0; base < num; base += TS_WORD_BITS)
+    {
+        const TS_WORD bits = mask[base / TS_WORD_BITS];
+        if (!bits)
+            continue;
+        const size_t count = (num - base < TS_WORD_BITS ? num - base
+                                                        : TS_WORD_BITS);
+        TRISTATE *block = values + base;
+        for (size_t i = 0; i < count; ++i)
+        {
+            const TRISTATE old = block[i];
+            block[i] = (((bits >> i) & 1) ? (TRISTATE)-old : old);
+        }
+    }
+}
+
+TRISTATE_INLINE void
+TS_reset_tri_totality_tri_masked(TRISTATE value, size_t num,
+                                 TRISTATE *values, const TS_WORD *mask)
+{
+    assert(values != NULL || num == 0);
+    assert(mask != NULL || num == 0);
+#ifdef TRISTATE_STRICT
+    assert(TS_is_valid_tri(value));
+#endif
+    for (size_t base = 0; base < num; base += TS_WORD_BITS)
+    {
+        const TS_WORD bits = mask[base / TS_WORD_BITS];
+        if (!bits)
+            continue;
+        const size_t count = (num - base < TS_WORD_BITS ? num - base
+                                                        : TS_WORD_BITS);
+        TRISTATE *block = values + base;
+        for (size_t i = 0; i < count; ++i)
+            block[i] = (((bits >> i) & 1) ? value : block[i]);
+    }
+}
+
+TRISTATE_INLINE void
+TS_tri_each_and_tri_indexed(TRISTATE value, size_t num_indices,
+                            const size_t *indices, TRISTATE *values)
+{
+    assert(indices != NULL || num_indices == 0);
+    assert(values != NULL || num_indices == 0);
+#ifdef TRISTATE_STRICT
+    assert(TS_is_valid_tri(value));
+#endif
+    for (size_t i = 0; i < num_indices; ++i)
     {
+        TRISTATE *target = values + indices[i];
+#ifdef TRISTATE_STRICT
+        assert(TS_is_valid_tri(*target));
+#endif
+        *target = (*target > value ? value : *target);
+    }
+}
+
+TRISTATE_INLINE void
+TS_tri_each_or_tri_indexed(TRISTATE value, size_t num_indices,
+                           const size_t *indices, TRISTATE *values)
+{
+    assert(indices != NULL || num_indices == 0);
+    assert(values != NULL || num_indices == 0);
 #ifdef TRISTATE_STRICT
-        assert(TS_is_valid_tri(*values));
+    assert(TS_is_valid_tri(value));
 #endif
-        *values = TS_tri_not(*values);
+    for (size_t i = 0; i < num_indices; ++i)
+    {
+        TRISTATE *target = values + indices[i];
 #ifdef TRISTATE_STRICT
-        assert(TS_is_valid_tri(*values));
+        assert(TS_is_valid_tri(*target));
 #endif
-        ++values;
+        *target = (*target < value ? value : *target);
+    }
+}
+
+TRISTATE_INLINE void
+TS_each_not_tri_indexed(size_t num_indices, const size_t *indices,
+                        TRISTATE *values)
+{
+    assert(indices != NULL || num_indices == 0);
+    assert(values != NULL || num_indices == 0);
+    for (size_t i = 0; i < num_indices; ++i)
+    {
+        TRISTATE *target = values + indices[i];
+#ifdef TRISTATE_STRICT
+        assert(TS_is_valid_tri(*target));
+#endif
+        *target = (TRISTATE)-*target;
     }
 }
 
+TRISTATE_INLINE void
+TS_reset_tri_totality_tri_indexed(TRISTATE value, size_t num_indices,
+                                  const size_t *indices, TRISTATE *values)
+{
+    assert(indices != NULL || num_indices == 0);
+    assert(values != NULL || num_indices == 0);
+#ifdef TRISTATE_STRICT
+    assert(TS_is_valid_tri(value));
+#endif
+    for (size_t i = 0; i < num_indices; ++i)
+        values[indices[i]] = value;
+}
+
 TRISTATE_INLINE bool
 TS_connect_and(size_t num, const bool *values)
 {
+    assert(values != NULL || num == 0);
+#ifdef TRISTATE_STRICT
+    assert(TS_find_invalid_bool(num, values) == num);
+#endif
     bool value = true;
     while (num-- > 0)
     {
-#ifdef TRISTATE_STRICT
-        assert(TS_is_valid_bool(*values));
-#endif
         value = *values;
         if (!value)
             break;
@@ -665,12 +953,13 @@ TS_connect_and(size_t num, const bool *values)
 TRISTATE_INLINE bool
 TS_connect_or(size_t num, const bool *values)
 {
+    assert(values != NULL || num == 0);
+#ifdef TRISTATE_STRICT
+    assert(TS_find_invalid_bool(num, values) == num);
+#endif
     bool value = false;
     while (num-- > 0)
     {
-#ifdef TRISTATE_STRICT
-        assert(TS_is_valid_bool(*values));
-#endif
         value = *values;
         if (value)
             break;
@@ -682,43 +971,1858 @@ TS_connect_or(size_t num, const bool *values)
 TRISTATE_INLINE TRISTATE
 TS_connect_and_tri(size_t num, const TRISTATE *values)
 {
+#ifdef TRISTATE_STRICT
+    assert(TS_find_invalid_tri(num, values) == num);
+#endif
+    return TS_connect_and_tri_unchecked(num, values);
+}
+
+TRISTATE_INLINE TRISTATE
+TS_connect_and_tri_unchecked(size_t num, const TRISTATE *values)
+{
+    assert(values != NULL || num == 0);
     TRISTATE value = TS_TRUE;
+#ifdef TRISTATE_INSTRUMENT
+    const TRISTATE *first = values;
+    size_t unknowns = 0;
+#endif
     while (num-- > 0)
     {
-#ifdef TRISTATE_STRICT
-        assert(TS_is_valid_tri(*values));
-#endif
-        value = TS_tri_and(value, *values);
-#ifdef TRISTATE_STRICT
-        assert(TS_is_valid_tri(value));
+#ifdef TRISTATE_INSTRUMENT
+        unknowns += (*values == TS_UNKNOWN);
 #endif
+        value = (*values < value ? *values : value);
         if (value < 0)
             break;
         ++values;
     }
+#ifdef TRISTATE_INSTRUMENT
+    TS_instr_connect(false, values - first + (value < 0), unknowns,
+                     num != 0 && num != (size_t)-1);
+#endif
     return value;
 }
 
 TRISTATE_INLINE TRISTATE
 TS_connect_or_tri(size_t num, const TRISTATE *values)
 {
+#ifdef TRISTATE_STRICT
+    assert(TS_find_invalid_tri(num, values) == num);
+#endif
+    return TS_connect_or_tri_unchecked(num, values);
+}
+
+TRISTATE_INLINE TRISTATE
+TS_connect_or_tri_unchecked(size_t num, const TRISTATE *values)
+{
+    assert(values != NULL || num == 0);
     TRISTATE value = TS_FALSE;
+#ifdef TRISTATE_INSTRUMENT
+    const TRISTATE *first = values;
+    size_t unknowns = 0;
+#endif
     while (num-- > 0)
     {
-#ifdef TRISTATE_STRICT
-        assert(TS_is_valid_tri(*values));
-#endif
-        value = TS_tri_or(value, *values);
-#ifdef TRISTATE_STRICT
-        assert(TS_is_valid_tri(value));
+#ifdef TRISTATE_INSTRUMENT
+        unknowns += (*values == TS_UNKNOWN);
 #endif
+        value = (*values > value ? *values : value);
         if (value > 0)
             break;
         ++values;
     }
+#ifdef TRISTATE_INSTRUMENT
+    TS_instr_connect(true, values - first + (value > 0), unknowns,
+                     num != 0 && num != (size_t)-1);
+#endif
     return value;
 }
 
+/****************************************************************************/
+/* bitsets */
+
+TRISTATE_INLINE int
+TS_popcount(TS_WORD word)
+{
+#if defined(__GNUC__) || defined(__clang__)
+    return __builtin_popcountll(word);
+#else
+    word = word - ((word >> 1) & 0x5555555555555555ULL);
+    word = (word & 0x3333333333333333ULL) +
+           ((word >> 2) & 0x3333333333333333ULL);
+    word = (word + (word >> 4)) & 0x0F0F0F0F0F0F0F0FULL;
+    return (int)((word * 0x0101010101010101ULL) >> 56);
+#endif
+}
+
+TRISTATE_INLINE int
+TS_ctz(TS_WORD word)
+{
+    assert(word != 0);
+#if defined(__GNUC__) || defined(__clang__)
+    return __builtin_ctzll(word);
+#else
+    return TS_popcount((word & (0 - word)) - 1);
+#endif
+}
+
+TRISTATE_INLINE bool
+TS_bits_get(size_t index, const TS_WORD *bits)
+{
+    assert(bits != NULL);
+    return ((bits[index / TS_WORD_BITS] >> (index % TS_WORD_BITS)) & 1) != 0;
+}
+
+TRISTATE_INLINE void
+TS_bits_set(bool value, size_t index, TS_WORD *bits)
+{
+    assert(bits != NULL);
+#ifdef TRISTATE_STRICT
+    assert(TS_is_valid_bool(value));
+#endif
+    const TS_WORD bit = (TS_WORD)1 << (index % TS_WORD_BITS);
+    if (value)
+        bits[index / TS_WORD_BITS] |= bit;
+    else
+        bits[index / TS_WORD_BITS] &= ~bit;
+}
+
+TRISTATE_INLINE size_t
+TS_bits_count(size_t num, const TS_WORD *bits)
+{
+    assert(bits != NULL || num == 0);
+    size_t count = 0;
+    const size_t full = num / TS_WORD_BITS;
+    for (size_t i = 0; i < full; ++i)
+        count += TS_popcount(bits[i]);
+    if (num % TS_WORD_BITS)
+        count += TS_popcount(bits[full] & TS_TAIL_MASK(num));
+    return count;
+}
+
+TRISTATE_INLINE void
+TS_bool_to_bits(size_t num, const bool *bools, TS_WORD *bits)
+{
+    assert(bools != NULL || num == 0);
+    assert(bits != NULL || num == 0);
+#ifdef TRISTATE_STRICT
+    assert(TS_find_invalid_bool(num, bools) == num);
+#endif
+    while (num > 0)
+    {
+        const size_t count = (num < TS_WORD_BITS ? num : TS_WORD_BITS);
+        TS_WORD word = 0;
+        for (size_t i = 0; i < count; ++i)
+        {
+            word |= (TS_WORD)(bools[i] ? 1 : 0) << i;
+        }
+        if (count < TS_WORD_BITS)
+            word |= *bits & ~TS_TAIL_MASK(count);
+        *bits++ = word;
+        bools += count;
+        num -= count;
+    }
+}
+
+TRISTATE_INLINE void
+TS_bits_to_bool(size_t num, const TS_WORD *bits, bool *bools)
+{
+    assert(bits != NULL || num == 0);
+    assert(bools != NULL || num == 0);
+    for (size_t i = 0; i < num; ++i)
+    {
+        bools[i] = ((bits[i / TS_WORD_BITS] >> (i % TS_WORD_BITS)) & 1) != 0;
+    }
+}
+
+TRISTATE_INLINE void
+TS_bits_to_tri(size_t num, const TS_WORD *bits, TRISTATE *tris)
+{
+    assert(bits != NULL || num == 0);
+    assert(tris != NULL || num == 0);
+    for (size_t i = 0; i < num; ++i)
+    {
+        tris[i] = (((bits[i / TS_WORD_BITS] >> (i % TS_WORD_BITS)) & 1) ?
+                   TS_TRUE : TS_FALSE);
+    }
+}
+
+TRISTATE_INLINE void
+TS_bits_get_totality(bool *value, size_t num, const TS_WORD *bits)
+{
+    assert(value != NULL);
+    assert(bits != NULL || num == 0);
+    TRISTATE state;
+    TS_bits_get_tri_totality(&state, num, bits);
+    if (state < 0)
+        *value = false;
+    if (state > 0)
+        *value = true;
+}
+
+TRISTATE_INLINE void
+TS_bits_set_totality(bool value, size_t num, TS_WORD *bits)
+{
+    assert(bits != NULL || num == 0);
+#ifdef TRISTATE_STRICT
+    assert(TS_is_valid_bool(value));
+#endif
+    const TS_WORD word = (value ? ~(TS_WORD)0 : 0);
+    const size_t full = num / TS_WORD_BITS;
+    for (size_t i = 0; i < full; ++i)
+        bits[i] = word;
+    if (num % TS_WORD_BITS)
+    {
+        const TS_WORD mask = TS_TAIL_MASK(num);
+        bits[full] = (bits[full] & ~mask) | (word & mask);
+    }
+}
+
+TRISTATE_INLINE void
+TS_bits_get_tri_totality(TRISTATE *value, size_t num, const TS_WORD *bits)
+{
+    assert(value != NULL);
+    assert(bits != NULL || num == 0);
+    bool are_false = true;
+    bool are_true = true;
+    const size_t words = TS_WORDS(num);
+    for (size_t i = 0; i < words; ++i)
+    {
+        const TS_WORD mask = (i + 1 < words ? ~(TS_WORD)0 : TS_TAIL_MASK(num));
+        const TS_WORD word = bits[i] & mask;
+        if (word != 0)
+            are_false = false;
+        if (word != mask)
+            are_true = false;
+        if (!are_false && !are_true)
+            break;
+    }
+    if (are_false == are_true)
+        *value = TS_UNKNOWN;
+    else if (are_false)
+        *value = TS_FALSE;
+    else
+        *value = TS_TRUE;
+}
+
+TRISTATE_INLINE void
+TS_bits_set_tri_totality(TRISTATE value, size_t num, TS_WORD *bits)
+{
+#ifdef TRISTATE_STRICT
+    assert(TS_is_valid_tri(value));
+#endif
+    assert(bits != NULL || num == 0);
+    if (value < 0)
+    {
+        TS_bits_set_totality(false, num, bits);
+    }
+    else if (value > 0)
+    {
+        TS_bits_set_totality(true, num, bits);
+    }
+}
+
+TRISTATE_INLINE void
+TS_bits_each_and(bool value, size_t num, TS_WORD *bits)
+{
+    assert(bits != NULL || num == 0);
+#ifdef TRISTATE_STRICT
+    assert(TS_is_valid_bool(value));
+#endif
+    if (value)
+        return;
+    TS_bits_set_totality(false, num, bits);
+}
+
+TRISTATE_INLINE void
+TS_bits_each_or(bool value, size_t num, TS_WORD *bits)
+{
+    assert(bits != NULL || num == 0);
+#ifdef TRISTATE_STRICT
+    assert(TS_is_valid_bool(value));
+#endif
+    if (!value)
+        return;
+    TS_bits_set_totality(true, num, bits);
+}
+
+TRISTATE_INLINE void
+TS_bits_each_not(size_t num, TS_WORD *bits)
+{
+    assert(bits != NULL || num == 0);
+    const size_t full = num / TS_WORD_BITS;
+    for (size_t i = 0; i < full; ++i)
+        bits[i] = ~bits[i];
+    if (num % TS_WORD_BITS)
+        bits[full] ^= TS_TAIL_MASK(num);
+}
+
+TRISTATE_INLINE bool
+TS_bits_connect_and(size_t num, const TS_WORD *bits)
+{
+    assert(bits != NULL || num == 0);
+    const size_t full = num / TS_WORD_BITS;
+    for (size_t i = 0; i < full; ++i)
+    {
+        if (bits[i] != ~(TS_WORD)0)
+            return false;
+    }
+    if (num % TS_WORD_BITS)
+    {
+        const TS_WORD mask = TS_TAIL_MASK(num);
+        return (bits[full] & mask) == mask;
+    }
+    return true;
+}
+
+TRISTATE_INLINE bool
+TS_bits_connect_or(size_t num, const TS_WORD *bits)
+{
+    assert(bits != NULL || num == 0);
+    const size_t full = num / TS_WORD_BITS;
+    for (size_t i = 0; i < full; ++i)
+    {
+        if (bits[i] != 0)
+            return true;
+    }
+    if (num % TS_WORD_BITS)
+        return (bits[full] & TS_TAIL_MASK(num)) != 0;
+    return false;
+}
+
+TRISTATE_INLINE size_t
+TS_bits_find(bool value, size_t first, size_t num, const TS_WORD *bits)
+{
+    assert(bits != NULL || num == 0);
+#ifdef TRISTATE_STRICT
+    assert(TS_is_valid_bool(value));
+#endif
+    if (first >= num)
+        return num;
+    const TS_WORD flip = (value ? 0 : ~(TS_WORD)0);
+    size_t i = first / TS_WORD_BITS;
+    TS_WORD word = (bits[i] ^ flip) & (~(TS_WORD)0 << (first % TS_WORD_BITS));
+    const size_t words = TS_WORDS(num);
+    while (word == 0)
+    {
+        if (++i >= words)
+            return num;
+        word = bits[i] ^ flip;
+    }
+    const size_t index = i * TS_WORD_BITS + TS_ctz(word);
+    return (index < num ? index : num);
+}
+
+TRISTATE_INLINE void
+TS_bits_set_range(bool value, size_t first, size_t last, TS_WORD *bits)
+{
+    assert(first <= last);
+    assert(bits != NULL || first == last);
+#ifdef TRISTATE_STRICT
+    assert(TS_is_valid_bool(value));
+#endif
+    while (first < last && first % TS_WORD_BITS)
+    {
+        TS_bits_set(value, first, bits);
+        ++first;
+    }
+    const TS_WORD fill = (value ? ~(TS_WORD)0 : 0);
+    for (; first + TS_WORD_BITS <= last; first += TS_WORD_BITS)
+        bits[first / TS_WORD_BITS] = fill;
+    for (; first < last; ++first)
+        TS_bits_set(value, first, bits);
+}
+
+/****************************************************************************/
+/* TRISTATE8 arrays */
+
+/* The TRISTATE8 loops below are kept free of branches on the element
+ * values (Kleene AND is min, OR is max, NOT is negation), so that the
+ * compiler can vectorize them.  The reductions work on blocks of 64
+ * elements and test for a short-circuit once per block. */
+
+TRISTATE_INLINE bool
+TS_is_valid_tri8(TRISTATE8 value)
+{
+    return (value == TS_FALSE || value == TS_UNKNOWN || value == TS_TRUE);
+}
+
+TRISTATE_INLINE size_t
+TS_find_invalid_tri8(size_t num, const TRISTATE8 *values)
+{
+    assert(values != NULL || num == 0);
+    for (size_t i = 0; i < num; i += 64)
+    {
+        unsigned char bad = 0;
+        if (num - i >= 64)
+        {
+            for (size_t k = 0; k < 64; ++k)
+            {
+                const unsigned char u = (unsigned char)(values[i + k] + 1);
+                bad |= (u | (u + 1)) & ~3U;
+            }
+        }
+        else
+        {
+            for (size_t k = i; k < num; ++k)
+                bad |= !TS_is_valid_tri8(values[k]);
+        }
+        if (bad)
+        {
+            while (TS_is_valid_tri8(values[i]))
+                ++i;
+            return i;
+        }
+    }
+    return num;
+}
+
+TRISTATE_INLINE void
+TS_tri_to_tri8(size_t num, const TRISTATE *tris, TRISTATE8 *tri8s)
+{
+    assert(tris != NULL || num == 0);
+    assert(tri8s != NULL || num == 0);
+#ifdef TRISTATE_STRICT
+    assert(TS_find_invalid_tri(num, tris) == num);
+#endif
+    for (size_t i = 0; i < num; ++i)
+    {
+        tri8s[i] = TS_TO_TRI8(tris[i]);
+    }
+}
+
+TRISTATE_INLINE void
+TS_tri8_to_tri(size_t num, const TRISTATE8 *tri8s, TRISTATE *tris)
+{
+    assert(tri8s != NULL || num == 0);
+    assert(tris != NULL || num == 0);
+#ifdef TRISTATE_STRICT
+    assert(TS_find_invalid_tri8(num, tri8s) == num);
+#endif
+    for (size_t i = 0; i < num; ++i)
+    {
+        tris[i] = (TRISTATE)tri8s[i];
+    }
+}
+
+TRISTATE_INLINE void
+TS_bool_to_tri8(size_t num, const bool *bools, TRISTATE8 *tris)
+{
+    assert(bools != NULL || num == 0);
+    assert(tris != NULL || num == 0);
+#ifdef TRISTATE_STRICT
+    assert(TS_find_invalid_bool(num, bools) == num);
+#endif
+    for (size_t i = 0; i < num; ++i)
+    {
+        tris[i] = (TRISTATE8)(2 * (int)bools[i] - 1);
+    }
+}
+
+TRISTATE_INLINE void
+TS_tri8_to_bool(size_t num, const TRISTATE8 *tris, bool *bools)
+{
+    assert(tris != NULL || num == 0);
+    assert(bools != NULL || num == 0);
+#ifdef TRISTATE_STRICT
+    assert(TS_find_invalid_tri8(num, tris) == num);
+#endif
+    for (size_t i = 0; i < num; ++i)
+    {
+        bools[i] = (tris[i] > 0) || (tris[i] == 0 && bools[i]);
+    }
+}
+
+TRISTATE_INLINE void
+TS_tri8_to_bool_def(size_t num, const TRISTATE8 *tris, bool *bools,
+                    bool default_value)
+{
+    assert(tris != NULL || num == 0);
+    assert(bools != NULL || num == 0);
+#ifdef TRISTATE_STRICT
+    assert(TS_find_invalid_tri8(num, tris) == num);
+    assert(TS_is_valid_bool(default_value));
+#endif
+    for (size_t i = 0; i < num; ++i)
+    {
+        bools[i] = (tris[i] > 0) || (tris[i] == 0 && default_value);
+    }
+}
+
+TRISTATE_INLINE void
+TS_get_totality_tri8(bool *value, size_t num, const TRISTATE8 *values)
+{
+    assert(value != NULL);
+    assert(values != NULL || num == 0);
+    TRISTATE state;
+    TS_get_tri_totality_tri8(&state, num, values);
+    if (state < 0)
+        *value = false;
+    if (state > 0)
+        *value = true;
+}
+
+TRISTATE_INLINE void
+TS_set_totality_tri8(bool value, size_t num, TRISTATE8 *values)
+{
+#ifdef TRISTATE_STRICT
+    assert(TS_is_valid_bool(value));
+#endif
+    TS_reset_tri_totality_tri8(TS_from_bool(value), num, values);
+}
+
+TRISTATE_INLINE void
+TS_get_tri_totality_tri8(TRISTATE *value, size_t num, const TRISTATE8 *values)
+{
+    assert(value != NULL);
+    assert(values != NULL || num == 0);
+#ifdef TRISTATE_STRICT
+    assert(TS_find_invalid_tri8(num, values) == num);
+#endif
+    TRISTATE8 lowest = 0, highest = 0;
+    while (num > 0)
+    {
+        const size_t count = (num < 64 ? num : 64);
+        for (size_t i = 0; i < count; ++i)
+        {
+            lowest = (values[i] < lowest ? values[i] : lowest);
+            highest = (values[i] > highest ? values[i] : highest);
+        }
+        if (lowest < 0 && highest > 0)
+            break;
+        values += count;
+        num -= count;
+    }
+    if ((lowest < 0) == (highest > 0))
+        *value = TS_UNKNOWN;
+    else if (lowest < 0)
+        *value = TS_FALSE;
+    else
+        *value = TS_TRUE;
+}
+
+TRISTATE_INLINE void
+TS_set_tri_totality_tri8(TRISTATE value, size_t num, TRISTATE8 *values)
+{
+#ifdef TRISTATE_STRICT
+    assert(TS_is_valid_tri(value));
+#endif
+    if (value == TS_UNKNOWN)
+        return;
+
+    TS_reset_tri_totality_tri8(value, num, values);
+}
+
+TRISTATE_INLINE void
+TS_reset_tri_totality_tri8(TRISTATE value, size_t num, TRISTATE8 *values)
+{
+#ifdef __cplusplus
+    using namespace std;
+#endif
+    assert(values != NULL || num == 0);
+#ifdef TRISTATE_STRICT
+    assert(TS_is_valid_tri(value));
+#endif
+    memset(values, TS_TO_TRI8(value), num);
+}
+
+TRISTATE_INLINE void
+TS_each_and_tri8(bool value, size_t num, TRISTATE8 *values)
+{
+#ifdef TRISTATE_STRICT
+    assert(TS_is_valid_bool(value));
+#endif
+    assert(values != NULL || num == 0);
+
+    if (value)
+        return;
+
+    TS_reset_tri_totality_tri8(TS_FALSE, num, values);
+}
+
+TRISTATE_INLINE void
+TS_each_or_tri8(bool value, size_t num, TRISTATE8 *values)
+{
+#ifdef TRISTATE_STRICT
+    assert(TS_is_valid_bool(value));
+#endif
+    assert(values != NULL || num == 0);
+
+    if (!value)
+        return;
+
+    TS_reset_tri_totality_tri8(TS_TRUE, num, values);
+}
+
+TRISTATE_INLINE void
+TS_each_not_tri8(size_t num, TRISTATE8 *values)
+{
+    assert(values != NULL || num == 0);
+#ifdef TRISTATE_STRICT
+    assert(TS_find_invalid_tri8(num, values) == num);
+#endif
+    for (size_t i = 0; i < num; ++i)
+    {
+        values[i] = (TRISTATE8)-values[i];
+    }
+}
+
+TRISTATE_INLINE void
+TS_tri_each_and_tri8(TRISTATE value, size_t num, TRISTATE8 *values)
+{
+    assert(values != NULL || num == 0);
+#ifdef TRISTATE_STRICT
+    assert(TS_find_invalid_tri8(num, values) == num);
+    assert(TS_is_valid_tri(value));
+#endif
+    if (value > 0)
+        return;
+
+    if (value < 0)
+    {
+        TS_reset_tri_totality_tri8(TS_FALSE, num, values);
+        return;
+    }
+
+    for (size_t i = 0; i < num; ++i)
+    {
+        values[i] = (values[i] < 0 ? values[i] : 0);
+    }
+}
+
+TRISTATE_INLINE void
+TS_tri_each_or_tri8(TRISTATE value, size_t num, TRISTATE8 *values)
+{
+    assert(values != NULL || num == 0);
+#ifdef TRISTATE_STRICT
+    assert(TS_find_invalid_tri8(num, values) == num);
+    assert(TS_is_valid_tri(value));
+#endif
+    if (value > 0)
+    {
+        TS_reset_tri_totality_tri8(TS_TRUE, num, values);
+        return;
+    }
+
+    if (value < 0)
+        return;
+
+    for (size_t i = 0; i < num; ++i)
+    {
+        values[i] = (values[i] > 0 ? values[i] : 0);
+    }
+}
+
+TRISTATE_INLINE TRISTATE
+TS_connect_and_tri8(size_t num, const TRISTATE8 *values)
+{
+    assert(values != NULL || num == 0);
+#ifdef TRISTATE_STRICT
+    assert(TS_find_invalid_tri8(num, values) == num);
+#endif
+    TRISTATE8 value = TS_TRUE;
+    while (num > 0)
+    {
+        const size_t count = (num < 64 ? num : 64);
+        for (size_t i = 0; i < count; ++i)
+        {
+            value = (values[i] < value ? values[i] : value);
+        }
+        if (value < 0)
+            break;
+        values += count;
+        num -= count;
+    }
+    return (TRISTATE)value;
+}
+
+TRISTATE_INLINE TRISTATE
+TS_connect_or_tri8(size_t num, const TRISTATE8 *values)
+{
+    assert(values != NULL || num == 0);
+#ifdef TRISTATE_STRICT
+    assert(TS_find_invalid_tri8(num, values) == num);
+#endif
+    TRISTATE8 value = TS_FALSE;
+    while (num > 0)
+    {
+        const size_t count = (num < 64 ? num : 64);
+        for (size_t i = 0; i < count; ++i)
+        {
+            value = (values[i] > value ? values[i] : value);
+        }
+        if (value > 0)
+            break;
+        values += count;
+        num -= count;
+    }
+    return (TRISTATE)value;
+}
+
+/****************************************************************************/
+/* packed arrays */
+
+TRISTATE_INLINE TRISTATE
+TS_packed_get(size_t index, const TS_WORD *trues, const TS_WORD *falses)
+{
+    assert(trues != NULL);
+    assert(falses != NULL);
+    if (TS_bits_get(index, trues))
+        return TS_TRUE;
+    if (TS_bits_get(index, falses))
+        return TS_FALSE;
+    return TS_UNKNOWN;
+}
+
+TRISTATE_INLINE void
+TS_packed_set(TRISTATE value, size_t index, TS_WORD *trues, TS_WORD *falses)
+{
+    assert(trues != NULL);
+    assert(falses != NULL);
+#ifdef TRISTATE_STRICT
+    assert(TS_is_valid_tri(value));
+#endif
+    TS_bits_set(value > 0, index, trues);
+    TS_bits_set(value < 0, index, falses);
+}
+
+TRISTATE_INLINE void
+TS_tri_to_packed(size_t num, const TRISTATE *tris,
+                 TS_WORD *trues, TS_WORD *falses)
+{
+    assert(tris != NULL || num == 0);
+    assert(trues != NULL || num == 0);
+    assert(falses != NULL || num == 0);
+#ifdef TRISTATE_STRICT
+    assert(TS_find_invalid_tri(num, tris) == num);
+#endif
+    while (num > 0)
+    {
+        const size_t count = (num < TS_WORD_BITS ? num : TS_WORD_BITS);
+        TS_WORD t = 0, f = 0;
+        for (size_t i = 0; i < count; ++i)
+        {
+            t |= (TS_WORD)(tris[i] > 0) << i;
+            f |= (TS_WORD)(tris[i] < 0) << i;
+        }
+        if (count < TS_WORD_BITS)
+        {
+            t |= *trues & ~TS_TAIL_MASK(count);
+            f |= *falses & ~TS_TAIL_MASK(count);
+        }
+        *trues++ = t;
+        *falses++ = f;
+        tris += count;
+        num -= count;
+    }
+}
+
+TRISTATE_INLINE void
+TS_packed_to_tri(size_t num, const TS_WORD *trues, const TS_WORD *falses,
+                 TRISTATE *tris)
+{
+    assert(trues != NULL || num == 0);
+    assert(falses != NULL || num == 0);
+    assert(tris != NULL || num == 0);
+    for (size_t i = 0; i < num; ++i)
+    {
+        const size_t k = i / TS_WORD_BITS, shift = i % TS_WORD_BITS;
+        const int t = (int)((trues[k] >> shift) & 1);
+        const int f = (int)((falses[k] >> shift) & 1);
+        tris[i] = (TRISTATE)(t - f);
+    }
+}
+
+TRISTATE_INLINE size_t
+TS_packed_count(TRISTATE value, size_t num,
+                const TS_WORD *trues, const TS_WORD *falses)
+{
+#ifdef TRISTATE_STRICT
+    assert(TS_is_valid_tri(value));
+#endif
+    if (value > 0)
+        return TS_bits_count(num, trues);
+    if (value < 0)
+        return TS_bits_count(num, falses);
+    return num - TS_bits_count(num, trues) - TS_bits_count(num, falses);
+}
+
+TRISTATE_INLINE size_t
+TS_packed_find(TRISTATE value, size_t num,
+               const TS_WORD *trues, const TS_WORD *falses)
+{
+    assert(trues != NULL || num == 0);
+    assert(falses != NULL || num == 0);
+#ifdef TRISTATE_STRICT
+    assert(TS_is_valid_tri(value));
+#endif
+    const size_t words = TS_WORDS(num);
+    for (size_t i = 0; i < words; ++i)
+    {
+        TS_WORD word;
+        if (value > 0)
+            word = trues[i];
+        else if (value < 0)
+            word = falses[i];
+        else
+            word = ~(trues[i] | falses[i]);
+        if (i + 1 == words)
+            word &= TS_TAIL_MASK(num);
+        if (word)
+            return i * TS_WORD_BITS + TS_ctz(word);
+    }
+    return num;
+}
+
+TRISTATE_INLINE bool
+TS_packed_equal(size_t num,
+                const TS_WORD *trues1, const TS_WORD *falses1,
+                const TS_WORD *trues2, const TS_WORD *falses2)
+{
+    assert(trues1 != NULL || num == 0);
+    assert(falses1 != NULL || num == 0);
+    assert(trues2 != NULL || num == 0);
+    assert(falses2 != NULL || num == 0);
+    const size_t words = TS_WORDS(num);
+    for (size_t i = 0; i < words; ++i)
+    {
+        const TS_WORD mask = (i + 1 < words ? ~(TS_WORD)0 : TS_TAIL_MASK(num));
+        if (((trues1[i] ^ trues2[i]) | (falses1[i] ^ falses2[i])) & mask)
+            return false;
+    }
+    return true;
+}
+
+TRISTATE_INLINE bool
+TS_packed_match(size_t num, const TS_WORD *trues, const TS_WORD *falses,
+                const TS_WORD *key)
+{
+    assert(trues != NULL || num == 0);
+    assert(falses != NULL || num == 0);
+    assert(key != NULL || num == 0);
+    const size_t words = TS_WORDS(num);
+    for (size_t i = 0; i < words; ++i)
+    {
+        const TS_WORD mask = (i + 1 < words ? ~(TS_WORD)0 : TS_TAIL_MASK(num));
+        if (((key[i] & falses[i]) | (~key[i] & trues[i])) & mask)
+            return false;
+    }
+    return true;
+}
+
+TRISTATE_INLINE void
+TS_packed_get_tri_totality(TRISTATE *value, size_t num,
+                           const TS_WORD *trues, const TS_WORD *falses)
+{
+    assert(value != NULL);
+    assert(trues != NULL || num == 0);
+    assert(falses != NULL || num == 0);
+    TS_WORD any_true = 0, any_false = 0;
+    const size_t words = TS_WORDS(num);
+    for (size_t i = 0; i < words; ++i)
+    {
+        const TS_WORD mask = (i + 1 < words ? ~(TS_WORD)0 : TS_TAIL_MASK(num));
+        any_true |= trues[i] & mask;
+        any_false |= falses[i] & mask;
+        if (any_true && any_false)
+            break;
+    }
+    if ((any_true != 0) == (any_false != 0))
+        *value = TS_UNKNOWN;
+    else if (any_false)
+        *value = TS_FALSE;
+    else
+        *value = TS_TRUE;
+}
+
+TRISTATE_INLINE void
+TS_packed_reset_tri_totality(TRISTATE value, size_t num,
+                             TS_WORD *trues, TS_WORD *falses)
+{
+#ifdef TRISTATE_STRICT
+    assert(TS_is_valid_tri(value));
+#endif
+    TS_bits_set_totality(value > 0, num, trues);
+    TS_bits_set_totality(value < 0, num, falses);
+}
+
+TRISTATE_INLINE void
+TS_packed_tri_each_and(TRISTATE value, size_t num,
+                       TS_WORD *trues, TS_WORD *falses)
+{
+#ifdef TRISTATE_STRICT
+    assert(TS_is_valid_tri(value));
+#endif
+    if (value > 0)
+        return;
+
+    if (value < 0)
+    {
+        TS_packed_reset_tri_totality(TS_FALSE, num, trues, falses);
+        return;
+    }
+
+    TS_bits_set_totality(false, num, trues);
+}
+
+TRISTATE_INLINE void
+TS_packed_tri_each_or(TRISTATE value, size_t num,
+                      TS_WORD *trues, TS_WORD *falses)
+{
+#ifdef TRISTATE_STRICT
+    assert(TS_is_valid_tri(value));
+#endif
+    if (value > 0)
+    {
+        TS_packed_reset_tri_totality(TS_TRUE, num, trues, falses);
+        return;
+    }
+
+    if (value < 0)
+        return;
+
+    TS_bits_set_totality(false, num, falses);
+}
+
+TRISTATE_INLINE void
+TS_packed_each_not(size_t num, TS_WORD *trues, TS_WORD *falses)
+{
+    assert(trues != NULL || num == 0);
+    assert(falses != NULL || num == 0);
+    const size_t words = TS_WORDS(num);
+    for (size_t i = 0; i < words; ++i)
+    {
+        const TS_WORD mask = (i + 1 < words ? ~(TS_WORD)0 : TS_TAIL_MASK(num));
+        const TS_WORD t = trues[i], f = falses[i];
+        trues[i] = (t & ~mask) | (f & mask);
+        falses[i] = (f & ~mask) | (t & mask);
+    }
+}
+
+TRISTATE_INLINE void
+TS_packed_and(size_t num, TS_WORD *trues, TS_WORD *falses,
+              const TS_WORD *trues2, const TS_WORD *falses2)
+{
+    assert(trues != NULL || num == 0);
+    assert(falses != NULL || num == 0);
+    assert(trues2 != NULL || num == 0);
+    assert(falses2 != NULL || num == 0);
+    const size_t words = TS_WORDS(num);
+    for (size_t i = 0; i < words; ++i)
+    {
+        const TS_WORD mask = (i + 1 < words ? ~(TS_WORD)0 : TS_TAIL_MASK(num));
+        trues[i] &= trues2[i] | ~mask;
+        falses[i] |= falses2[i] & mask;
+    }
+}
+
+TRISTATE_INLINE void
+TS_packed_or(size_t num, TS_WORD *trues, TS_WORD *falses,
+             const TS_WORD *trues2, const TS_WORD *falses2)
+{
+    assert(trues != NULL || num == 0);
+    assert(falses != NULL || num == 0);
+    assert(trues2 != NULL || num == 0);
+    assert(falses2 != NULL || num == 0);
+    const size_t words = TS_WORDS(num);
+    for (size_t i = 0; i < words; ++i)
+    {
+        const TS_WORD mask = (i + 1 < words ? ~(TS_WORD)0 : TS_TAIL_MASK(num));
+        trues[i] |= trues2[i] & mask;
+        falses[i] &= falses2[i] | ~mask;
+    }
+}
+
+TRISTATE_INLINE TRISTATE
+TS_packed_connect_and(size_t num, const TS_WORD *trues, const TS_WORD *falses)
+{
+    assert(trues != NULL || num == 0);
+    assert(falses != NULL || num == 0);
+    TRISTATE value = TS_TRUE;
+    const size_t words = TS_WORDS(num);
+    for (size_t i = 0; i < words; ++i)
+    {
+        const TS_WORD mask = (i + 1 < words ? ~(TS_WORD)0 : TS_TAIL_MASK(num));
+        if (falses[i] & mask)
+            return TS_FALSE;
+        if ((trues[i] & mask) != mask)
+            value = TS_UNKNOWN;
+    }
+    return value;
+}
+
+TRISTATE_INLINE TRISTATE
+TS_packed_connect_or(size_t num, const TS_WORD *trues, const TS_WORD *falses)
+{
+    assert(trues != NULL || num == 0);
+    assert(falses != NULL || num == 0);
+    TRISTATE value = TS_FALSE;
+    const size_t words = TS_WORDS(num);
+    for (size_t i = 0; i < words; ++i)
+    {
+        const TS_WORD mask = (i + 1 < words ? ~(TS_WORD)0 : TS_TAIL_MASK(num));
+        if (trues[i] & mask)
+            return TS_TRUE;
+        if ((falses[i] & mask) != mask)
+            value = TS_UNKNOWN;
+    }
+    return value;
+}
+
+TRISTATE_INLINE void
+TS_packed_distance(TS_PACKED_DISTANCE *distance, size_t num,
+                   const TS_WORD *trues1, const TS_WORD *falses1,
+                   const TS_WORD *trues2, const TS_WORD *falses2)
+{
+    assert(distance != NULL);
+    assert(trues1 != NULL || num == 0);
+    assert(falses1 != NULL || num == 0);
+    assert(trues2 != NULL || num == 0);
+    assert(falses2 != NULL || num == 0);
+    size_t agree = 0, disagree = 0, either = 0;
+    const size_t words = TS_WORDS(num);
+    for (size_t i = 0; i < words; ++i)
+    {
+        const TS_WORD mask = (i + 1 < words ? ~(TS_WORD)0 : TS_TAIL_MASK(num));
+        const TS_WORD t1 = trues1[i], f1 = falses1[i];
+        const TS_WORD t2 = trues2[i], f2 = falses2[i];
+        agree += TS_popcount(((t1 & t2) | (f1 & f2)) & mask);
+        disagree += TS_popcount(((t1 & f2) | (f1 & t2)) & mask);
+        either += TS_popcount((t1 | f1 | t2 | f2) & mask);
+    }
+    distance->agree = agree;
+    distance->disagree = disagree;
+    distance->both_known = agree + disagree;
+    distance->either_known = either;
+}
+
+TRISTATE_INLINE double
+TS_packed_similarity(size_t num,
+                     const TS_WORD *trues1, const TS_WORD *falses1,
+                     const TS_WORD *trues2, const TS_WORD *falses2)
+{
+    TS_PACKED_DISTANCE distance;
+    TS_packed_distance(&distance, num, trues1, falses1, trues2, falses2);
+    if (distance.either_known == 0)
+        return 0;
+    return (double)distance.agree / (double)distance.either_known;
+}
+
+TRISTATE_INLINE size_t
+TS_packed_top_k(size_t k, size_t num,
+                const TS_WORD *trues, const TS_WORD *falses,
+                size_t count, const TS_WORD *all_trues,
+                const TS_WORD *all_falses,
+                size_t *indices, double *similarities)
+{
+    assert(all_trues != NULL || count == 0 || num == 0);
+    assert(all_falses != NULL || count == 0 || num == 0);
+    assert(indices != NULL || k == 0);
+    assert(similarities != NULL || k == 0);
+    const size_t words = TS_WORDS(num);
+    size_t found = 0;
+    if (k == 0)
+        return 0;
+    for (size_t i = 0; i < count; ++i)
+    {
+        const double value =
+            TS_packed_similarity(num, trues, falses,
+                                 all_trues + i * words,
+                                 all_falses + i * words);
+        if (found == k && !(value > similarities[k - 1]))
+            continue;
+        size_t j = (found < k ? found++ : k - 1);
+        for (; j > 0 && similarities[j - 1] < value; --j)
+        {
+            indices[j] = indices[j - 1];
+            similarities[j] = similarities[j - 1];
+        }
+        indices[j] = i;
+        similarities[j] = value;
+    }
+    return found;
+}
+
+/* Blocks of 64 values are selected without branches.  While the output
+ * has room for a whole block, every index is written and only the
+ * selected ones are kept; near max_out the selection is gathered into a
+ * word whose set bits TS_select_emit writes out by TS_ctz. */
+static TRISTATE_INLINE size_t
+TS_select_emit(TS_WORD selected, size_t base, size_t end, size_t *first,
+               size_t count, size_t max_out, size_t *indices)
+{
+    for (; selected; selected &= selected - 1)
+    {
+        if (count == max_out)
+        {
+            *first = base + TS_ctz(selected);
+            return count;
+        }
+        indices[count++] = base + TS_ctz(selected);
+    }
+    *first = end;
+    return count;
+}
+
+TRISTATE_INLINE size_t
+TS_select_tri(int mask, size_t *first, size_t num, const TRISTATE *values,
+              size_t max_out, size_t *indices)
+{
+    assert(first != NULL && *first <= num);
+    assert(values != NULL || num == 0);
+    assert(indices != NULL || max_out == 0);
+    assert(0 <= mask && mask <= TS_SELECT_ALL);
+#ifdef TRISTATE_STRICT
+    assert(TS_find_invalid_tri(num - *first, values + *first) ==
+           num - *first);
+#endif
+    size_t count = 0;
+    while (*first < num && count < max_out)
+    {
+        const size_t base = *first;
+        const size_t end = (num - base > TS_WORD_BITS ? base + TS_WORD_BITS
+                                                      : num);
+        if (max_out - count >= end - base)
+        {
+            for (size_t i = base; i < end; ++i)
+            {
+                indices[count] = i;
+                count += (mask >> TS_TRI_INDEX(values[i])) & 1;
+            }
+            *first = end;
+            continue;
+        }
+        TS_WORD selected = 0;
+        for (size_t i = base; i < end; ++i)
+        {
+            const TS_WORD bit = (mask >> TS_TRI_INDEX(values[i])) & 1;
+            selected |= bit << (i - base);
+        }
+        count = TS_select_emit(selected, base, end, first, count, max_out,
+                               indices);
+    }
+    return count;
+}
+
+TRISTATE_INLINE size_t
+TS_select_bool(bool value, size_t *first, size_t num, const bool *values,
+               size_t max_out, size_t *indices)
+{
+    assert(first != NULL && *first <= num);
+    assert(values != NULL || num == 0);
+    assert(indices != NULL || max_out == 0);
+#ifdef TRISTATE_STRICT
+    assert(TS_find_invalid_bool(num - *first, values + *first) ==
+           num - *first);
+#endif
+    size_t count = 0;
+    while (*first < num && count < max_out)
+    {
+        const size_t base = *first;
+        const size_t end = (num - base > TS_WORD_BITS ? base + TS_WORD_BITS
+                                                      : num);
+        if (max_out - count >= end - base)
+        {
+            for (size_t i = base; i < end; ++i)
+            {
+                indices[count] = i;
+                count += (values[i] == value);
+            }
+            *first = end;
+            continue;
+        }
+        TS_WORD selected = 0;
+        for (size_t i = base; i < end; ++i)
+            selected |= (TS_WORD)(values[i] == value) << (i - base);
+        count = TS_select_emit(selected, base, end, first, count, max_out,
+                               indices);
+    }
+    return count;
+}
+
+TRISTATE_INLINE size_t
+TS_packed_select(int mask, size_t *first, size_t num,
+                 const TS_WORD *trues, const TS_WORD *falses,
+                 size_t max_out, size_t *indices)
+{
+    assert(first != NULL && *first <= num);
+    assert(trues != NULL || num == 0);
+    assert(falses != NULL || num == 0);
+    assert(indices != NULL || max_out == 0);
+    assert(0 <= mask && mask <= TS_SELECT_ALL);
+    const TS_WORD want_false = (mask & TS_SELECT_FALSE) ? ~(TS_WORD)0 : 0;
+    const TS_WORD want_unknown = (mask & TS_SELECT_UNKNOWN) ? ~(TS_WORD)0 : 0;
+    const TS_WORD want_true = (mask & TS_SELECT_TRUE) ? ~(TS_WORD)0 : 0;
+    size_t count = 0;
+    while (*first < num && count < max_out)
+    {
+        const size_t i = *first / TS_WORD_BITS;
+        const size_t base = i * TS_WORD_BITS;
+        const size_t end = (num - base > TS_WORD_BITS ? base + TS_WORD_BITS
+                                                      : num);
+        const TS_WORD t = trues[i], f = falses[i];
+        TS_WORD selected = (t & want_true) | (f & want_false) |
+                           (~(t | f) & want_unknown);
+        if (end - base < TS_WORD_BITS)
+            selected &= TS_TAIL_MASK(end);
+        selected &= ~(TS_WORD)0 << (*first - base);
+        count = TS_select_emit(selected, base, end, first, count, max_out,
+                               indices);
+    }
+    return count;
+}
+
+TRISTATE_INLINE size_t
+TS_compact_tri(int mask, size_t num, const TRISTATE *values,
+               TRISTATE *results)
+{
+    assert(values != NULL || num == 0);
+    assert(results != NULL || num == 0);
+    assert(0 <= mask && mask <= TS_SELECT_ALL);
+#ifdef TRISTATE_STRICT
+    assert(TS_find_invalid_tri(num, values) == num);
+#endif
+    /* writes every value and keeps it only if selected */
+    size_t count = 0;
+    for (size_t i = 0; i < num; ++i)
+    {
+        const TRISTATE value = values[i];
+        results[count] = value;
+        count += (mask >> TS_TRI_INDEX(value)) & 1;
+    }
+    return count;
+}
+
+TRISTATE_INLINE void
+TS_stable_order_tri(size_t num, const TRISTATE *keys, size_t *order,
+                    size_t *bounds)
+{
+    assert(keys != NULL || num == 0);
+    assert(order != NULL || num == 0);
+#ifdef TRISTATE_STRICT
+    assert(TS_find_invalid_tri(num, keys) == num);
+#endif
+    size_t trues, falses, unknowns;
+    TS_count_tri(&trues, &falses, &unknowns, num, keys);
+    size_t next[3];
+    next[0] = 0;
+    next[1] = falses;
+    next[2] = falses + unknowns;
+    for (size_t i = 0; i < num; ++i)
+        order[next[TS_TRI_INDEX(keys[i])]++] = i;
+    if (bounds)
+    {
+        bounds[0] = falses;
+        bounds[1] = falses + unknowns;
+    }
+}
+
+/****************************************************************************/
+/* Arrow layout */
+
+/* The bitmaps are read and written a byte at a time into 64-bit words, so
+ * the offset needs no alignment and the result does not depend on the
+ * byte order.  The word loops then work like the packed ones. */
+TRISTATE_INLINE TS_WORD
+TS_arrow_load(const uint8_t *bitmap, size_t pos, size_t count)
+{
+    assert(bitmap != NULL || count == 0);
+    assert(count <= TS_WORD_BITS);
+    if (count == 0)
+        return 0;
+    const uint8_t *bytes = bitmap + pos / 8;
+    const int shift = (int)(pos % 8);
+    const size_t num_bytes = (shift + count + 7) / 8;
+    TS_WORD bits = 0;
+    if (num_bytes >= 8)
+    {
+        /* a fixed count, which compilers turn into one load */
+        for (size_t i = 0; i < 8; ++i)
+            bits |= (TS_WORD)bytes[i] << (8 * i);
+    }
+    else
+    {
+        for (size_t i = 0; i < num_bytes; ++i)
+            bits |= (TS_WORD)bytes[i] << (8 * i);
+    }
+    bits >>= shift;
+    if (num_bytes > 8)
+        bits |= (TS_WORD)bytes[8] << (TS_WORD_BITS - shift);
+    return bits & TS_TAIL_MASK(count);
+}
+
+TRISTATE_INLINE void
+TS_arrow_store(uint8_t *bitmap, size_t pos, size_t count, TS_WORD bits)
+{
+    assert(bitmap != NULL || count == 0);
+    assert(count <= TS_WORD_BITS);
+    size_t done = 0;
+    while (done < count)
+    {
+        const size_t bit = pos + done;
+        const int shift = (int)(bit % 8);
+        size_t n = 8 - shift;
+        if (n > count - done)
+            n = count - done;
+        const uint8_t mask = (uint8_t)(((1U << n) - 1) << shift);
+        const uint8_t part = (uint8_t)((bits >> done) << shift);
+        bitmap[bit / 8] = (uint8_t)((bitmap[bit / 8] & ~mask) | (part & mask));
+        done += n;
+    }
+}
+
+TRISTATE_INLINE TRISTATE
+TS_arrow_get(size_t index, size_t offset, const uint8_t *validity,
+             const uint8_t *values)
+{
+    assert(values != NULL);
+    const size_t pos = offset + index;
+    if (validity && !((validity[pos / 8] >> (pos % 8)) & 1))
+        return TS_UNKNOWN;
+    return (((values[pos / 8] >> (pos % 8)) & 1) ? TS_TRUE : TS_FALSE);
+}
+
+TRISTATE_INLINE void
+TS_arrow_set(TRISTATE value, size_t index, size_t offset,
+             uint8_t *validity, uint8_t *values)
+{
+    assert(values != NULL);
+    assert(validity != NULL || value != TS_UNKNOWN);
+#ifdef TRISTATE_STRICT
+    assert(TS_is_valid_tri(value));
+#endif
+    const size_t pos = offset + index;
+    if (validity)
+        TS_arrow_store(validity, pos, 1, (TS_WORD)(value != TS_UNKNOWN));
+    TS_arrow_store(values, pos, 1, (TS_WORD)(value > 0));
+}
+
+TRISTATE_INLINE void
+TS_arrow_to_tri(size_t num, size_t offset, const uint8_t *validity,
+                const uint8_t *values, TRISTATE *tris)
+{
+    assert(values != NULL || num == 0);
+    assert(tris != NULL || num == 0);
+    for (size_t base = 0; base < num; base += TS_WORD_BITS)
+    {
+        const size_t count = (num - base < TS_WORD_BITS ? num - base
+                                                        : TS_WORD_BITS);
+        const TS_WORD known = (validity ? TS_arrow_load(validity,
+                                                        offset + base, count)
+                                        : TS_TAIL_MASK(count));
+        const TS_WORD bits = TS_arrow_load(values, offset + base, count);
+        const TS_WORD trues = known & bits, falses = known & ~bits;
+        TRISTATE *block = tris + base;
+        for (size_t i = 0; i < count; ++i)
+        {
+            block[i] = (TRISTATE)((int)((trues >> i) & 1) -
+                                  (int)((falses >> i) & 1));
+        }
+    }
+}
+
+TRISTATE_INLINE void
+TS_tri_to_arrow(size_t num, const TRISTATE *tris, size_t offset,
+                uint8_t *validity, uint8_t *values)
+{
+    assert(tris != NULL || num == 0);
+    assert(values != NULL || num == 0);
+#ifdef TRISTATE_STRICT
+    assert(TS_find_invalid_tri(num, tris) == num);
+#endif
+    for (size_t base = 0; base < num; base += TS_WORD_BITS)
+    {
+        const size_t count = (num - base < TS_WORD_BITS ? num - base
+                                                        : TS_WORD_BITS);
+        const TRISTATE *block = tris + base;
+        TS_WORD known = 0, trues = 0;
+        for (size_t i = 0; i < count; ++i)
+        {
+            known |= (TS_WORD)(block[i] != 0) << i;
+            trues |= (TS_WORD)(block[i] > 0) << i;
+        }
+        if (validity)
+            TS_arrow_store(validity, offset + base, count, known);
+        else
+            assert(known == TS_TAIL_MASK(count));
+        TS_arrow_store(values, offset + base, count, trues);
+    }
+}
+
+TRISTATE_INLINE void
+TS_arrow_to_packed(size_t num, size_t offset, const uint8_t *validity,
+                   const uint8_t *values, TS_WORD *trues, TS_WORD *falses)
+{
+    assert(values != NULL || num == 0);
+    assert(trues != NULL || num == 0);
+    assert(falses != NULL || num == 0);
+    for (size_t base = 0; base < num; base += TS_WORD_BITS)
+    {
+        const size_t count = (num - base < TS_WORD_BITS ? num - base
+                                                        : TS_WORD_BITS);
+        const TS_WORD known = (validity ? TS_arrow_load(validity,
+                                                        offset + base, count)
+                                        : TS_TAIL_MASK(count));
+        const TS_WORD bits = TS_arrow_load(values, offset + base, count);
+        const size_t i = base / TS_WORD_BITS;
+        const TS_WORD keep = ~TS_TAIL_MASK(count);
+        trues[i] = (trues[i] & keep) | (known & bits);
+        falses[i] = (falses[i] & keep) | (known & ~bits & ~keep);
+    }
+}
+
+TRISTATE_INLINE void
+TS_packed_to_arrow(size_t num, const TS_WORD *trues, const TS_WORD *falses,
+                   size_t offset, uint8_t *validity, uint8_t *values)
+{
+    assert(trues != NULL || num == 0);
+    assert(falses != NULL || num == 0);
+    assert(values != NULL || num == 0);
+    for (size_t base = 0; base < num; base += TS_WORD_BITS)
+    {
+        const size_t count = (num - base < TS_WORD_BITS ? num - base
+                                                        : TS_WORD_BITS);
+        const size_t i = base / TS_WORD_BITS;
+        const TS_WORD known = (trues[i] | falses[i]) & TS_TAIL_MASK(count);
+        if (validity)
+            TS_arrow_store(validity, offset + base, count, known);
+        else
+            assert(known == TS_TAIL_MASK(count));
+        TS_arrow_store(values, offset + base, count, trues[i]);
+    }
+}
+
+TRISTATE_INLINE size_t
+TS_arrow_count(TRISTATE value, size_t num, size_t offset,
+               const uint8_t *validity, const uint8_t *values)
+{
+    assert(values != NULL || num == 0);
+#ifdef TRISTATE_STRICT
+    assert(TS_is_valid_tri(value));
+#endif
+    size_t count = 0;
+    for (size_t base = 0; base < num; base += TS_WORD_BITS)
+    {
+        const size_t n = (num - base < TS_WORD_BITS ? num - base
+                                                    : TS_WORD_BITS);
+        const TS_WORD known = (validity ? TS_arrow_load(validity,
+                                                        offset + base, n)
+                                        : TS_TAIL_MASK(n));
+        const TS_WORD bits = TS_arrow_load(values, offset + base, n);
+        TS_WORD selected;
+        if (value > 0)
+            selected = known & bits;
+        else if (value < 0)
+            selected = known & ~bits;
+        else
+            selected = ~known & TS_TAIL_MASK(n);
+        count += TS_popcount(selected);
+    }
+    return count;
+}
+
+TRISTATE_INLINE TRISTATE
+TS_arrow_connect_and(size_t num, size_t offset, const uint8_t *validity,
+                     const uint8_t *values)
+{
+    assert(values != NULL || num == 0);
+    TRISTATE value = TS_TRUE;
+    for (size_t base = 0; base < num; base += TS_WORD_BITS)
+    {
+        const size_t n = (num - base < TS_WORD_BITS ? num - base
+                                                    : TS_WORD_BITS);
+        const TS_WORD known = (validity ? TS_arrow_load(validity,
+                                                        offset + base, n)
+                                        : TS_TAIL_MASK(n));
+        const TS_WORD bits = TS_arrow_load(values, offset + base, n);
+        if (known & ~bits)
+            return TS_FALSE;
+        if (known != TS_TAIL_MASK(n))
+            value = TS_UNKNOWN;
+    }
+    return value;
+}
+
+TRISTATE_INLINE TRISTATE
+TS_arrow_connect_or(size_t num, size_t offset, const uint8_t *validity,
+                    const uint8_t *values)
+{
+    assert(values != NULL || num == 0);
+    TRISTATE value = TS_FALSE;
+    for (size_t base = 0; base < num; base += TS_WORD_BITS)
+    {
+        const size_t n = (num - base < TS_WORD_BITS ? num - base
+                                                    : TS_WORD_BITS);
+        const TS_WORD known = (validity ? TS_arrow_load(validity,
+                                                        offset + base, n)
+                                        : TS_TAIL_MASK(n));
+        const TS_WORD bits = TS_arrow_load(values, offset + base, n);
+        if (known & bits)
+            return TS_TRUE;
+        if (known != TS_TAIL_MASK(n))
+            value = TS_UNKNOWN;
+    }
+    return value;
+}
+
+TRISTATE_INLINE void
+TS_arrow_get_tri_totality(TRISTATE *value, size_t num, size_t offset,
+                          const uint8_t *validity, const uint8_t *values)
+{
+    assert(value != NULL);
+    assert(values != NULL || num == 0);
+    TS_WORD any_true = 0, any_false = 0;
+    for (size_t base = 0; base < num; base += TS_WORD_BITS)
+    {
+        const size_t n = (num - base < TS_WORD_BITS ? num - base
+                                                    : TS_WORD_BITS);
+        const TS_WORD known = (validity ? TS_arrow_load(validity,
+                                                        offset + base, n)
+                                        : TS_TAIL_MASK(n));
+        const TS_WORD bits = TS_arrow_load(values, offset + base, n);
+        any_true |= known & bits;
+        any_false |= known & ~bits;
+    }
+    if (any_true && !any_false)
+        *value = TS_TRUE;
+    else if (any_false && !any_true)
+        *value = TS_FALSE;
+    else
+        *value = TS_UNKNOWN;
+}
+
+TRISTATE_INLINE void
+TS_arrow_each_not(size_t num, size_t offset, uint8_t *values)
+{
+    assert(values != NULL || num == 0);
+    for (size_t base = 0; base < num; base += TS_WORD_BITS)
+    {
+        const size_t n = (num - base < TS_WORD_BITS ? num - base
+                                                    : TS_WORD_BITS);
+        const TS_WORD bits = TS_arrow_load(values, offset + base, n);
+        TS_arrow_store(values, offset + base, n, ~bits);
+    }
+}
+
+TRISTATE_INLINE void
+TS_arrow_tri_each_and(TRISTATE value, size_t num, size_t offset,
+                      uint8_t *validity, uint8_t *values)
+{
+    assert(values != NULL || num == 0);
+#ifdef TRISTATE_STRICT
+    assert(TS_is_valid_tri(value));
+#endif
+    if (value > 0)
+        return;
+    for (size_t base = 0; base < num; base += TS_WORD_BITS)
+    {
+        const size_t n = (num - base < TS_WORD_BITS ? num - base
+                                                    : TS_WORD_BITS);
+        const TS_WORD bits = TS_arrow_load(values, offset + base, n);
+        if (value < 0)
+        {
+            /* everything becomes TS_FALSE */
+            if (validity)
+                TS_arrow_store(validity, offset + base, n, ~(TS_WORD)0);
+            TS_arrow_store(values, offset + base, n, 0);
+        }
+        else
+        {
+            /* TS_TRUE becomes TS_UNKNOWN */
+            assert(validity != NULL);
+            const TS_WORD known = TS_arrow_load(validity, offset + base, n);
+            TS_arrow_store(validity, offset + base, n, known & ~bits);
+        }
+    }
+}
+
+TRISTATE_INLINE void
+TS_arrow_tri_each_or(TRISTATE value, size_t num, size_t offset,
+                     uint8_t *validity, uint8_t *values)
+{
+    assert(values != NULL || num == 0);
+#ifdef TRISTATE_STRICT
+    assert(TS_is_valid_tri(value));
+#endif
+    if (value < 0)
+        return;
+    for (size_t base = 0; base < num; base += TS_WORD_BITS)
+    {
+        const size_t n = (num - base < TS_WORD_BITS ? num - base
+                                                    : TS_WORD_BITS);
+        const TS_WORD bits = TS_arrow_load(values, offset + base, n);
+        if (value > 0)
+        {
+            /* everything becomes TS_TRUE */
+            if (validity)
+                TS_arrow_store(validity, offset + base, n, ~(TS_WORD)0);
+            TS_arrow_store(values, offset + base, n, ~(TS_WORD)0);
+        }
+        else
+        {
+            /* TS_FALSE becomes TS_UNKNOWN */
+            assert(validity != NULL);
+            const TS_WORD known = TS_arrow_load(validity, offset + base, n);
+            TS_arrow_store(validity, offset + base, n, known & bits);
+        }
+    }
+}
+
+/****************************************************************************/
+/* scans */
+
+/* A running Kleene AND only falls (TS_TRUE, then TS_UNKNOWN, then
+ * TS_FALSE) and a running OR only rises, so a scan is found by two
+ * searches and written by three fills. */
+
+/* fills [0, middle) with head, [middle, last) with TS_UNKNOWN and
+ * [last, num) with tail */
+static TRISTATE_INLINE void
+TS_scan_fill_tri(TRISTATE head, size_t middle, TRISTATE tail, size_t last,
+                 size_t num, TRISTATE *results)
+{
+    assert(middle <= last && last <= num);
+    TS_reset_tri_totality_tri(head, middle, results);
+    TS_reset_tri_totality_tri(TS_UNKNOWN, last - middle, results + middle);
+    TS_reset_tri_totality_tri(tail, num - last, results + last);
+}
+
+TRISTATE_INLINE void
+TS_inclusive_scan_and_tri(size_t num, const TRISTATE *values,
+                          TRISTATE *results)
+{
+    assert(values != NULL || num == 0);
+    assert(results != NULL || num == 0);
+#ifdef TRISTATE_STRICT
+    assert(TS_find_invalid_tri(num, values) == num);
+#endif
+    size_t middle = 0, last;
+    while (middle < num && values[middle] > 0)
+        ++middle;
+    for (last = middle; last < num && values[last] >= 0; ++last)
+        ;
+    TS_scan_fill_tri(TS_TRUE, middle, TS_FALSE, last, num, results);
+}
+
+TRISTATE_INLINE void
+TS_inclusive_scan_or_tri(size_t num, const TRISTATE *values,
+                         TRISTATE *results)
+{
+    assert(values != NULL || num == 0);
+    assert(results != NULL || num == 0);
+#ifdef TRISTATE_STRICT
+    assert(TS_find_invalid_tri(num, values) == num);
+#endif
+    size_t middle = 0, last;
+    while (middle < num && values[middle] < 0)
+        ++middle;
+    for (last = middle; last < num && values[last] <= 0; ++last)
+        ;
+    TS_scan_fill_tri(TS_FALSE, middle, TS_TRUE, last, num, results);
+}
+
+TRISTATE_INLINE void
+TS_exclusive_scan_and_tri(size_t num, const TRISTATE *values,
+                          TRISTATE *results)
+{
+    assert(values != NULL || num == 0);
+    assert(results != NULL || num == 0);
+#ifdef TRISTATE_STRICT
+    assert(TS_find_invalid_tri(num, values) == num);
+#endif
+    size_t middle = 0, last;
+    while (middle < num && values[middle] > 0)
+        ++middle;
+    for (last = middle; last < num && values[last] >= 0; ++last)
+        ;
+    middle = (middle < num ? middle + 1 : num);
+    last = (last < num ? last + 1 : num);
+    TS_scan_fill_tri(TS_TRUE, middle, TS_FALSE, last, num, results);
+}
+
+TRISTATE_INLINE void
+TS_exclusive_scan_or_tri(size_t num, const TRISTATE *values,
+                         TRISTATE *results)
+{
+    assert(values != NULL || num == 0);
+    assert(results != NULL || num == 0);
+#ifdef TRISTATE_STRICT
+    assert(TS_find_invalid_tri(num, values) == num);
+#endif
+    size_t middle = 0, last;
+    while (middle < num && values[middle] < 0)
+        ++middle;
+    for (last = middle; last < num && values[last] <= 0; ++last)
+        ;
+    middle = (middle < num ? middle + 1 : num);
+    last = (last < num ? last + 1 : num);
+    TS_scan_fill_tri(TS_FALSE, middle, TS_TRUE, last, num, results);
+}
+
+/* The packed scans work in place on the planes.  For AND, the trues
+ * keep a prefix and the falses a suffix; for OR, the other way round. */
+
+static TRISTATE_INLINE void
+TS_packed_scan(bool is_or, bool inclusive, size_t num,
+               TS_WORD *trues, TS_WORD *falses)
+{
+    assert(trues != NULL || num == 0);
+    assert(falses != NULL || num == 0);
+    TS_WORD *heads = (is_or ? falses : trues);
+    TS_WORD *tails = (is_or ? trues : falses);
+    size_t middle = TS_bits_find(false, 0, num, heads);
+    size_t last = TS_bits_find(true, 0, num, tails);
+    if (!inclusive)
+    {
+        middle = (middle < num ? middle + 1 : num);
+        last = (last < num ? last + 1 : num);
+    }
+    TS_bits_set_range(true, 0, middle, heads);
+    TS_bits_set_range(false, middle, num, heads);
+    TS_bits_set_range(false, 0, last, tails);
+    TS_bits_set_range(true, last, num, tails);
+}
+
+TRISTATE_INLINE void
+TS_packed_inclusive_scan_and(size_t num, TS_WORD *trues, TS_WORD *falses)
+{
+    TS_packed_scan(false, true, num, trues, falses);
+}
+
+TRISTATE_INLINE void
+TS_packed_inclusive_scan_or(size_t num, TS_WORD *trues, TS_WORD *falses)
+{
+    TS_packed_scan(true, true, num, trues, falses);
+}
+
+TRISTATE_INLINE void
+TS_packed_exclusive_scan_and(size_t num, TS_WORD *trues, TS_WORD *falses)
+{
+    TS_packed_scan(false, false, num, trues, falses);
+}
+
+TRISTATE_INLINE void
+TS_packed_exclusive_scan_or(size_t num, TS_WORD *trues, TS_WORD *falses)
+{
+    TS_packed_scan(true, false, num, trues, falses);
+}
+
+/****************************************************************************/
+/* segmented reductions */
+
+/* Segment i is values[offsets[i]] to values[offsets[i + 1] - 1].  Each
+ * segment is reduced in blocks of 64 elements without branches, and
+ * tested for a short-circuit once per block, so that short segments
+ * cost no more than a loop and long ones still stop early. */
+
+TRISTATE_INLINE bool
+TS_is_valid_offsets(size_t num_segments, const size_t *offsets)
+{
+    assert(offsets != NULL);
+    for (size_t i = 0; i < num_segments; ++i)
+    {
+        if (offsets[i] > offsets[i + 1])
+            return false;
+    }
+    return true;
+}
+
+TRISTATE_INLINE void
+TS_segmented_connect_and_tri(size_t num_segments, const size_t *offsets,
+                             const TRISTATE *values, TRISTATE *results)
+{
+    assert(offsets != NULL);
+    assert(values != NULL || offsets[num_segments] == offsets[0]);
+    assert(results != NULL || num_segments == 0);
+#ifdef TRISTATE_STRICT
+    assert(TS_is_valid_offsets(num_segments, offsets));
+    assert(TS_find_invalid_tri(offsets[num_segments] - offsets[0],
+                               values + offsets[0]) ==
+           offsets[num_segments] - offsets[0]);
+#endif
+    for (size_t i = 0; i < num_segments; ++i)
+    {
+        const TRISTATE *first = values + offsets[i];
+        const TRISTATE *last = values + offsets[i + 1];
+        int value = TS_TRUE;
+        while (first < last)
+        {
+            const TRISTATE *end = (last - first > 64 ? first + 64 : last);
+            for (; first < end; ++first)
+                value = (*first < value ? *first : value);
+            if (value < 0)
+                break;
+        }
+        results[i] = (TRISTATE)value;
+    }
+}
+
+TRISTATE_INLINE void
+TS_segmented_connect_or_tri(size_t num_segments, const size_t *offsets,
+                            const TRISTATE *values, TRISTATE *results)
+{
+    assert(offsets != NULL);
+    assert(values != NULL || offsets[num_segments] == offsets[0]);
+    assert(results != NULL || num_segments == 0);
+#ifdef TRISTATE_STRICT
+    assert(TS_is_valid_offsets(num_segments, offsets));
+    assert(TS_find_invalid_tri(offsets[num_segments] - offsets[0],
+                               values + offsets[0]) ==
+           offsets[num_segments] - offsets[0]);
+#endif
+    for (size_t i = 0; i < num_segments; ++i)
+    {
+        const TRISTATE *first = values + offsets[i];
+        const TRISTATE *last = values + offsets[i + 1];
+        int value = TS_FALSE;
+        while (first < last)
+        {
+            const TRISTATE *end = (last - first > 64 ? first + 64 : last);
+            for (; first < end; ++first)
+                value = (*first > value ? *first : value);
+            if (value > 0)
+                break;
+        }
+        results[i] = (TRISTATE)value;
+    }
+}
+
+TRISTATE_INLINE void
+TS_segmented_get_tri_totality_tri(size_t num_segments, const size_t *offsets,
+                                  const TRISTATE *values, TRISTATE *results)
+{
+    assert(offsets != NULL);
+    assert(values != NULL || offsets[num_segments] == offsets[0]);
+    assert(results != NULL || num_segments == 0);
+#ifdef TRISTATE_STRICT
+    assert(TS_is_valid_offsets(num_segments, offsets));
+    assert(TS_find_invalid_tri(offsets[num_segments] - offsets[0],
+                               values + offsets[0]) ==
+           offsets[num_segments] - offsets[0]);
+#endif
+    for (size_t i = 0; i < num_segments; ++i)
+    {
+        const TRISTATE *first = values + offsets[i];
+        const TRISTATE *last = values + offsets[i + 1];
+        int lowest = 0, highest = 0;
+        while (first < last)
+        {
+            const TRISTATE *end = (last - first > 64 ? first + 64 : last);
+            for (; first < end; ++first)
+            {
+                lowest = (*first < lowest ? *first : lowest);
+                highest = (*first > highest ? *first : highest);
+            }
+            if (lowest < 0 && highest > 0)
+                break;
+        }
+        if ((lowest < 0) == (highest > 0))
+            results[i] = TS_UNKNOWN;
+        else
+            results[i] = (lowest < 0 ? TS_FALSE : TS_TRUE);
+    }
+}
+
 /****************************************************************************/
 
 #ifdef __cplusplus